@@ -2,14 +2,25 @@
 // Created by kok on 08.09.24.
 //
 
+#include <stdatomic.h>
+
+#include "freertos/FreeRTOS.h"
 #include "esp_spiffs.h"
 #include "esp_log.h"
 
+#include "tasks_common.h"
+#include "boot_stats/boot_stats.h"
 #include "app_spiffs.h"
 
 static const char TAG[] = "app_spiffs";
 
-void app_spiffs_init(void) {
+static atomic_bool g_started = false;
+static atomic_bool g_mounted = false;
+
+/**
+ * Registers the partition and marks the boot phase once files can be opened. Must only run once.
+ */
+static void app_spiffs_mount(void) {
     ESP_LOGI(TAG, "Initializing SPIFFS...");
     const esp_vfs_spiffs_conf_t spiffs_conf = {
         .base_path = "/spiffs",
@@ -22,4 +33,33 @@ void app_spiffs_init(void) {
     esp_spiffs_info(NULL, &total_spiffs_size, &used_spiffs_size);
     ESP_LOGI(TAG, "SPIFFS successfully initialized");
     ESP_LOGI(TAG, "SPIFFS total size: %d, used size: %d", total_spiffs_size, used_spiffs_size);
+    atomic_store(&g_mounted, true);
+    boot_stats_mark(BOOT_STATS_PHASE_SPIFFS_UP);
+}
+
+static void app_spiffs_mount_task(void *pvParams) {
+    app_spiffs_mount();
+    vTaskDelete(NULL);
+}
+
+void app_spiffs_init(void) {
+    if (atomic_exchange(&g_started, true)) return;
+    app_spiffs_mount();
+}
+
+void app_spiffs_mount_async(void) {
+    if (atomic_load(&g_started) || atomic_exchange(&g_started, true)) return;
+    xTaskCreatePinnedToCore(
+        &app_spiffs_mount_task,
+        "app_spiffs_mount_task",
+        APP_BOOT_TASK_STACK_SIZE,
+        NULL,
+        APP_BOOT_TASK_PRIORITY,
+        NULL,
+        APP_BOOT_TASK_CORE_ID
+    );
+}
+
+bool app_spiffs_is_mounted(void) {
+    return atomic_load(&g_mounted);
 }
@@ -5,9 +5,22 @@
 #ifndef APP_SPIFFS_H
 #define APP_SPIFFS_H
 
+#include <stdbool.h>
+
 /**
-* Initialize the SPIFFS storage
+* Initialize the SPIFFS storage. Does nothing if it was already started.
 */
 void app_spiffs_init(void);
 
+/**
+ * Mounts the SPIFFS storage in a background task unless it was already started.
+ * Files can't be opened until the mount has finished.
+ */
+void app_spiffs_mount_async(void);
+
+/**
+ * @return true once files can be opened
+ */
+bool app_spiffs_is_mounted(void);
+
 #endif //APP_SPIFFS_H
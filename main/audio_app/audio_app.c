@@ -0,0 +1,134 @@
+//
+// Created by kok on 19.10.26.
+//
+
+#include <string.h>
+
+#include "freertos/FreeRTOS.h"
+#include "driver/i2s_std.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+
+#include "tasks_common.h"
+#include "seqlock/seqlock.h"
+#include "audio_app.h"
+
+static const char TAG[] = "audio_app";
+
+static i2s_chan_handle_t g_rx_chan = NULL;
+static audio_dsp_t g_dsp;
+static audio_app_stats_t g_stats;
+
+/**
+ * Band energies published by the audio task (the only writer)
+ */
+static seqlock_t g_bands_lock;
+static audio_dsp_bands_t g_bands;
+
+// --------- BAND ENERGIES HANDOFF --------- //
+
+static void audio_app_publish_bands(const audio_dsp_bands_t *bands) {
+    seqlock_write_begin(&g_bands_lock);
+    memcpy(&g_bands, bands, sizeof(audio_dsp_bands_t));
+    seqlock_write_end(&g_bands_lock);
+}
+
+bool audio_app_get_bands(audio_dsp_bands_t *bands) {
+    uint32_t seq;
+    do {
+        seq = seqlock_read_begin(&g_bands_lock);
+        memcpy(bands, &g_bands, sizeof(audio_dsp_bands_t));
+    } while (seqlock_read_retry(&g_bands_lock, seq));
+    return seq != 0;
+}
+
+// --------- AUDIO TASK --------- //
+
+/**
+ * Reads blocks from the microphone and runs them through the DSP stage
+ */
+static void audio_app_task(void *pvParams) {
+    static int32_t raw[AUDIO_DSP_FFT_SIZE];
+    static int16_t samples[AUDIO_DSP_FFT_SIZE];
+    audio_dsp_bands_t bands;
+
+    audio_dsp_init(&g_dsp);
+    while (1) {
+        size_t bytes_read = 0;
+        const esp_err_t err = i2s_channel_read(g_rx_chan, raw, sizeof(raw), &bytes_read, portMAX_DELAY);
+        if (err != ESP_OK || bytes_read != sizeof(raw)) {
+            ESP_LOGE(TAG, "Failed to read audio block: %s", esp_err_to_name(err));
+            continue;
+        }
+
+        const int64_t start_us = esp_timer_get_time();
+        for (int i = 0; i < AUDIO_DSP_FFT_SIZE; i++) {
+            int32_t sample = raw[i] >> AUDIO_APP_SAMPLE_SHIFT;
+            if (sample > INT16_MAX) sample = INT16_MAX;
+            else if (sample < INT16_MIN) sample = INT16_MIN;
+            samples[i] = (int16_t)sample;
+        }
+        audio_dsp_process_block(&g_dsp, samples, &bands);
+        audio_app_publish_bands(&bands);
+
+        g_stats.last_block_us = esp_timer_get_time() - start_us;
+        g_stats.total_block_us += g_stats.last_block_us;
+        if (g_stats.last_block_us > g_stats.max_block_us) g_stats.max_block_us = g_stats.last_block_us;
+        if (++g_stats.blocks % AUDIO_APP_STATS_LOG_BLOCKS == 0) {
+            ESP_LOGI(TAG, "DSP cost per %d sample block: avg %llu us, max %lu us (block period %d us)",
+                AUDIO_DSP_FFT_SIZE, g_stats.total_block_us / g_stats.blocks, g_stats.max_block_us,
+                AUDIO_DSP_FFT_SIZE * 1000 / (AUDIO_APP_SAMPLE_RATE / 1000));
+        }
+    }
+}
+
+// --------- INITIAL CONFIGURATION --------- //
+
+esp_err_t audio_app_init(void) {
+    ESP_LOGI(TAG, "Initializing audio application...");
+
+    const i2s_chan_config_t chan_config = I2S_CHANNEL_DEFAULT_CONFIG(I2S_NUM_AUTO, I2S_ROLE_MASTER);
+    esp_err_t err = i2s_new_channel(&chan_config, NULL, &g_rx_chan);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to create I2S RX channel: %s", esp_err_to_name(err));
+        return err;
+    }
+
+    const i2s_std_config_t std_config = {
+        .clk_cfg = I2S_STD_CLK_DEFAULT_CONFIG(AUDIO_APP_SAMPLE_RATE),
+        .slot_cfg = I2S_STD_PHILIPS_SLOT_DEFAULT_CONFIG(I2S_DATA_BIT_WIDTH_32BIT, I2S_SLOT_MODE_MONO),
+        .gpio_cfg = {
+            .mclk = I2S_GPIO_UNUSED,
+            .bclk = AUDIO_APP_I2S_BCLK_GPIO,
+            .ws = AUDIO_APP_I2S_WS_GPIO,
+            .dout = I2S_GPIO_UNUSED,
+            .din = AUDIO_APP_I2S_DIN_GPIO,
+        },
+    };
+    err = i2s_channel_init_std_mode(g_rx_chan, &std_config);
+    if (err == ESP_OK) err = i2s_channel_enable(g_rx_chan);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to start I2S RX channel: %s", esp_err_to_name(err));
+        i2s_del_channel(g_rx_chan);
+        g_rx_chan = NULL;
+        return err;
+    }
+
+    // The DSP stage runs on the core which is not used for rendering
+    xTaskCreatePinnedToCore(
+        &audio_app_task,
+        "audio_app_task",
+        AUDIO_APP_TASK_STACK_SIZE,
+        NULL,
+        AUDIO_APP_TASK_PRIORITY,
+        NULL,
+        AUDIO_APP_TASK_CORE_ID
+    );
+
+    ESP_LOGI(TAG, "Audio application successfully initialized!");
+    return ESP_OK;
+}
+
+audio_app_stats_t audio_app_get_stats(void) {
+    return g_stats;
+}
@@ -0,0 +1,49 @@
+//
+// Created by kok on 19.10.26.
+//
+
+#ifndef AUDIO_APP_H
+#define AUDIO_APP_H
+
+#include "esp_err.h"
+
+#include "audio_dsp.h"
+
+#define AUDIO_APP_I2S_BCLK_GPIO         26
+#define AUDIO_APP_I2S_WS_GPIO           25
+#define AUDIO_APP_I2S_DIN_GPIO          33
+#define AUDIO_APP_SAMPLE_RATE           16000
+#define AUDIO_APP_SAMPLE_SHIFT          14    // 24 bit microphone data in 32 bit slots -> Q15 with some gain
+
+#define AUDIO_APP_STATS_LOG_BLOCKS      1000
+
+/**
+ * DSP stage statistics
+ */
+typedef struct {
+    uint32_t blocks;
+    uint32_t last_block_us;
+    uint32_t max_block_us;
+    uint64_t total_block_us;
+} audio_app_stats_t;
+
+/**
+ * Start the I2S sample ingestion and DSP task. Only called when built with AUDIO_APP_ENABLED,
+ * otherwise the pins stay free and the audio mode shows a dark strip.
+ * @return ESP_OK if the microphone channel was started
+ */
+esp_err_t audio_app_init(void);
+
+/**
+ * Lock-free read of the latest band energies
+ * @param bands output band energies
+ * @return false if no block has been processed yet
+ */
+bool audio_app_get_bands(audio_dsp_bands_t *bands);
+
+/**
+ * Gets the DSP stage statistics
+ */
+audio_app_stats_t audio_app_get_stats(void);
+
+#endif //AUDIO_APP_H
@@ -0,0 +1,101 @@
+//
+// Created by kok on 19.10.26.
+//
+
+#include <math.h>
+#include <string.h>
+
+#include "audio_dsp.h"
+
+/**
+ * Upper FFT bin (exclusive) of every band. Bin width is sample_rate / AUDIO_DSP_FFT_SIZE.
+ */
+static const uint8_t g_band_edges[AUDIO_DSP_BANDS_COUNT + 1] = {1, 2, 4, 8, 16, 32, 64, 96, 128};
+
+static int16_t g_sin_table[AUDIO_DSP_FFT_SIZE];
+static int16_t g_window[AUDIO_DSP_FFT_SIZE];
+static bool g_tables_ready = false;
+
+// --------- FFT --------- //
+
+static void audio_dsp_bit_reverse(int16_t *re, int16_t *im) {
+    for (uint32_t i = 1, j = 0; i < AUDIO_DSP_FFT_SIZE; i++) {
+        uint32_t bit = AUDIO_DSP_FFT_SIZE >> 1;
+        for (; j & bit; bit >>= 1) j ^= bit;
+        j ^= bit;
+        if (i < j) {
+            int16_t tmp = re[i]; re[i] = re[j]; re[j] = tmp;
+            tmp = im[i]; im[i] = im[j]; im[j] = tmp;
+        }
+    }
+}
+
+void audio_dsp_fft_q15(int16_t *re, int16_t *im) {
+    audio_dsp_bit_reverse(re, im);
+    for (uint32_t size = 2; size <= AUDIO_DSP_FFT_SIZE; size <<= 1) {
+        const uint32_t half = size >> 1;
+        const uint32_t step = AUDIO_DSP_FFT_SIZE / size;
+        for (uint32_t i = 0; i < AUDIO_DSP_FFT_SIZE; i += size) {
+            for (uint32_t j = 0; j < half; j++) {
+                const int32_t wr = g_sin_table[j * step + AUDIO_DSP_FFT_SIZE / 4];
+                const int32_t wi = -g_sin_table[j * step];
+                const uint32_t a = i + j;
+                const uint32_t b = a + half;
+                const int32_t tr = (wr * re[b] - wi * im[b]) >> 15;
+                const int32_t ti = (wr * im[b] + wi * re[b]) >> 15;
+                re[b] = (re[a] - tr) >> 1;
+                im[b] = (im[a] - ti) >> 1;
+                re[a] = (re[a] + tr) >> 1;
+                im[a] = (im[a] + ti) >> 1;
+            }
+        }
+    }
+}
+
+// --------- BLOCK PROCESSING --------- //
+
+void audio_dsp_init(audio_dsp_t *dsp) {
+    if (!g_tables_ready) {
+        for (int i = 0; i < AUDIO_DSP_FFT_SIZE; i++) {
+            g_sin_table[i] = (int16_t)(32767.0 * sin(2.0 * M_PI * i / AUDIO_DSP_FFT_SIZE));
+            g_window[i] = (int16_t)(32767.0 * 0.5 * (1.0 - cos(2.0 * M_PI * i / (AUDIO_DSP_FFT_SIZE - 1))));
+        }
+        g_tables_ready = true;
+    }
+    memset(dsp, 0, sizeof(audio_dsp_t));
+    for (int b = 0; b < AUDIO_DSP_BANDS_COUNT; b++) dsp->band_peaks[b] = AUDIO_DSP_BEAT_MIN_ENERGY;
+}
+
+void audio_dsp_process_block(audio_dsp_t *dsp, const int16_t *samples, audio_dsp_bands_t *bands) {
+    // Apply the Hann window
+    for (int i = 0; i < AUDIO_DSP_FFT_SIZE; i++) {
+        dsp->re[i] = (int16_t)(((int32_t)samples[i] * g_window[i]) >> 15);
+        dsp->im[i] = 0;
+    }
+
+    audio_dsp_fft_q15(dsp->re, dsp->im);
+
+    // Sum the bin powers of every band and normalize against a decaying peak
+    for (int b = 0; b < AUDIO_DSP_BANDS_COUNT; b++) {
+        uint64_t energy = 0;
+        for (int k = g_band_edges[b]; k < g_band_edges[b + 1]; k++)
+            energy += (int32_t)dsp->re[k] * dsp->re[k] + (int32_t)dsp->im[k] * dsp->im[k];
+        bands->energies[b] = energy > UINT32_MAX ? UINT32_MAX : (uint32_t)energy;
+
+        uint32_t *peak = &dsp->band_peaks[b];
+        if (bands->energies[b] > *peak) *peak = bands->energies[b];
+        else if (*peak > AUDIO_DSP_BEAT_MIN_ENERGY) *peak -= *peak >> 7;
+        bands->levels[b] = (uint8_t)((uint64_t)bands->energies[b] * 255 / *peak);
+    }
+
+    // Beat = bass energy well above its running average
+    uint64_t bass = 0;
+    for (int b = 0; b < AUDIO_DSP_BEAT_BANDS; b++) bass += bands->energies[b];
+    if (bass > UINT32_MAX) bass = UINT32_MAX;
+
+    if (dsp->beat_holdoff > 0) dsp->beat_holdoff--;
+    bands->beat = dsp->beat_holdoff == 0 && bass > AUDIO_DSP_BEAT_MIN_ENERGY && bass * 2 > (uint64_t)dsp->beat_average * 3;
+    if (bands->beat) dsp->beat_holdoff = AUDIO_DSP_BEAT_REFRACTORY;
+
+    dsp->beat_average += ((int64_t)bass - dsp->beat_average) / 16;
+}
@@ -0,0 +1,59 @@
+//
+// Created by kok on 19.10.26.
+//
+
+#ifndef AUDIO_DSP_H
+#define AUDIO_DSP_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define AUDIO_DSP_FFT_BITS              8
+#define AUDIO_DSP_FFT_SIZE              (1 << AUDIO_DSP_FFT_BITS)
+#define AUDIO_DSP_BANDS_COUNT           8
+
+#define AUDIO_DSP_BEAT_BANDS            2     // Lowest bands used for beat detection
+#define AUDIO_DSP_BEAT_MIN_ENERGY       2048  // Ignore beats below the noise floor
+#define AUDIO_DSP_BEAT_REFRACTORY       12    // Blocks to ignore after a detected beat
+
+/**
+ * Band energies produced from one block of samples
+ */
+typedef struct {
+    uint8_t levels[AUDIO_DSP_BANDS_COUNT];     // Per band level normalized to 0-255
+    uint32_t energies[AUDIO_DSP_BANDS_COUNT];  // Raw per band energy
+    bool beat;
+} audio_dsp_bands_t;
+
+/**
+ * DSP stage state carried between blocks
+ */
+typedef struct {
+    int16_t re[AUDIO_DSP_FFT_SIZE];
+    int16_t im[AUDIO_DSP_FFT_SIZE];
+    uint32_t band_peaks[AUDIO_DSP_BANDS_COUNT];
+    uint32_t beat_average;
+    uint8_t beat_holdoff;
+} audio_dsp_t;
+
+/**
+ * Initializes the DSP state and the shared window / twiddle tables
+ */
+void audio_dsp_init(audio_dsp_t *dsp);
+
+/**
+ * In-place radix-2 Q15 FFT. Every stage is scaled by 1/2 so the result never overflows.
+ * @param re real parts
+ * @param im imaginary parts
+ */
+void audio_dsp_fft_q15(int16_t *re, int16_t *im);
+
+/**
+ * Runs one block through window -> FFT -> band energies -> beat detection
+ * @param dsp DSP state
+ * @param samples AUDIO_DSP_FFT_SIZE Q15 samples
+ * @param bands output band energies
+ */
+void audio_dsp_process_block(audio_dsp_t *dsp, const int16_t *samples, audio_dsp_bands_t *bands);
+
+#endif //AUDIO_DSP_H
@@ -0,0 +1,55 @@
+//
+// Created by kok on 19.10.26.
+//
+
+#include "freertos/FreeRTOS.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+
+#include "boot_stats.h"
+
+static const char TAG[] = "boot_stats";
+
+static const char *g_phase_names[BOOT_STATS_PHASES_COUNT] = {
+    [BOOT_STATS_PHASE_FIRST_PHOTON] = "first_photon",
+    [BOOT_STATS_PHASE_SPIFFS_UP] = "spiffs_up",
+    [BOOT_STATS_PHASE_HTTP_UP] = "http_up",
+    [BOOT_STATS_PHASE_WIFI_UP] = "wifi_up",
+    [BOOT_STATS_PHASE_MQTT_UP] = "mqtt_up",
+};
+
+/**
+ * Phase timestamps in microseconds since startup. A timestamp is only valid once its g_phase_reached flag is set,
+ * boot_stats_get() reports an unreached phase as -1. Both are written under g_phase_lock.
+ */
+static int64_t g_phase_us[BOOT_STATS_PHASES_COUNT];
+static bool g_phase_reached[BOOT_STATS_PHASES_COUNT];
+static portMUX_TYPE g_phase_lock = portMUX_INITIALIZER_UNLOCKED;
+
+void boot_stats_mark(boot_stats_phase_e phase) {
+    // Cheap check first, this is called on every rendered frame
+    if (phase >= BOOT_STATS_PHASES_COUNT || g_phase_reached[phase]) return;
+
+    const int64_t now_us = esp_timer_get_time();
+    portENTER_CRITICAL(&g_phase_lock);
+    const bool first = !g_phase_reached[phase];
+    if (first) {
+        g_phase_us[phase] = now_us;
+        g_phase_reached[phase] = true;
+    }
+    portEXIT_CRITICAL(&g_phase_lock);
+
+    if (first) ESP_LOGI(TAG, "Boot phase %s reached after %lld ms", g_phase_names[phase], now_us / 1000);
+}
+
+int64_t boot_stats_get(boot_stats_phase_e phase) {
+    if (phase >= BOOT_STATS_PHASES_COUNT) return -1;
+    portENTER_CRITICAL(&g_phase_lock);
+    const int64_t us = g_phase_reached[phase] ? g_phase_us[phase] : -1;
+    portEXIT_CRITICAL(&g_phase_lock);
+    return us;
+}
+
+const char *boot_stats_phase_name(boot_stats_phase_e phase) {
+    return phase < BOOT_STATS_PHASES_COUNT ? g_phase_names[phase] : "unknown";
+}
@@ -0,0 +1,40 @@
+//
+// Created by kok on 19.10.26.
+//
+
+#ifndef BOOT_STATS_H
+#define BOOT_STATS_H
+
+#include <stdint.h>
+
+/**
+ * Boot phases which are timestamped once
+ */
+typedef enum {
+    BOOT_STATS_PHASE_FIRST_PHOTON,
+    BOOT_STATS_PHASE_SPIFFS_UP,
+    BOOT_STATS_PHASE_HTTP_UP,
+    BOOT_STATS_PHASE_WIFI_UP,
+    BOOT_STATS_PHASE_MQTT_UP,
+    BOOT_STATS_PHASES_COUNT
+} boot_stats_phase_e;
+
+/**
+ * Records the time of the phase. Only the first call per phase is recorded.
+ * @param phase boot_stats_phase_e
+ */
+void boot_stats_mark(boot_stats_phase_e phase);
+
+/**
+ * Gets the time of the phase
+ * @param phase boot_stats_phase_e
+ * @return microseconds since startup or -1 if the phase was not reached yet
+ */
+int64_t boot_stats_get(boot_stats_phase_e phase);
+
+/**
+ * Gets the name of the phase as used in logs and the stats endpoint
+ */
+const char *boot_stats_phase_name(boot_stats_phase_e phase);
+
+#endif //BOOT_STATS_H
@@ -560,6 +560,32 @@ static cJSON_bool compare_double(double a, double b)
     return (fabs(a - b) <= maxVal * DBL_EPSILON);
 }
 
+/* format an int without sprintf or locale lookups, returns the number of characters written (at most 11) */
+static int print_integer(unsigned char * const buffer, int value)
+{
+    unsigned char digits[10];
+    unsigned int magnitude = (value < 0) ? (0u - (unsigned int)value) : (unsigned int)value;
+    int count = 0;
+    int length = 0;
+
+    do
+    {
+        digits[count++] = (unsigned char)('0' + (magnitude % 10));
+        magnitude /= 10;
+    } while (magnitude != 0);
+
+    if (value < 0)
+    {
+        buffer[length++] = '-';
+    }
+    while (count > 0)
+    {
+        buffer[length++] = digits[--count];
+    }
+
+    return length;
+}
+
 /* Render the number nicely from the given item into a string. */
 static cJSON_bool print_number(const cJSON * const item, printbuffer * const output_buffer)
 {
@@ -568,7 +594,7 @@ static cJSON_bool print_number(const cJSON * const item, printbuffer * const out
     int length = 0;
     size_t i = 0;
     unsigned char number_buffer[26] = {0}; /* temporary buffer to print the number into */
-    unsigned char decimal_point = get_decimal_point();
+    unsigned char decimal_point = '.';
     double test = 0.0;
 
     if (output_buffer == NULL)
@@ -576,15 +602,30 @@ static cJSON_bool print_number(const cJSON * const item, printbuffer * const out
         return false;
     }
 
+    /* Integral values within int range are written straight to the output, there is no
+     * decimal point to localize and nothing to round trip. NaN and Infinity never compare equal here
+     * because valueint saturates at INT_MAX / INT_MIN. */
+    if (d == (double)item->valueint)
+    {
+        length = print_integer(number_buffer, item->valueint);
+        output_pointer = ensure(output_buffer, (size_t)length + sizeof(""));
+        if (output_pointer == NULL)
+        {
+            return false;
+        }
+        memcpy(output_pointer, number_buffer, (size_t)length);
+        output_pointer[length] = '\0';
+        output_buffer->offset += (size_t)length;
+        return true;
+    }
+
+    decimal_point = get_decimal_point();
+
     /* This checks for NaN and Infinity */
     if (isnan(d) || isinf(d))
     {
         length = sprintf((char*)number_buffer, "null");
     }
-    else if(d == (double)item->valueint)
-    {
-        length = sprintf((char*)number_buffer, "%d", item->valueint);
-    }
     else
     {
         /* Try 15 decimal places of precision to avoid nonsignificant nonzero digits */
@@ -1202,6 +1243,134 @@ CJSON_PUBLIC(cJSON *) cJSON_ParseWithLength(const char *value, size_t buffer_len
     return cJSON_ParseWithLengthOpts(value, buffer_length, 0, 0);
 }
 
+/* Parse a JSON array of integers within [0, max_value] straight into a caller supplied buffer.
+ * The text is walked once and no nodes are created. */
+static cJSON_bool parse_integer_array(const char *value, size_t buffer_length, unsigned long max_value, unsigned char *out_bytes, unsigned short *out_words, size_t capacity, size_t *count)
+{
+    const unsigned char *content = (const unsigned char*)value;
+    size_t offset = 0;
+    size_t parsed = 0;
+
+    /* reset error position */
+    global_error.json = NULL;
+    global_error.position = 0;
+
+    if (value == NULL || buffer_length == 0)
+    {
+        return false;
+    }
+
+    while ((offset < buffer_length) && (content[offset] != '\0') && (content[offset] <= 32))
+    {
+        offset++;
+    }
+    if ((offset >= buffer_length) || (content[offset] != '['))
+    {
+        goto fail;
+    }
+    offset++;
+
+    for (;;)
+    {
+        unsigned long number = 0;
+        size_t digits = 0;
+
+        while ((offset < buffer_length) && (content[offset] != '\0') && (content[offset] <= 32))
+        {
+            offset++;
+        }
+        if ((parsed == 0) && (offset < buffer_length) && (content[offset] == ']'))
+        {
+            break;
+        }
+
+        while ((offset < buffer_length) && (content[offset] >= '0') && (content[offset] <= '9'))
+        {
+            /* JSON doesn't allow leading zeros */
+            if ((digits == 1) && (number == 0))
+            {
+                goto fail;
+            }
+            number = number * 10 + (unsigned long)(content[offset] - '0');
+            if (number > max_value)
+            {
+                goto fail;
+            }
+            offset++;
+            digits++;
+        }
+        if ((digits == 0) || (parsed >= capacity))
+        {
+            goto fail;
+        }
+        if (out_bytes != NULL)
+        {
+            out_bytes[parsed] = (unsigned char)number;
+        }
+        else
+        {
+            out_words[parsed] = (unsigned short)number;
+        }
+        parsed++;
+
+        while ((offset < buffer_length) && (content[offset] != '\0') && (content[offset] <= 32))
+        {
+            offset++;
+        }
+        if ((offset < buffer_length) && (content[offset] == ','))
+        {
+            offset++;
+            continue;
+        }
+        if ((offset < buffer_length) && (content[offset] == ']'))
+        {
+            break;
+        }
+        /* fractions, exponents, signs and anything else end up here */
+        goto fail;
+    }
+    offset++;
+
+    /* only whitespace or a null terminator may follow the array */
+    while ((offset < buffer_length) && (content[offset] != '\0') && (content[offset] <= 32))
+    {
+        offset++;
+    }
+    if ((offset < buffer_length) && (content[offset] != '\0'))
+    {
+        goto fail;
+    }
+
+    if (count != NULL)
+    {
+        *count = parsed;
+    }
+    return true;
+
+fail:
+    global_error.json = content;
+    global_error.position = (offset < buffer_length) ? offset : buffer_length - 1;
+    return false;
+}
+
+CJSON_PUBLIC(cJSON_bool) cJSON_ParseUInt8Array(const char *value, size_t buffer_length, unsigned char *out, size_t capacity, size_t *count)
+{
+    if (out == NULL)
+    {
+        return false;
+    }
+    return parse_integer_array(value, buffer_length, 0xFF, out, NULL, capacity, count);
+}
+
+CJSON_PUBLIC(cJSON_bool) cJSON_ParseUInt16Array(const char *value, size_t buffer_length, unsigned short *out, size_t capacity, size_t *count)
+{
+    if (out == NULL)
+    {
+        return false;
+    }
+    return parse_integer_array(value, buffer_length, 0xFFFF, NULL, out, capacity, count);
+}
+
 #define cjson_min(a, b) (((a) < (b)) ? (a) : (b))
 
 static unsigned char *print(const cJSON * const item, cJSON_bool format, const internal_hooks * const hooks)
@@ -151,6 +151,11 @@ CJSON_PUBLIC(cJSON *) cJSON_ParseWithLength(const char *value, size_t buffer_len
 /* If you supply a ptr in return_parse_end and parsing fails, then return_parse_end will contain a pointer to the error so will match cJSON_GetErrorPtr(). */
 CJSON_PUBLIC(cJSON *) cJSON_ParseWithOpts(const char *value, const char **return_parse_end, cJSON_bool require_null_terminated);
 CJSON_PUBLIC(cJSON *) cJSON_ParseWithLengthOpts(const char *value, size_t buffer_length, const char **return_parse_end, cJSON_bool require_null_terminated);
+/* Parse a JSON array of non-negative integers straight into a caller supplied buffer, without creating any nodes.
+ * Fails on other values, on leading zeros, on numbers above 255 (65535 for UInt16) and if the array has more than capacity elements.
+ * On success count receives the number of elements. On failure cJSON_GetErrorPtr() points at the offending character. */
+CJSON_PUBLIC(cJSON_bool) cJSON_ParseUInt8Array(const char *value, size_t buffer_length, unsigned char *out, size_t capacity, size_t *count);
+CJSON_PUBLIC(cJSON_bool) cJSON_ParseUInt16Array(const char *value, size_t buffer_length, unsigned short *out, size_t capacity, size_t *count);
 
 /* Render a cJSON entity to text for transfer/storage. */
 CJSON_PUBLIC(char *) cJSON_Print(const cJSON *item);
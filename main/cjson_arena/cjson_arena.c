@@ -0,0 +1,82 @@
+//
+// Created by kok on 19.10.26.
+//
+
+#include <stdatomic.h>
+#include <stdlib.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+
+#include "cjson/cJSON.h"
+#include "cjson_arena.h"
+
+static uint8_t g_buffer[CJSON_ARENA_SIZE] __attribute__((aligned(CJSON_ARENA_ALIGN)));
+static size_t g_used = 0;
+
+/**
+ * Only the owner task allocates from the arena, so g_used needs no lock.
+ * The heap fallback runs on any task, so the counters have their own.
+ */
+static SemaphoreHandle_t g_owner_mutex = NULL;
+static _Atomic(TaskHandle_t) g_owner = NULL;   // Read by every task in the malloc hook
+static cjson_arena_stats_t g_stats;
+static portMUX_TYPE g_stats_lock = portMUX_INITIALIZER_UNLOCKED;
+
+// --------- CJSON HOOKS --------- //
+
+static void *cjson_arena_malloc(size_t size) {
+    if (atomic_load(&g_owner) == xTaskGetCurrentTaskHandle()) {
+        const size_t aligned = (size + CJSON_ARENA_ALIGN - 1) & ~(size_t)(CJSON_ARENA_ALIGN - 1);
+        if (aligned <= CJSON_ARENA_SIZE - g_used) {
+            void *ptr = g_buffer + g_used;
+            g_used += aligned;
+            portENTER_CRITICAL(&g_stats_lock);
+            g_stats.allocs++;
+            portEXIT_CRITICAL(&g_stats_lock);
+            return ptr;
+        }
+    }
+    portENTER_CRITICAL(&g_stats_lock);
+    g_stats.fallbacks++;
+    portEXIT_CRITICAL(&g_stats_lock);
+    return malloc(size);
+}
+
+static void cjson_arena_free(void *ptr) {
+    // Arena memory is released all at once by cjson_arena_end()
+    if ((uint8_t*)ptr >= g_buffer && (uint8_t*)ptr < g_buffer + CJSON_ARENA_SIZE) return;
+    free(ptr);
+}
+
+// --------- PUBLIC METHODS --------- //
+
+void cjson_arena_init(void) {
+    g_owner_mutex = xSemaphoreCreateMutex();
+    cJSON_Hooks hooks = {.malloc_fn = cjson_arena_malloc, .free_fn = cjson_arena_free};
+    cJSON_InitHooks(&hooks);
+}
+
+void cjson_arena_begin(void) {
+    xSemaphoreTake(g_owner_mutex, portMAX_DELAY);
+    g_used = 0;
+    atomic_store(&g_owner, xTaskGetCurrentTaskHandle());
+}
+
+void cjson_arena_end(void) {
+    portENTER_CRITICAL(&g_stats_lock);
+    if (g_used > g_stats.high_water) g_stats.high_water = g_used;
+    g_stats.messages++;
+    portEXIT_CRITICAL(&g_stats_lock);
+    atomic_store(&g_owner, NULL);
+    g_used = 0;
+    xSemaphoreGive(g_owner_mutex);
+}
+
+cjson_arena_stats_t cjson_arena_get_stats(void) {
+    portENTER_CRITICAL(&g_stats_lock);
+    const cjson_arena_stats_t stats = g_stats;
+    portEXIT_CRITICAL(&g_stats_lock);
+    return stats;
+}
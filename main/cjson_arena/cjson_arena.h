@@ -0,0 +1,46 @@
+//
+// Created by kok on 19.10.26.
+//
+
+#ifndef CJSON_ARENA_H
+#define CJSON_ARENA_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define CJSON_ARENA_SIZE                4096
+#define CJSON_ARENA_ALIGN               8
+
+/**
+ * Arena counters
+ */
+typedef struct {
+    uint32_t messages;      // Completed begin/end pairs
+    uint32_t allocs;        // Allocations served by the arena
+    uint32_t fallbacks;     // Allocations which went to the heap because the arena was full or not owned
+    uint32_t high_water;    // Largest arena usage of a single message in bytes
+} cjson_arena_stats_t;
+
+/**
+ * Installs the arena allocator as the cJSON hooks. Call once before any cJSON use.
+ */
+void cjson_arena_init(void);
+
+/**
+ * Claims the arena for the calling task. Every cJSON allocation of this task is a bump allocation until
+ * cjson_arena_end() is called, other tasks keep using the heap. Blocks while another task owns the arena.
+ */
+void cjson_arena_begin(void);
+
+/**
+ * Releases everything allocated since cjson_arena_begin() at once and gives up the ownership.
+ * cJSON_Delete() should still be called before, it frees the heap fallbacks and is a no-op for arena memory.
+ */
+void cjson_arena_end(void);
+
+/**
+ * Gets the arena counters
+ */
+cjson_arena_stats_t cjson_arena_get_stats(void);
+
+#endif //CJSON_ARENA_H
@@ -0,0 +1,187 @@
+//
+// Created by kok on 19.10.26.
+//
+
+#include <errno.h>
+#include <string.h>
+
+#include "freertos/FreeRTOS.h"
+#include "esp_log.h"
+#include "esp_mac.h"
+#include "esp_timer.h"
+#include "lwip/sockets.h"
+
+#include "tasks_common.h"
+#include "seqlock/seqlock.h"
+#include "frame_sync.h"
+
+static const char TAG[] = "frame_sync";
+
+static int g_sock = -1;
+static struct sockaddr_in g_group_addr;
+
+/**
+ * State machine, owned by the sync task
+ */
+static frame_sync_core_t g_core;
+
+/**
+ * Offset and counters published by the sync task (the only writer)
+ */
+static seqlock_t g_offset_lock;
+static int64_t g_offset_us = 0;
+static frame_sync_stats_t g_stats;
+
+// --------- OFFSET HANDOFF --------- //
+
+static void frame_sync_publish(void) {
+    seqlock_write_begin(&g_offset_lock);
+    g_offset_us = g_core.offset_us;
+    g_stats = (frame_sync_stats_t){
+        .role = g_core.role,
+        .leader_id = g_core.leader_id,
+        .offset_us = g_core.offset_us,
+        .last_error_us = g_core.last_error_us,
+        .beacons_rx = g_core.beacons_rx,
+        .beacons_tx = g_core.beacons_tx,
+        .steps = g_core.steps,
+    };
+    seqlock_write_end(&g_offset_lock);
+}
+
+int64_t frame_sync_now_us(void) {
+    int64_t offset_us;
+    uint32_t seq;
+    do {
+        seq = seqlock_read_begin(&g_offset_lock);
+        offset_us = g_offset_us;
+    } while (seqlock_read_retry(&g_offset_lock, seq));
+    return esp_timer_get_time() + offset_us;
+}
+
+frame_sync_stats_t frame_sync_get_stats(void) {
+    frame_sync_stats_t stats;
+    uint32_t seq;
+    do {
+        seq = seqlock_read_begin(&g_offset_lock);
+        stats = g_stats;
+    } while (seqlock_read_retry(&g_offset_lock, seq));
+    return stats;
+}
+
+const char *frame_sync_role_name(frame_sync_role_e role) {
+    switch (role) {
+        case FRAME_SYNC_ROLE_LISTENING: return "listening";
+        case FRAME_SYNC_ROLE_LEADER: return "leader";
+        case FRAME_SYNC_ROLE_FOLLOWER: return "follower";
+        default: return "unknown";
+    }
+}
+
+// --------- SYNC TASK --------- //
+
+/**
+ * Receives beacons and sends its own while it is the leader.
+ * The task wakes up once per beacon or receive timeout, so its cost is bounded by the beacon rate.
+ */
+static void frame_sync_task(void *pvParams) {
+    frame_sync_beacon_t beacon;
+    while (1) {
+        const ssize_t len = recv(g_sock, &beacon, sizeof(beacon), 0);
+        const int64_t now_us = esp_timer_get_time();
+        if (len == sizeof(beacon)) frame_sync_core_on_beacon(&g_core, &beacon, now_us);
+
+        if (frame_sync_core_poll(&g_core, now_us, &beacon) &&
+            sendto(g_sock, &beacon, sizeof(beacon), 0, (struct sockaddr*)&g_group_addr, sizeof(g_group_addr)) < 0)
+            ESP_LOGW(TAG, "Failed to send beacon: errno %d", errno);
+
+        frame_sync_publish();
+    }
+}
+
+// --------- INITIAL CONFIGURATION --------- //
+
+/**
+ * Creates the UDP socket and joins the multicast group
+ */
+static esp_err_t frame_sync_open_socket(void) {
+    g_sock = socket(AF_INET, SOCK_DGRAM, IPPROTO_IP);
+    if (g_sock < 0) {
+        ESP_LOGE(TAG, "Failed to create socket: errno %d", errno);
+        return ESP_FAIL;
+    }
+
+    const int reuse = 1;
+    setsockopt(g_sock, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+
+    // Wake up at least twice per beacon interval to run the role timeouts
+    const struct timeval timeout = {.tv_sec = 0, .tv_usec = FRAME_SYNC_BEACON_INTERVAL_US / 2};
+    setsockopt(g_sock, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+
+    const struct sockaddr_in bind_addr = {
+        .sin_family = AF_INET,
+        .sin_port = htons(FRAME_SYNC_PORT),
+        .sin_addr.s_addr = htonl(INADDR_ANY),
+    };
+    if (bind(g_sock, (const struct sockaddr*)&bind_addr, sizeof(bind_addr)) < 0) {
+        ESP_LOGE(TAG, "Failed to bind socket: errno %d", errno);
+        goto fail;
+    }
+
+    // Beacons stay on the local network and don't come back to the sender
+    const uint8_t ttl = 1;
+    const uint8_t loop = 0;
+    setsockopt(g_sock, IPPROTO_IP, IP_MULTICAST_TTL, &ttl, sizeof(ttl));
+    setsockopt(g_sock, IPPROTO_IP, IP_MULTICAST_LOOP, &loop, sizeof(loop));
+
+    struct ip_mreq mreq = {.imr_interface.s_addr = htonl(INADDR_ANY)};
+    inet_aton(FRAME_SYNC_MULTICAST_ADDR, &mreq.imr_multiaddr);
+    if (setsockopt(g_sock, IPPROTO_IP, IP_ADD_MEMBERSHIP, &mreq, sizeof(mreq)) < 0) {
+        ESP_LOGE(TAG, "Failed to join multicast group %s: errno %d", FRAME_SYNC_MULTICAST_ADDR, errno);
+        goto fail;
+    }
+
+    g_group_addr = (struct sockaddr_in){
+        .sin_family = AF_INET,
+        .sin_port = htons(FRAME_SYNC_PORT),
+        .sin_addr = mreq.imr_multiaddr,
+    };
+    return ESP_OK;
+
+fail:
+    close(g_sock);
+    g_sock = -1;
+    return ESP_FAIL;
+}
+
+esp_err_t frame_sync_init(void) {
+    if (g_sock >= 0) return ESP_OK;
+    ESP_LOGI(TAG, "Initializing frame clock synchronization...");
+
+    // The station MAC is unique on the network, so it doubles as the leader election ID
+    uint8_t mac[6];
+    esp_err_t err = esp_read_mac(mac, ESP_MAC_WIFI_STA);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to read MAC address: %s", esp_err_to_name(err));
+        return err;
+    }
+    uint64_t node_id = 0;
+    for (int i = 0; i < 6; i++) node_id = node_id << 8 | mac[i];
+
+    err = frame_sync_open_socket();
+    if (err != ESP_OK) return err;
+
+    frame_sync_core_init(&g_core, node_id, esp_timer_get_time());
+    xTaskCreatePinnedToCore(
+        &frame_sync_task,
+        "frame_sync_task",
+        FRAME_SYNC_TASK_STACK_SIZE,
+        NULL,
+        FRAME_SYNC_TASK_PRIORITY,
+        NULL,
+        FRAME_SYNC_TASK_CORE_ID
+    );
+
+    ESP_LOGI(TAG, "Frame clock synchronization started as node %012llx", node_id);
+    return ESP_OK;
+}
@@ -0,0 +1,50 @@
+//
+// Created by kok on 19.10.26.
+//
+
+#ifndef FRAME_SYNC_H
+#define FRAME_SYNC_H
+
+#include "esp_err.h"
+
+#include "frame_sync_core.h"
+
+#define FRAME_SYNC_MULTICAST_ADDR           "239.255.42.99"
+#define FRAME_SYNC_PORT                     4210
+
+/**
+ * Synchronization counters
+ */
+typedef struct {
+    frame_sync_role_e role;
+    uint64_t leader_id;
+    int64_t offset_us;
+    int32_t last_error_us;
+    uint32_t beacons_rx;
+    uint32_t beacons_tx;
+    uint32_t steps;
+} frame_sync_stats_t;
+
+/**
+ * Joins the multicast group and starts the synchronization task. Safe to call again after every reconnect.
+ */
+esp_err_t frame_sync_init(void);
+
+/**
+ * Gets the frame clock shared by every controller on the network.
+ * Falls back to the local clock until a leader is found. Never blocks.
+ * @return frame clock in microseconds
+ */
+int64_t frame_sync_now_us(void);
+
+/**
+ * Gets the synchronization counters
+ */
+frame_sync_stats_t frame_sync_get_stats(void);
+
+/**
+ * Gets the name of a role
+ */
+const char *frame_sync_role_name(frame_sync_role_e role);
+
+#endif //FRAME_SYNC_H
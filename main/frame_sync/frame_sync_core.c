@@ -0,0 +1,82 @@
+//
+// Created by kok on 19.10.26.
+//
+
+#include <string.h>
+
+#include "frame_sync_core.h"
+
+static void frame_sync_core_set_role(frame_sync_core_t *core, frame_sync_role_e role, uint64_t leader_id, int64_t now_us) {
+    core->role = role;
+    core->leader_id = leader_id;
+    core->role_since_us = now_us;
+}
+
+void frame_sync_core_init(frame_sync_core_t *core, uint64_t node_id, int64_t now_us) {
+    memset(core, 0, sizeof(frame_sync_core_t));
+    core->node_id = node_id;
+    frame_sync_core_set_role(core, FRAME_SYNC_ROLE_LISTENING, 0, now_us);
+}
+
+void frame_sync_core_on_beacon(frame_sync_core_t *core, const frame_sync_beacon_t *beacon, int64_t now_us) {
+    if (memcmp(beacon->magic, FRAME_SYNC_MAGIC, sizeof(beacon->magic)) != 0 || beacon->version != FRAME_SYNC_VERSION) return;
+
+    if (beacon->node_id == 0 || beacon->node_id == core->node_id) return;
+
+    // A node without a time base follows any leader, whatever its ID, so joining never resets the frame clock.
+    // Once synced, only a lower ID can take over and higher IDs yield as soon as they hear this node.
+    const bool from_leader = core->role == FRAME_SYNC_ROLE_FOLLOWER && core->leader_id == beacon->node_id;
+    if (!from_leader && core->offset_valid) {
+        if (beacon->node_id > core->node_id) return;
+
+        // Follow a lower ID, or anyone once the current leader went silent
+        const bool leader_alive = core->role == FRAME_SYNC_ROLE_FOLLOWER && now_us - core->last_rx_us < FRAME_SYNC_LEADER_TIMEOUT_US;
+        if (leader_alive && beacon->node_id > core->leader_id) return;
+    }
+    if (!from_leader) frame_sync_core_set_role(core, FRAME_SYNC_ROLE_FOLLOWER, beacon->node_id, now_us);
+
+    core->beacons_rx++;
+    core->last_rx_us = now_us;
+
+    // The one-way delay on the local network is well below a frame, so it is not compensated
+    const int64_t sample_us = beacon->time_us - now_us;
+    const int64_t error_us = sample_us - core->offset_us;
+    core->last_error_us = error_us > INT32_MAX ? INT32_MAX : error_us < INT32_MIN ? INT32_MIN : (int32_t)error_us;
+    if (!core->offset_valid || error_us > FRAME_SYNC_STEP_US || error_us < -FRAME_SYNC_STEP_US) {
+        core->offset_us = sample_us;
+        core->offset_valid = true;
+        core->steps++;
+    } else {
+        // Slew so that a single delayed beacon can't make the effects jump
+        core->offset_us += error_us / (1 << FRAME_SYNC_SMOOTHING_SHIFT);
+    }
+}
+
+bool frame_sync_core_poll(frame_sync_core_t *core, int64_t now_us, frame_sync_beacon_t *beacon) {
+    switch (core->role) {
+        case FRAME_SYNC_ROLE_FOLLOWER:
+            // The offset is kept so the frame clock stays continuous across a leader change
+            if (now_us - core->last_rx_us >= FRAME_SYNC_LEADER_TIMEOUT_US)
+                frame_sync_core_set_role(core, FRAME_SYNC_ROLE_LISTENING, 0, now_us);
+            return false;
+        case FRAME_SYNC_ROLE_LISTENING:
+            if (now_us - core->role_since_us < FRAME_SYNC_LEADER_TIMEOUT_US) return false;
+            // Nobody spoke up, the local clock (or the one inherited from the last leader) becomes the time base
+            frame_sync_core_set_role(core, FRAME_SYNC_ROLE_LEADER, core->node_id, now_us);
+            core->offset_valid = true;
+            core->last_tx_us = now_us - FRAME_SYNC_BEACON_INTERVAL_US;
+            break;
+        case FRAME_SYNC_ROLE_LEADER:
+            break;
+    }
+
+    if (now_us - core->last_tx_us < FRAME_SYNC_BEACON_INTERVAL_US) return false;
+    memcpy(beacon->magic, FRAME_SYNC_MAGIC, sizeof(beacon->magic));
+    beacon->version = FRAME_SYNC_VERSION;
+    memset(beacon->reserved, 0, sizeof(beacon->reserved));
+    beacon->node_id = core->node_id;
+    beacon->time_us = frame_sync_core_time(core, now_us);
+    core->last_tx_us = now_us;
+    core->beacons_tx++;
+    return true;
+}
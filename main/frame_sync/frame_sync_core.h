@@ -0,0 +1,87 @@
+//
+// Created by kok on 19.10.26.
+//
+
+#ifndef FRAME_SYNC_CORE_H
+#define FRAME_SYNC_CORE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/**
+ * Platform independent part of the frame clock synchronization.
+ * It only deals with beacons and timestamps, so several instances can be run against each other on a host.
+ */
+
+#define FRAME_SYNC_MAGIC                    "FSYN"
+#define FRAME_SYNC_VERSION                  1
+#define FRAME_SYNC_BEACON_INTERVAL_US       500000
+#define FRAME_SYNC_LEADER_TIMEOUT_US        (3 * FRAME_SYNC_BEACON_INTERVAL_US)
+#define FRAME_SYNC_STEP_US                  50000   // Larger errors are stepped instead of slewed
+#define FRAME_SYNC_SMOOTHING_SHIFT          3       // Every beacon corrects 1/8 of the error
+
+/**
+ * Beacon sent by the leader. Fields are little-endian.
+ */
+typedef struct __attribute__((packed)) {
+    char magic[4];
+    uint8_t version;
+    uint8_t reserved[3];
+    uint64_t node_id;
+    int64_t time_us;   // Leader's frame clock when the beacon was sent
+} frame_sync_beacon_t;
+
+typedef enum {
+    FRAME_SYNC_ROLE_LISTENING,   // Waiting for a leader before claiming the role
+    FRAME_SYNC_ROLE_LEADER,
+    FRAME_SYNC_ROLE_FOLLOWER
+} frame_sync_role_e;
+
+typedef struct {
+    uint64_t node_id;
+    frame_sync_role_e role;
+    uint64_t leader_id;
+    int64_t offset_us;           // Frame clock minus local clock
+    bool offset_valid;           // A time base was taken from a leader or established as leader
+    int64_t role_since_us;
+    int64_t last_rx_us;
+    int64_t last_tx_us;
+    int32_t last_error_us;       // Error corrected by the last beacon
+    uint32_t beacons_rx;
+    uint32_t beacons_tx;
+    uint32_t steps;
+} frame_sync_core_t;
+
+/**
+ * Initializes the state machine. The node starts listening for a leader.
+ * @param core state to initialize
+ * @param node_id unique non-zero ID, the lowest ID among the synced nodes becomes the leader
+ * @param now_us local clock
+ */
+void frame_sync_core_init(frame_sync_core_t *core, uint64_t node_id, int64_t now_us);
+
+/**
+ * Feeds a received beacon
+ * @param core state
+ * @param beacon received beacon, invalid or own beacons are ignored
+ * @param now_us local clock at the time of reception
+ */
+void frame_sync_core_on_beacon(frame_sync_core_t *core, const frame_sync_beacon_t *beacon, int64_t now_us);
+
+/**
+ * Advances the role timeouts. Should be called at least every FRAME_SYNC_BEACON_INTERVAL_US.
+ * @param core state
+ * @param now_us local clock
+ * @param beacon beacon which should be sent
+ * @return true if the beacon should be sent
+ */
+bool frame_sync_core_poll(frame_sync_core_t *core, int64_t now_us, frame_sync_beacon_t *beacon);
+
+/**
+ * Converts the local clock to the shared frame clock
+ */
+static inline int64_t frame_sync_core_time(const frame_sync_core_t *core, int64_t now_us) {
+    return now_us + core->offset_us;
+}
+
+#endif //FRAME_SYNC_CORE_H
@@ -2,13 +2,26 @@
 // Created by kok on 05.09.24.
 //
 
+#include <stdatomic.h>
+
 #include "esp_log.h"
 #include "esp_http_server.h"
 #include "freertos/FreeRTOS.h"
+#include "freertos/event_groups.h"
 #include "sys/param.h"
+#include "esp_heap_caps.h"
+#include "esp_timer.h"
 
 #include "tasks_common.h"
 #include "wifi_app/wifi_app.h"
+#include "rmt/rmt_app.h"
+#include "rmt_store/rmt_store.h"
+#include "boot_stats/boot_stats.h"
+#include "frame_sync/frame_sync.h"
+#include "cjson_arena/cjson_arena.h"
+#include "mqtt_app/mqtt_app.h"
+#include "web_assets/web_assets.h"
+#include "led_api/led_api.h"
 #include "http_server.h"
 
 #include <cJSON.h>
@@ -18,11 +31,72 @@ static const char TAG[] = "http_server";
 
 static httpd_handle_t http_server_handle = NULL;
 static QueueHandle_t http_server_monitor_queue = NULL;
+
+static http_server_wifi_connect_status_e g_http_server_wifi_connect_status = NONE;
+
+// Latest connection attempt started through the API, shared by the monitor and the HTTP server tasks
+static http_server_connect_op_t g_connect_op;
+static portMUX_TYPE g_connect_op_lock = portMUX_INITIALIZER_UNLOCKED;
+
+// Set once the latest attempt reached a final state, a "?wait=1" connect request waits for it
 static EventGroupHandle_t http_server_event_group = NULL;
+static const uint32_t HTTP_SERVER_CONNECT_OP_DONE = BIT0;
 
-static uint32_t HTTP_SERVER_WIFI_CONNECTION_UPDATED         = BIT0;
+// The one "?wait=1" request which is answered from the wait task instead of the HTTP server task
+static atomic_bool g_connect_waiting = false;
+static httpd_req_t *g_connect_wait_req = NULL;
+static uint32_t g_connect_wait_op_id = 0;
 
-static http_server_wifi_connect_status_e g_http_server_wifi_connect_status = NONE;
+/**
+ * Times out the pending attempt once it has outlived HTTP_SERVER_CONNECT_TIMEOUT_MS. Call with g_connect_op_lock held.
+ * @return true if the attempt just timed out
+ */
+static bool http_server_connect_op_expire(const int64_t now_us) {
+    if (g_connect_op.state != HTTP_SERVER_CONNECT_OP_PENDING || now_us - g_connect_op.started_us <= HTTP_SERVER_CONNECT_TIMEOUT_MS * 1000LL)
+        return false;
+    g_connect_op.state = HTTP_SERVER_CONNECT_OP_TIMEOUT;
+    g_connect_op.finished_us = g_connect_op.started_us + HTTP_SERVER_CONNECT_TIMEOUT_MS * 1000LL;
+    return true;
+}
+
+/**
+ * Completes the pending connection attempt, if there is one. Final states never change again,
+ * an outcome reported after the timeout leaves the attempt timed out.
+ */
+static void http_server_connect_op_finish(const http_server_connect_op_state_e state) {
+    const int64_t now_us = esp_timer_get_time();
+    bool done = false;
+    taskENTER_CRITICAL(&g_connect_op_lock);
+    if (!http_server_connect_op_expire(now_us) && g_connect_op.state == HTTP_SERVER_CONNECT_OP_PENDING) {
+        g_connect_op.state = state;
+        g_connect_op.finished_us = now_us;
+        done = true;
+    }
+    taskEXIT_CRITICAL(&g_connect_op_lock);
+    if (done) xEventGroupSetBits(http_server_event_group, HTTP_SERVER_CONNECT_OP_DONE);
+}
+
+/**
+ * Copies the latest connection attempt, timing it out first if it is overdue
+ */
+static http_server_connect_op_t http_server_connect_op_get(void) {
+    const int64_t now_us = esp_timer_get_time();
+    taskENTER_CRITICAL(&g_connect_op_lock);
+    http_server_connect_op_expire(now_us);
+    const http_server_connect_op_t op = g_connect_op;
+    taskEXIT_CRITICAL(&g_connect_op_lock);
+    return op;
+}
+
+static const char *http_server_connect_op_state_name(const http_server_connect_op_state_e state) {
+    switch (state) {
+        case HTTP_SERVER_CONNECT_OP_PENDING: return "pending";
+        case HTTP_SERVER_CONNECT_OP_CONNECTED: return "connected";
+        case HTTP_SERVER_CONNECT_OP_FAILED: return "failed";
+        case HTTP_SERVER_CONNECT_OP_TIMEOUT: return "timeout";
+        default: return "none";
+    }
+}
 
 // --------- MONITOR TASK --------- //
 
@@ -42,13 +116,14 @@ static void http_server_monitor_task(void *pvParams) {
                 case HTTP_SERVER_MSG_WIFI_CONNECTED:
                     ESP_LOGI(TAG, "HTTP_SERVER_MSG_WIFI_CONNECTED");
                     g_http_server_wifi_connect_status = HTTP_SERVER_WIFI_STATUS_CONNECTED;
+                    http_server_connect_op_finish(HTTP_SERVER_CONNECT_OP_CONNECTED);
                     break;
                 case HTTP_SERVER_MSG_WIFI_DISCONNECTED:
                     ESP_LOGI(TAG, "HTTP_SERVER_MSG_WIFI_DISCONNECTED");
                     g_http_server_wifi_connect_status = HTTP_SERVER_WIFI_STATUS_DISCONNECTED;
+                    http_server_connect_op_finish(HTTP_SERVER_CONNECT_OP_FAILED);
                     break;
             }
-            xEventGroupSetBits(http_server_event_group, HTTP_SERVER_WIFI_CONNECTION_UPDATED);
         }
     }
 }
@@ -58,7 +133,7 @@ static void http_server_monitor_task(void *pvParams) {
 /**
  * Set the required CORS headers required by the browsers
  */
-static void set_cors_headers(httpd_req_t *req) {
+void http_server_set_cors_headers(httpd_req_t *req) {
     httpd_resp_set_hdr(req, "Access-Control-Allow-Origin", "*");
     httpd_resp_set_hdr(req, "Access-Control-Allow-Methods", "GET, POST, PUT, DELETE");
     httpd_resp_set_hdr(req, "Access-Control-Allow-Headers", "Content-Type, Authorization");
@@ -66,30 +141,36 @@ static void set_cors_headers(httpd_req_t *req) {
 
 static esp_err_t get_available_remote_ap_handler(httpd_req_t *req) {
     ESP_LOGI(TAG, "Available remote AP's requested");
-    set_cors_headers(req);
-    wifi_app_sta_scan_results_t results;
-    const esp_err_t err = wifi_app_sta_scan(&results);
+    http_server_set_cors_headers(req);
     httpd_resp_set_type(req, "application/json");
 
-    char responseJSON[1024];
-    int offset = 0;
-
-    if (err == ESP_OK) {
+    // Served from the cache, "?refresh=1" asks for a new scan which shows up in a later request
+    char query[32], value[4];
+    const bool force = httpd_req_get_url_query_str(req, query, sizeof(query)) == ESP_OK
+        && httpd_query_key_value(query, "refresh", value, sizeof(value)) == ESP_OK && strcmp(value, "1") == 0;
+    wifi_app_sta_scan_request(force);
+
+    static wifi_app_sta_scan_results_t results;
+    wifi_app_sta_scan_get(&results);
+
+    // Handlers run on the single HTTP server task, keep the large buffer off its stack
+    static char responseJSON[2048];
+    int offset = snprintf(
+        responseJSON,
+        sizeof(responseJSON),
+        "{\"status\": \"success\", \"scanning\": %s, \"age_ms\": %lld, \"available_networks\": [",
+        results.scanning ? "true" : "false",
+        results.updated_us > 0 ? (esp_timer_get_time() - results.updated_us) / 1000 : -1
+    );
+    for (int i = 0; i < results.records_count && offset < sizeof(responseJSON); i++) {
         offset += snprintf(
             responseJSON + offset,
             sizeof(responseJSON) - offset,
-            "{\"status\": \"success\", \"available_networks\": ["
+            "{\"ssid\":\"%s\", \"signal_strength\": %d}%s",
+            results.records[i].ssid, results.records[i].rssi, (i < results.records_count - 1) ? "," : ""
         );
-        for (int i = 0; i < results.records_count; i++) {
-            offset += snprintf(
-                responseJSON + offset,
-                sizeof(responseJSON) - offset,
-                "{\"ssid\":\"%s\", \"signal_strength\": %d}%s",
-                results.records[i].ssid, results.records[i].rssi, (i < results.records_count - 1) ? "," : ""
-            );
-        }
-        offset += snprintf(responseJSON + offset, sizeof(responseJSON) - offset, "]}");
-    } else snprintf(responseJSON, sizeof(responseJSON), "{\"status\": \"fail\", \"available_networks\": []");
+    }
+    if (offset < sizeof(responseJSON)) snprintf(responseJSON + offset, sizeof(responseJSON) - offset, "]}");
 
     httpd_resp_send(req, responseJSON, HTTPD_RESP_USE_STRLEN);
     return ESP_OK;
@@ -100,7 +181,7 @@ static esp_err_t get_connection_status_handler(httpd_req_t *req) {
     wifi_config_t *config = wifi_app_get_sta_config();
     wifi_ap_record_t ap_info;
 
-    set_cors_headers(req);
+    http_server_set_cors_headers(req);
     httpd_resp_set_type(req, "application/json");
 
     char responseJSON[200];
@@ -117,13 +198,53 @@ static esp_err_t get_connection_status_handler(httpd_req_t *req) {
     return ESP_OK;
 }
 
+/**
+ * Answers a connect request with 202 and the ID to poll
+ */
+static void http_server_connect_send_pending(httpd_req_t *req, const uint32_t op_id) {
+    char responseJSON[100];
+    snprintf(responseJSON, sizeof(responseJSON), "{\"status\": \"pending\", \"operation_id\": %lu}", op_id);
+    httpd_resp_set_status(req, HTTP_SERVER_202);
+    httpd_resp_send(req, responseJSON, HTTPD_RESP_USE_STRLEN);
+}
+
+/**
+ * Waits for the attempt of a "?wait=1" request to end and answers it with the outcome
+ */
+static void http_server_connect_wait_task(void *pvParams) {
+    httpd_req_t *req = g_connect_wait_req;
+    const uint32_t op_id = g_connect_wait_op_id;
+
+    // A little longer than the timeout, so the attempt is final when it is read
+    xEventGroupWaitBits(http_server_event_group, HTTP_SERVER_CONNECT_OP_DONE, pdFALSE, pdTRUE,
+                        pdMS_TO_TICKS(HTTP_SERVER_CONNECT_TIMEOUT_MS + HTTP_SERVER_CONNECT_WAIT_MARGIN_MS));
+    const http_server_connect_op_t op = http_server_connect_op_get();
+
+    // Headers set by the handler don't carry over to the detached request
+    http_server_set_cors_headers(req);
+    httpd_resp_set_type(req, "application/json");
+    char responseJSON[100];
+    if (op.id == op_id && op.state == HTTP_SERVER_CONNECT_OP_CONNECTED)
+        snprintf(responseJSON, sizeof(responseJSON), "{\"status\": \"success\", \"operation_id\": %lu}", op_id);
+    else {
+        // A newer attempt supersedes this one
+        snprintf(responseJSON, sizeof(responseJSON), "{\"status\": \"fail\", \"operation_id\": %lu, \"state\": \"%s\"}",
+                 op_id, http_server_connect_op_state_name(op.id == op_id ? op.state : HTTP_SERVER_CONNECT_OP_NONE));
+        httpd_resp_set_status(req, HTTPD_500);
+    }
+    httpd_resp_send(req, responseJSON, HTTPD_RESP_USE_STRLEN);
+    httpd_req_async_handler_complete(req);
+    atomic_store(&g_connect_waiting, false);
+    vTaskDelete(NULL);
+}
+
 static esp_err_t wifi_connect_handler(httpd_req_t *req) {
     ESP_LOGI(TAG, "WIFI connect requested");
-    set_cors_headers(req);
+    http_server_set_cors_headers(req);
     httpd_resp_set_type(req, "application/json");
 
     char body[300];
-    const size_t body_size = MIN(req->content_len, sizeof(body));
+    const size_t body_size = MIN(req->content_len, sizeof(body) - 1);
 
     const int recv_body_len = httpd_req_recv(req, body, body_size);
     if (recv_body_len < 0) {
@@ -133,49 +254,114 @@ static esp_err_t wifi_connect_handler(httpd_req_t *req) {
     }
     body[recv_body_len] = '\0';
 
-    const cJSON *json = cJSON_Parse(body);
-    if (json == NULL) {
-        httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "The provided body is not a valid JSON!");
-        return ESP_FAIL;
+    // The whole tree lives in the arena and is released at once
+    cjson_arena_begin();
+    cJSON *json = cJSON_Parse(body);
+    const cJSON *ssid = cJSON_GetObjectItemCaseSensitive(json, "ssid");
+    const cJSON *password = cJSON_GetObjectItemCaseSensitive(json, "password");
+    const char *error = NULL;
+    if (json == NULL) error = "The provided body is not a valid JSON!";
+    else if (!cJSON_IsString(ssid) || ssid->valuestring == NULL || strlen(ssid->valuestring) > sizeof(((wifi_config_t*)0)->sta.ssid) - 1)
+        error = "Please, provide a valid SSID!";
+    else if (!cJSON_IsString(password) || password->valuestring == NULL || strlen(password->valuestring) > sizeof(((wifi_config_t*)0)->sta.password) - 1)
+        error = "Please, provide a valid password!";
+
+    if (error == NULL) {
+        wifi_config_t *config = wifi_app_get_sta_config();
+        memcpy(config->sta.ssid, ssid->valuestring, strlen(ssid->valuestring) + 1);
+        memcpy(config->sta.password, password->valuestring, strlen(password->valuestring) + 1);
+        ESP_LOGI(TAG, "%s", config->sta.ssid);
     }
+    cJSON_Delete(json);
+    cjson_arena_end();
 
-    const cJSON *ssid = cJSON_GetObjectItemCaseSensitive(json, "ssid");
-    if (!cJSON_IsString(ssid) || (ssid->valuestring == NULL)) {
-        httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Please, provide a valid SSID!");
+    if (error != NULL) {
+        httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, error);
         return ESP_FAIL;
     }
 
-    const cJSON *password = cJSON_GetObjectItemCaseSensitive(json, "password");
-    if (!cJSON_IsString(password) || (password->valuestring == NULL)) {
-        httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Please, provide a valid SSID!");
-        return ESP_FAIL;
+    char query[32], value[4];
+    const bool wait = httpd_req_get_url_query_str(req, query, sizeof(query)) == ESP_OK
+        && httpd_query_key_value(query, "wait", value, sizeof(value)) == ESP_OK && strcmp(value, "1") == 0;
+    if (wait && atomic_exchange(&g_connect_waiting, true)) {
+        httpd_resp_set_status(req, HTTP_SERVER_503);
+        httpd_resp_send(req, "{\"status\": \"fail\", \"error\": \"Another request is already waiting for a connection\"}", HTTPD_RESP_USE_STRLEN);
+        return ESP_OK;
     }
 
-    wifi_config_t *config = wifi_app_get_sta_config();
-    memcpy(config->sta.ssid, ssid->valuestring, strlen(ssid->valuestring) + 1);
-    memcpy(config->sta.password, password->valuestring, strlen(password->valuestring) + 1);
-    ESP_LOGI(TAG, "%s", config->sta.ssid);
-    ESP_LOGI(TAG, "%s", config->sta.password);
+    xEventGroupClearBits(http_server_event_group, HTTP_SERVER_CONNECT_OP_DONE);
+    taskENTER_CRITICAL(&g_connect_op_lock);
+    g_connect_op.id++;
+    g_connect_op.state = HTTP_SERVER_CONNECT_OP_PENDING;
+    g_connect_op.started_us = esp_timer_get_time();
+    g_connect_op.finished_us = 0;
+    const uint32_t op_id = g_connect_op.id;
+    taskEXIT_CRITICAL(&g_connect_op_lock);
+    http_server_send_message(HTTP_SERVER_MSG_WIFI_CONNECTING, NULL);
     wifi_app_send_message(WIFI_APP_MSG_CONNECT, NULL);
 
-    char responseJSON[100];
-    xEventGroupClearBits(http_server_event_group, HTTP_SERVER_WIFI_CONNECTION_UPDATED);
+    // The outcome is sent from the wait task, the HTTP server task goes on serving other requests
+    if (wait) {
+        g_connect_wait_op_id = op_id;
+        if (httpd_req_async_handler_begin(req, &g_connect_wait_req) == ESP_OK) {
+            const BaseType_t created = xTaskCreatePinnedToCore(
+                &http_server_connect_wait_task,
+                "http_connect_wait",
+                HTTP_SERVER_CONNECT_WAIT_TASK_STACK_SIZE,
+                NULL,
+                HTTP_SERVER_CONNECT_WAIT_TASK_PRIORITY,
+                NULL,
+                HTTP_SERVER_CONNECT_WAIT_TASK_CORE_ID
+            );
+            if (created == pdPASS) return ESP_OK;
+            ESP_LOGE(TAG, "Failed to create the connect wait task, answering right away");
+            req = g_connect_wait_req;
+            http_server_set_cors_headers(req);
+            httpd_resp_set_type(req, "application/json");
+            http_server_connect_send_pending(req, op_id);
+            httpd_req_async_handler_complete(req);
+            atomic_store(&g_connect_waiting, false);
+            return ESP_OK;
+        }
+        ESP_LOGE(TAG, "Failed to detach the connect request, answering right away");
+        atomic_store(&g_connect_waiting, false);
+    }
 
-    xEventGroupWaitBits(http_server_event_group, HTTP_SERVER_WIFI_CONNECTION_UPDATED, pdTRUE, pdTRUE, pdMS_TO_TICKS(30000));
-    if (g_http_server_wifi_connect_status == HTTP_SERVER_WIFI_STATUS_CONNECTED)
-        snprintf(responseJSON, sizeof(responseJSON), "{\"status\": \"success\"}");
-    else {
-        snprintf(responseJSON, sizeof(responseJSON), "{\"status\": \"fail\"}");
-        httpd_resp_set_status(req, HTTPD_500);
+    // Answer right away and let the client poll the state
+    http_server_connect_send_pending(req, op_id);
+    return ESP_OK;
+}
+
+static esp_err_t wifi_connect_status_handler(httpd_req_t *req) {
+    http_server_set_cors_headers(req);
+    httpd_resp_set_type(req, "application/json");
+
+    const http_server_connect_op_t op = http_server_connect_op_get();
+
+    // Without an ID the latest attempt is reported
+    char query[32], value[12];
+    if (httpd_req_get_url_query_str(req, query, sizeof(query)) == ESP_OK
+        && httpd_query_key_value(query, "id", value, sizeof(value)) == ESP_OK
+        && strtoul(value, NULL, 10) != op.id) {
+        httpd_resp_send_err(req, HTTPD_404_NOT_FOUND, "Unknown or superseded operation!");
+        return ESP_OK;
     }
 
+    const int64_t end_us = op.state == HTTP_SERVER_CONNECT_OP_PENDING ? esp_timer_get_time() : op.finished_us;
+    char responseJSON[150];
+    snprintf(
+        responseJSON,
+        sizeof(responseJSON),
+        "{\"status\": \"success\", \"operation_id\": %lu, \"state\": \"%s\", \"elapsed_ms\": %lld}",
+        op.id, http_server_connect_op_state_name(op.state), op.id > 0 ? (end_us - op.started_us) / 1000 : 0
+    );
     httpd_resp_send(req, responseJSON, HTTPD_RESP_USE_STRLEN);
     return ESP_OK;
 }
 
 static esp_err_t wifi_disconnect_handler(httpd_req_t *req) {
     ESP_LOGI(TAG, "WIFI disconnect requested");
-    set_cors_headers(req);
+    http_server_set_cors_headers(req);
     httpd_resp_set_type(req, "application/json");
 
     char responseJSON[200];
@@ -185,30 +371,65 @@ static esp_err_t wifi_disconnect_handler(httpd_req_t *req) {
     return ESP_OK;
 }
 
-static esp_err_t get_web_file_handler(httpd_req_t *req) {
-    char filepath[1032]; // sizeof req->uri + 7 bytes for the base path
-    snprintf(filepath, sizeof(filepath), "/spiffs%s", strcmp(req->uri, "/") == 0 ? "/index.html" : req->uri);
+static esp_err_t get_stats_handler(httpd_req_t *req) {
+    ESP_LOGI(TAG, "Stats requested");
+    http_server_set_cors_headers(req);
+    httpd_resp_set_type(req, "application/json");
 
-    FILE *fp = fopen(filepath, "r");
-    if (fp == NULL) {
-        ESP_LOGE(TAG, "Failed to open file: %s", filepath);
-        httpd_resp_send_404(req);
-        return ESP_OK;
+    // Handlers run on the single HTTP server task, keep the large buffer off its stack
+    static char responseJSON[3072];
+    int offset = snprintf(responseJSON, sizeof(responseJSON), "{\"status\": \"success\", \"boot_ms\": {");
+    for (int phase = 0; phase < BOOT_STATS_PHASES_COUNT; phase++) {
+        const int64_t phase_us = boot_stats_get(phase);
+        offset += snprintf(
+            responseJSON + offset,
+            sizeof(responseJSON) - offset,
+            "\"%s\": %lld%s",
+            boot_stats_phase_name(phase), phase_us < 0 ? -1 : phase_us / 1000, phase < BOOT_STATS_PHASES_COUNT - 1 ? ", " : ""
+        );
     }
 
-    if (strstr(filepath, ".html")) httpd_resp_set_type(req, "text/html");
-    else if (strstr(filepath, ".css")) httpd_resp_set_type(req, "text/css");
-    else if (strstr(filepath, ".js")) httpd_resp_set_type(req, "application/javascript");
-    else if (strstr(filepath, ".svg")) httpd_resp_set_type(req, "image/svg+xml");
-
-    char chunk[1024];
-    size_t chunk_size;
-    while ((chunk_size = fread(chunk, 1, sizeof(chunk), fp))) {
-        httpd_resp_send_chunk(req, chunk, chunk_size);
-    }
+    const rmt_app_msg_stats_t msg_stats = rmt_app_get_msg_stats();
+    const rmt_store_stats_t store_stats = rmt_store_get_stats();
+    const frame_sync_stats_t sync_stats = frame_sync_get_stats();
+    const cjson_arena_stats_t arena_stats = cjson_arena_get_stats();
+    const mqtt_app_outbox_stats_t outbox_stats = mqtt_app_get_outbox_stats();
+    const web_assets_stats_t asset_stats = web_assets_get_stats();
+    const led_api_stats_t api_stats = led_api_get_stats();
+    offset += snprintf(
+        responseJSON + offset,
+        sizeof(responseJSON) - offset,
+        "}, \"commands\": {\"received\": %lu, \"merged\": %lu, \"dropped\": %lu, "
+        "\"scheduled\": %lu, \"late\": %lu, \"max_schedule_error_us\": %lu}, "
+        "\"nvs\": {\"state_changes\": %lu, \"commits\": %lu, \"failures\": %lu}, "
+        "\"frame_sync\": {\"role\": \"%s\", \"leader\": \"%012llx\", \"offset_us\": %lld, \"last_error_us\": %ld, "
+        "\"beacons_rx\": %lu, \"beacons_tx\": %lu, \"steps\": %lu}, "
+        "\"cjson_arena\": {\"messages\": %lu, \"allocs\": %lu, \"fallbacks\": %lu, \"high_water\": %lu}, "
+        "\"mqtt_outbox\": {\"queued\": %lu, \"replaced\": %lu, \"dropped\": %lu, \"sent\": %lu, \"pending\": %lu}, "
+        "\"assets\": {\"requests\": %lu, \"hits\": %lu, \"not_modified\": %lu, \"streamed\": %lu, \"not_found\": %lu, "
+        "\"gzip\": %lu, \"flash_reads\": %lu, \"flash_bytes\": %llu, \"evictions\": %lu, \"cached_bytes\": %lu, "
+        "\"avg_us\": %llu, \"max_us\": %lu}, "
+        "\"api\": {\"requests\": %lu, \"commands\": %lu, \"frames\": %lu, \"rejected\": %lu, \"avg_us\": %llu, \"max_us\": %lu}, "
+        "\"heap\": {\"free\": %u, \"min_free\": %u, \"largest_free_block\": %u}, \"mqtt\": ",
+        msg_stats.received, msg_stats.merged, msg_stats.dropped,
+        msg_stats.scheduled, msg_stats.late, msg_stats.max_schedule_error_us,
+        store_stats.marks, store_stats.commits, store_stats.failures,
+        frame_sync_role_name(sync_stats.role), sync_stats.leader_id, sync_stats.offset_us, sync_stats.last_error_us,
+        sync_stats.beacons_rx, sync_stats.beacons_tx, sync_stats.steps,
+        arena_stats.messages, arena_stats.allocs, arena_stats.fallbacks, arena_stats.high_water,
+        outbox_stats.queued, outbox_stats.replaced, outbox_stats.dropped, outbox_stats.sent, outbox_stats.pending,
+        asset_stats.requests, asset_stats.hits, asset_stats.not_modified, asset_stats.streamed, asset_stats.not_found,
+        asset_stats.gzip, asset_stats.flash_reads, asset_stats.flash_bytes, asset_stats.evictions, asset_stats.cached_bytes,
+        asset_stats.requests > 0 ? asset_stats.total_us / asset_stats.requests : 0, asset_stats.max_us,
+        api_stats.requests, api_stats.commands, api_stats.frames, api_stats.rejected,
+        api_stats.requests > 0 ? api_stats.total_us / api_stats.requests : 0, api_stats.max_us,
+        heap_caps_get_free_size(MALLOC_CAP_8BIT), heap_caps_get_minimum_free_size(MALLOC_CAP_8BIT),
+        heap_caps_get_largest_free_block(MALLOC_CAP_8BIT)
+    );
+    if (offset < sizeof(responseJSON)) offset += mqtt_app_format_handler_stats(responseJSON + offset, sizeof(responseJSON) - offset);
+    if (offset < sizeof(responseJSON)) snprintf(responseJSON + offset, sizeof(responseJSON) - offset, "}");
 
-    fclose(fp);
-    httpd_resp_send_chunk(req, NULL, 0);
+    httpd_resp_send(req, responseJSON, HTTPD_RESP_USE_STRLEN);
     return ESP_OK;
 }
 
@@ -240,6 +461,14 @@ static void http_server_uri_handlers() {
     };
     httpd_register_uri_handler(http_server_handle, &wifi_connect);
 
+    const httpd_uri_t wifi_connect_status = {
+        .uri = "/remote/ap/connect/status",
+        .method = HTTP_GET,
+        .handler = wifi_connect_status_handler,
+        .user_ctx = NULL
+    };
+    httpd_register_uri_handler(http_server_handle, &wifi_connect_status);
+
     const httpd_uri_t wifi_diconnect = {
         .uri = "/remote/ap/disconnect",
         .method = HTTP_POST,
@@ -248,10 +477,59 @@ static void http_server_uri_handlers() {
     };
     httpd_register_uri_handler(http_server_handle, &wifi_diconnect);
 
+    const httpd_uri_t get_stats = {
+        .uri = "/stats",
+        .method = HTTP_GET,
+        .handler = get_stats_handler,
+        .user_ctx = NULL
+    };
+    httpd_register_uri_handler(http_server_handle, &get_stats);
+
+    // Registered before the web interface, whose wildcard would match every GET
+    const httpd_uri_t led_get = {
+        .uri = LED_API_URI,
+        .method = HTTP_GET,
+        .handler = led_api_get_handler,
+        .user_ctx = NULL
+    };
+    httpd_register_uri_handler(http_server_handle, &led_get);
+
+    const httpd_uri_t led_post = {
+        .uri = LED_API_URI,
+        .method = HTTP_POST,
+        .handler = led_api_command_handler,
+        .user_ctx = NULL
+    };
+    httpd_register_uri_handler(http_server_handle, &led_post);
+
+    const httpd_uri_t led_put = {
+        .uri = LED_API_URI,
+        .method = HTTP_PUT,
+        .handler = led_api_command_handler,
+        .user_ctx = NULL
+    };
+    httpd_register_uri_handler(http_server_handle, &led_put);
+
+    const httpd_uri_t led_pixels_post = {
+        .uri = LED_API_PIXELS_URI,
+        .method = HTTP_POST,
+        .handler = led_api_pixels_handler,
+        .user_ctx = NULL
+    };
+    httpd_register_uri_handler(http_server_handle, &led_pixels_post);
+
+    const httpd_uri_t led_pixels_put = {
+        .uri = LED_API_PIXELS_URI,
+        .method = HTTP_PUT,
+        .handler = led_api_pixels_handler,
+        .user_ctx = NULL
+    };
+    httpd_register_uri_handler(http_server_handle, &led_pixels_put);
+
     const httpd_uri_t web_file = {
         .uri = "/*",
         .method = HTTP_GET,
-        .handler = get_web_file_handler,
+        .handler = web_assets_handler,
         .user_ctx = NULL
     };
     httpd_register_uri_handler(http_server_handle, &web_file);
@@ -259,7 +537,7 @@ static void http_server_uri_handlers() {
     const httpd_uri_t web_index = {
         .uri = "/",
         .method = HTTP_GET,
-        .handler = get_web_file_handler,
+        .handler = web_assets_handler,
         .user_ctx = NULL
     };
     httpd_register_uri_handler(http_server_handle, &web_index);
@@ -267,13 +545,24 @@ static void http_server_uri_handlers() {
 
 // --------- INITIAL CONFIGURATION --------- //
 
+void http_server_monitor_init(void) {
+    http_server_event_group = xEventGroupCreate();
+    http_server_monitor_queue = xQueueCreate(3, sizeof(http_server_message_t));
+    xTaskCreatePinnedToCore(
+        &http_server_monitor_task,
+        "http_server_monitor_task",
+        HTTP_SERVER_TASK_STACK_SIZE,
+        NULL,
+        HTTP_SERVER_TASK_PRIORITY,
+        NULL,
+        HTTP_SERVER_TASK_CORE_ID
+    );
+    ESP_LOGI(TAG, "HTTPS monitor task successfully started!");
+}
+
 void http_server_init() {
     ESP_LOGI(TAG, "Initializing HTTPS server");
 
-    // Configure monitor queue and event group
-    http_server_monitor_queue = xQueueCreate(3, sizeof(http_server_message_t));
-    http_server_event_group = xEventGroupCreate();
-
     httpd_config_t httpd_config = HTTPD_DEFAULT_CONFIG();
 
     httpd_config.stack_size = HTTP_SERVER_TASK_STACK_SIZE;
@@ -295,17 +584,6 @@ void http_server_init() {
     // Add URI handlers
     http_server_uri_handlers();
     ESP_LOGI(TAG, "HTTPS URI handlers were successfully added!");
-
-    xTaskCreatePinnedToCore(
-        &http_server_monitor_task,
-        "http_server_monitor_task",
-        HTTP_SERVER_TASK_STACK_SIZE,
-        NULL,
-        HTTP_SERVER_TASK_PRIORITY,
-        NULL,
-        HTTP_SERVER_TASK_CORE_ID
-    );
-    ESP_LOGI(TAG, "HTTPS monitor task successfully started!");
 }
 
 void http_server_send_message(http_server_msg_e msgID, void *pvParams) {
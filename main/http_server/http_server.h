@@ -5,7 +5,15 @@
 #ifndef HTTP_SERVER_H
 #define HTTP_SERVER_H
 
+#include <stdint.h>
+
+#include "esp_http_server.h"
+
 #define HTTP_SERVER_MAX_URI_HANDLERS          20
+#define HTTP_SERVER_CONNECT_TIMEOUT_MS        30000   // A pending connection attempt is reported as timed out after this
+#define HTTP_SERVER_CONNECT_WAIT_MARGIN_MS    100
+#define HTTP_SERVER_202                       "202 Accepted"
+#define HTTP_SERVER_503                       "503 Service Unavailable"
 
 typedef enum {
   NONE = 0,
@@ -25,6 +33,33 @@ typedef struct {
  void *params;
 } http_server_message_t;
 
+typedef enum {
+  HTTP_SERVER_CONNECT_OP_NONE = 0,
+  HTTP_SERVER_CONNECT_OP_PENDING,
+  HTTP_SERVER_CONNECT_OP_CONNECTED,
+  HTTP_SERVER_CONNECT_OP_FAILED,
+  HTTP_SERVER_CONNECT_OP_TIMEOUT
+} http_server_connect_op_state_e;
+
+/**
+ * Connection attempt started by POST /remote/ap/connect, polled through GET /remote/ap/connect/status?id=
+ * The POST answers right away with 202 and the ID. Given "?wait=1" it answers with the outcome once the attempt
+ * is over instead; the request is detached from the HTTP server task meanwhile, only one can wait at a time.
+ * Connected, failed and timeout are final, an outcome reported after the timeout doesn't change it.
+ */
+typedef struct {
+  uint32_t id;
+  http_server_connect_op_state_e state;
+  int64_t started_us;
+  int64_t finished_us;
+} http_server_connect_op_t;
+
+/**
+ * Create the monitor queue and task. Must run before wifi_app_init(), whose tasks report the connection status
+ * through http_server_send_message() right away.
+ */
+void http_server_monitor_init(void);
+
 /**
  * Initialize the HTTP server
  */
@@ -35,4 +70,9 @@ void http_server_init();
  */
 void http_server_send_message(http_server_msg_e msgID, void *pvParams);
 
+/**
+ * Set the CORS headers required by the browsers
+ */
+void http_server_set_cors_headers(httpd_req_t *req);
+
 #endif //HTTP_SERVER_H
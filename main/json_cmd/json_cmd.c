@@ -0,0 +1,440 @@
+//
+// Created by kok on 19.10.26.
+//
+
+#include <stddef.h>
+#include <string.h>
+
+#include "json_cmd.h"
+
+/**
+ * Cursor over the input text
+ */
+typedef struct {
+    const char *data;
+    size_t len;
+    size_t pos;
+    json_cmd_err_e err;
+} json_cmd_reader_t;
+
+/**
+ * Key of a known field, compared against the raw key bytes
+ */
+typedef struct {
+    const char *name;
+    size_t len;
+} json_cmd_key_t;
+
+#define JSON_CMD_KEY(name) {name, sizeof(name) - 1}
+
+// --------- LEXER --------- //
+
+static bool json_cmd_fail(json_cmd_reader_t *r, json_cmd_err_e err) {
+    if (r->err == JSON_CMD_OK) r->err = err;
+    return false;
+}
+
+static void json_cmd_skip_ws(json_cmd_reader_t *r) {
+    while (r->pos < r->len) {
+        const char c = r->data[r->pos];
+        if (c != ' ' && c != '\t' && c != '\n' && c != '\r') return;
+        r->pos++;
+    }
+}
+
+/**
+ * Skips whitespace and consumes the expected character
+ */
+static bool json_cmd_expect(json_cmd_reader_t *r, char expected) {
+    json_cmd_skip_ws(r);
+    if (r->pos >= r->len || r->data[r->pos] != expected) return json_cmd_fail(r, JSON_CMD_ERR_SYNTAX);
+    r->pos++;
+    return true;
+}
+
+/**
+ * Skips whitespace and consumes the character if it is the next one
+ */
+static bool json_cmd_accept(json_cmd_reader_t *r, char c) {
+    json_cmd_skip_ws(r);
+    if (r->pos >= r->len || r->data[r->pos] != c) return false;
+    r->pos++;
+    return true;
+}
+
+/**
+ * Scans a string in place
+ * @param start first byte after the opening quote
+ * @param len raw length without the quotes
+ * @param escaped true if the string contains escape sequences
+ */
+static bool json_cmd_scan_string(json_cmd_reader_t *r, const char **start, size_t *len, bool *escaped) {
+    if (!json_cmd_expect(r, '"')) return false;
+    *start = r->data + r->pos;
+    *escaped = false;
+    while (r->pos < r->len) {
+        const unsigned char c = r->data[r->pos];
+        if (c == '"') {
+            *len = r->data + r->pos - *start;
+            r->pos++;
+            return true;
+        }
+        if (c < 0x20) return json_cmd_fail(r, JSON_CMD_ERR_SYNTAX);
+        if (c == '\\') {
+            *escaped = true;
+            if (++r->pos >= r->len) break;
+            const char e = r->data[r->pos];
+            if (e == 'u') {
+                for (int i = 0; i < 4; i++) {
+                    if (++r->pos >= r->len) return json_cmd_fail(r, JSON_CMD_ERR_SYNTAX);
+                    const char h = r->data[r->pos];
+                    if (!((h >= '0' && h <= '9') || (h >= 'a' && h <= 'f') || (h >= 'A' && h <= 'F')))
+                        return json_cmd_fail(r, JSON_CMD_ERR_SYNTAX);
+                }
+            } else if (!strchr("\"\\/bfnrt", e)) {
+                return json_cmd_fail(r, JSON_CMD_ERR_SYNTAX);
+            }
+        }
+        r->pos++;
+    }
+    return json_cmd_fail(r, JSON_CMD_ERR_SYNTAX);
+}
+
+/**
+ * Scans a number in place
+ * @param integer true if the number has neither a fraction nor an exponent
+ * @param value value of an integer number, saturated to the int64_t range
+ */
+static bool json_cmd_scan_number(json_cmd_reader_t *r, bool *integer, int64_t *value) {
+    json_cmd_skip_ws(r);
+    const bool negative = r->pos < r->len && r->data[r->pos] == '-';
+    if (negative) r->pos++;
+
+    const size_t digits_start = r->pos;
+    uint64_t magnitude = 0;
+    bool overflow = false;
+    while (r->pos < r->len && r->data[r->pos] >= '0' && r->data[r->pos] <= '9') {
+        const uint8_t digit = r->data[r->pos++] - '0';
+        if (magnitude > (UINT64_MAX - digit) / 10) overflow = true;
+        else magnitude = magnitude * 10 + digit;
+    }
+    const size_t digits = r->pos - digits_start;
+    if (digits == 0 || (digits > 1 && r->data[digits_start] == '0')) return json_cmd_fail(r, JSON_CMD_ERR_SYNTAX);
+
+    *integer = true;
+    if (r->pos < r->len && r->data[r->pos] == '.') {
+        *integer = false;
+        const size_t frac_start = ++r->pos;
+        while (r->pos < r->len && r->data[r->pos] >= '0' && r->data[r->pos] <= '9') r->pos++;
+        if (r->pos == frac_start) return json_cmd_fail(r, JSON_CMD_ERR_SYNTAX);
+    }
+    if (r->pos < r->len && (r->data[r->pos] == 'e' || r->data[r->pos] == 'E')) {
+        *integer = false;
+        r->pos++;
+        if (r->pos < r->len && (r->data[r->pos] == '+' || r->data[r->pos] == '-')) r->pos++;
+        const size_t exp_start = r->pos;
+        while (r->pos < r->len && r->data[r->pos] >= '0' && r->data[r->pos] <= '9') r->pos++;
+        if (r->pos == exp_start) return json_cmd_fail(r, JSON_CMD_ERR_SYNTAX);
+    }
+
+    if (overflow || magnitude > (uint64_t)INT64_MAX) magnitude = INT64_MAX;
+    *value = negative ? -(int64_t)magnitude : (int64_t)magnitude;
+    return true;
+}
+
+/**
+ * Consumes a literal such as true, false or null
+ */
+static bool json_cmd_scan_literal(json_cmd_reader_t *r, const char *literal) {
+    const size_t len = strlen(literal);
+    if (r->len - r->pos < len || memcmp(r->data + r->pos, literal, len) != 0) return json_cmd_fail(r, JSON_CMD_ERR_SYNTAX);
+    r->pos += len;
+    return true;
+}
+
+/**
+ * Validates and skips any value
+ */
+static bool json_cmd_skip_value(json_cmd_reader_t *r, int depth) {
+    if (depth > JSON_CMD_MAX_DEPTH) return json_cmd_fail(r, JSON_CMD_ERR_DEPTH);
+
+    json_cmd_skip_ws(r);
+    if (r->pos >= r->len) return json_cmd_fail(r, JSON_CMD_ERR_SYNTAX);
+
+    const char *start;
+    size_t len;
+    bool flag;
+    int64_t value;
+    switch (r->data[r->pos]) {
+        case '"':
+            return json_cmd_scan_string(r, &start, &len, &flag);
+        case '{':
+            r->pos++;
+            if (json_cmd_accept(r, '}')) return true;
+            do {
+                if (!json_cmd_scan_string(r, &start, &len, &flag) || !json_cmd_expect(r, ':') || !json_cmd_skip_value(r, depth + 1))
+                    return false;
+            } while (json_cmd_accept(r, ','));
+            return json_cmd_expect(r, '}');
+        case '[':
+            r->pos++;
+            if (json_cmd_accept(r, ']')) return true;
+            do {
+                if (!json_cmd_skip_value(r, depth + 1)) return false;
+            } while (json_cmd_accept(r, ','));
+            return json_cmd_expect(r, ']');
+        case 't':
+            return json_cmd_scan_literal(r, "true");
+        case 'f':
+            return json_cmd_scan_literal(r, "false");
+        case 'n':
+            return json_cmd_scan_literal(r, "null");
+        default:
+            return json_cmd_scan_number(r, &flag, &value);
+    }
+}
+
+// --------- FIELD DECODERS --------- //
+
+static bool json_cmd_key_is(const char *key, size_t key_len, const json_cmd_key_t *known) {
+    return key_len == known->len && memcmp(key, known->name, key_len) == 0;
+}
+
+/**
+ * Peeks at the first character of the next value
+ */
+static char json_cmd_peek(json_cmd_reader_t *r) {
+    json_cmd_skip_ws(r);
+    return r->pos < r->len ? r->data[r->pos] : '\0';
+}
+
+static bool json_cmd_is_number_start(char c) {
+    return c == '-' || (c >= '0' && c <= '9');
+}
+
+/**
+ * Copies a string value into a fixed buffer, decoding the simple escape sequences
+ * @param valid false if the value is not a plain ASCII string fitting the buffer
+ */
+static bool json_cmd_read_string(json_cmd_reader_t *r, char *out, size_t out_size, bool *valid) {
+    *valid = false;
+    if (json_cmd_peek(r) != '"') return json_cmd_skip_value(r, 1);
+
+    const char *start;
+    size_t len;
+    bool escaped;
+    if (!json_cmd_scan_string(r, &start, &len, &escaped)) return false;
+
+    size_t n = 0;
+    for (size_t i = 0; i < len; i++) {
+        char c = start[i];
+        if (escaped && c == '\\') {
+            switch (start[++i]) {
+                case 'b': c = '\b'; break;
+                case 'f': c = '\f'; break;
+                case 'n': c = '\n'; break;
+                case 'r': c = '\r'; break;
+                case 't': c = '\t'; break;
+                case 'u': return true;  // Identifiers are plain ASCII
+                default: c = start[i]; break;
+            }
+        }
+        if (n + 1 >= out_size) return true;
+        out[n++] = c;
+    }
+    out[n] = '\0';
+    *valid = true;
+    return true;
+}
+
+/**
+ * Reads an integer value
+ * @param valid false if the value is not an integer within [min, max]
+ */
+static bool json_cmd_read_int(json_cmd_reader_t *r, int64_t min, int64_t max, int64_t *out, bool *valid) {
+    *valid = false;
+    if (!json_cmd_is_number_start(json_cmd_peek(r))) return json_cmd_skip_value(r, 1);
+
+    bool integer;
+    int64_t value;
+    if (!json_cmd_scan_number(r, &integer, &value)) return false;
+    *valid = integer && value >= min && value <= max;
+    if (*valid) *out = value;
+    return true;
+}
+
+static bool json_cmd_read_int32(json_cmd_reader_t *r, int32_t *out, bool *valid) {
+    int64_t value;
+    if (!json_cmd_read_int(r, INT32_MIN, INT32_MAX, &value, valid)) return false;
+    if (*valid) *out = (int32_t)value;
+    return true;
+}
+
+static const json_cmd_key_t KEY_RED = JSON_CMD_KEY("red");
+static const json_cmd_key_t KEY_GREEN = JSON_CMD_KEY("green");
+static const json_cmd_key_t KEY_BLUE = JSON_CMD_KEY("blue");
+
+/**
+ * Reads the color object
+ * @param valid false unless all three channels are present and valid
+ */
+static bool json_cmd_read_color(json_cmd_reader_t *r, json_cmd_color_t *color, bool *valid) {
+    *valid = false;
+    if (json_cmd_peek(r) != '{') return json_cmd_skip_value(r, 1);
+    r->pos++;
+    if (json_cmd_accept(r, '}')) return true;
+
+    uint8_t channels = 0;
+    bool channels_valid = true;
+    do {
+        const char *key;
+        size_t key_len;
+        bool escaped;
+        if (!json_cmd_scan_string(r, &key, &key_len, &escaped) || !json_cmd_expect(r, ':')) return false;
+
+        bool ok;
+        bool channel_valid = true;
+        if (json_cmd_key_is(key, key_len, &KEY_RED)) { ok = json_cmd_read_int32(r, &color->red, &channel_valid); channels |= 1; }
+        else if (json_cmd_key_is(key, key_len, &KEY_GREEN)) { ok = json_cmd_read_int32(r, &color->green, &channel_valid); channels |= 2; }
+        else if (json_cmd_key_is(key, key_len, &KEY_BLUE)) { ok = json_cmd_read_int32(r, &color->blue, &channel_valid); channels |= 4; }
+        else ok = json_cmd_skip_value(r, 2);
+        if (!ok) return false;
+        channels_valid &= channel_valid;
+    } while (json_cmd_accept(r, ','));
+
+    *valid = channels == 7 && channels_valid;
+    return json_cmd_expect(r, '}');
+}
+
+static const json_cmd_key_t KEY_STATE = JSON_CMD_KEY("state");
+static const json_cmd_key_t KEY_MODE = JSON_CMD_KEY("mode");
+static const json_cmd_key_t KEY_COLOR = JSON_CMD_KEY("color");
+static const json_cmd_key_t KEY_BRIGHTNESS = JSON_CMD_KEY("brightness");
+
+/**
+ * Reads the value of a state changing field into the step
+ * @param handled false if the key is not a step field, nothing is consumed then
+ */
+static bool json_cmd_read_step_field(json_cmd_reader_t *r, const char *key, size_t key_len, json_cmd_step_t *step, bool *handled) {
+    uint32_t field;
+    bool valid;
+    bool ok;
+    *handled = true;
+    if (json_cmd_key_is(key, key_len, &KEY_STATE)) { ok = json_cmd_read_int32(r, &step->state, &valid); field = JSON_CMD_FIELD_STATE; }
+    else if (json_cmd_key_is(key, key_len, &KEY_MODE)) { ok = json_cmd_read_int32(r, &step->mode, &valid); field = JSON_CMD_FIELD_MODE; }
+    else if (json_cmd_key_is(key, key_len, &KEY_COLOR)) { ok = json_cmd_read_color(r, &step->color, &valid); field = JSON_CMD_FIELD_COLOR; }
+    else if (json_cmd_key_is(key, key_len, &KEY_BRIGHTNESS)) { ok = json_cmd_read_int32(r, &step->brightness, &valid); field = JSON_CMD_FIELD_BRIGHTNESS; }
+    else {
+        *handled = false;
+        return true;
+    }
+    if (valid) step->fields |= field;
+    else step->invalid |= field;
+    return ok;
+}
+
+/**
+ * Reads one object of the batch
+ * @param valid false if the element is not an object
+ */
+static bool json_cmd_read_step(json_cmd_reader_t *r, json_cmd_step_t *step, bool *valid) {
+    *valid = false;
+    if (json_cmd_peek(r) != '{') return json_cmd_skip_value(r, 2);
+    r->pos++;
+    *valid = true;
+    if (json_cmd_accept(r, '}')) return true;
+
+    do {
+        const char *key;
+        size_t key_len;
+        bool escaped;
+        bool handled;
+        if (!json_cmd_scan_string(r, &key, &key_len, &escaped) || !json_cmd_expect(r, ':')) return false;
+        if (!json_cmd_read_step_field(r, key, key_len, step, &handled)) return false;
+        if (!handled && !json_cmd_skip_value(r, 3)) return false;
+    } while (json_cmd_accept(r, ','));
+    return json_cmd_expect(r, '}');
+}
+
+/**
+ * Reads the batch array
+ * @param valid false if it is not an array of objects or has more than JSON_CMD_MAX_BATCH elements
+ */
+static bool json_cmd_read_batch(json_cmd_reader_t *r, json_cmd_t *cmd, bool *valid) {
+    *valid = false;
+    if (json_cmd_peek(r) != '[') return json_cmd_skip_value(r, 1);
+    r->pos++;
+    *valid = true;
+    if (json_cmd_accept(r, ']')) return true;
+
+    do {
+        // Elements past the limit are still validated so the error offset stays meaningful
+        json_cmd_step_t overflow;
+        json_cmd_step_t *step = cmd->batch_count < JSON_CMD_MAX_BATCH ? &cmd->batch[cmd->batch_count] : &overflow;
+        memset(step, 0, sizeof(json_cmd_step_t));
+        bool step_valid;
+        if (!json_cmd_read_step(r, step, &step_valid)) return false;
+        if (!step_valid || step == &overflow) *valid = false;
+        else cmd->batch_count++;
+    } while (json_cmd_accept(r, ','));
+    return json_cmd_expect(r, ']');
+}
+
+// --------- PUBLIC METHODS --------- //
+
+static const json_cmd_key_t KEY_TAG = JSON_CMD_KEY("tag");
+static const json_cmd_key_t KEY_CID = JSON_CMD_KEY("cid");
+static const json_cmd_key_t KEY_APPLY_AT = JSON_CMD_KEY("apply_at");
+static const json_cmd_key_t KEY_COMMANDS = JSON_CMD_KEY("commands");
+
+json_cmd_err_e json_cmd_parse(const char *data, size_t len, json_cmd_t *cmd, size_t *err_offset) {
+    json_cmd_reader_t r = {.data = data, .len = len, .pos = 0, .err = JSON_CMD_OK};
+    memset(cmd, 0, offsetof(json_cmd_t, batch));
+
+    bool ok = json_cmd_expect(&r, '{');
+    if (ok && !json_cmd_accept(&r, '}')) {
+        do {
+            const char *key;
+            size_t key_len;
+            bool escaped;
+            ok = json_cmd_scan_string(&r, &key, &key_len, &escaped) && json_cmd_expect(&r, ':');
+            if (!ok) break;
+
+            // Known fields with a wrong type are skipped and reported, the rest of the command still counts
+            bool handled;
+            ok = json_cmd_read_step_field(&r, key, key_len, &cmd->step, &handled);
+            if (!ok) break;
+            if (handled) continue;
+
+            uint32_t field = 0;
+            bool valid = true;
+            if (json_cmd_key_is(key, key_len, &KEY_TAG)) { ok = json_cmd_read_string(&r, cmd->tag, sizeof(cmd->tag), &valid); field = JSON_CMD_FIELD_TAG; }
+            else if (json_cmd_key_is(key, key_len, &KEY_CID)) { ok = json_cmd_read_string(&r, cmd->cid, sizeof(cmd->cid), &valid); field = JSON_CMD_FIELD_CID; }
+            else if (json_cmd_key_is(key, key_len, &KEY_APPLY_AT)) { ok = json_cmd_read_int(&r, 0, JSON_CMD_MAX_APPLY_AT_MS, &cmd->apply_at_ms, &valid); field = JSON_CMD_FIELD_APPLY_AT; }
+            else if (json_cmd_key_is(key, key_len, &KEY_COMMANDS)) { ok = json_cmd_read_batch(&r, cmd, &valid); field = JSON_CMD_FIELD_COMMANDS; }
+            else ok = json_cmd_skip_value(&r, 1);
+            if (!ok) break;
+            if (valid) cmd->fields |= field;
+            else cmd->invalid |= field;
+        } while (json_cmd_accept(&r, ','));
+        if (ok) ok = json_cmd_expect(&r, '}');
+    }
+
+    // Nothing but whitespace may follow the object
+    if (ok) {
+        json_cmd_skip_ws(&r);
+        if (r.pos != r.len) ok = json_cmd_fail(&r, JSON_CMD_ERR_SYNTAX);
+    }
+
+    if (!ok && err_offset != NULL) *err_offset = r.pos;
+    return ok ? JSON_CMD_OK : r.err;
+}
+
+const char *json_cmd_err_name(json_cmd_err_e err) {
+    switch (err) {
+        case JSON_CMD_OK: return "ok";
+        case JSON_CMD_ERR_SYNTAX: return "syntax error";
+        case JSON_CMD_ERR_DEPTH: return "nested too deep";
+        default: return "unknown error";
+    }
+}
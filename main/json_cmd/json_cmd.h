@@ -0,0 +1,85 @@
+//
+// Created by kok on 19.10.26.
+//
+
+#ifndef JSON_CMD_H
+#define JSON_CMD_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#define JSON_CMD_TAG_MAX_LEN            32
+#define JSON_CMD_CID_MAX_LEN            24
+#define JSON_CMD_MAX_DEPTH              8    // Nesting limit for skipped values
+#define JSON_CMD_MAX_STEP_MSGS          4    // State, mode, color and brightness, each step becomes at most this many rmt_app messages
+#define JSON_CMD_MAX_BATCH              5    // Steps of a "commands" array, rmt_app queues a whole batch at once
+#define JSON_CMD_MAX_APPLY_AT_MS        253402300799999LL   // End of year 9999, later "apply_at" values are invalid
+
+/**
+ * Fields found in a command
+ */
+#define JSON_CMD_FIELD_TAG              (1 << 0)
+#define JSON_CMD_FIELD_CID              (1 << 1)
+#define JSON_CMD_FIELD_STATE            (1 << 2)
+#define JSON_CMD_FIELD_MODE             (1 << 3)
+#define JSON_CMD_FIELD_COLOR            (1 << 4)   // All three channels are required
+#define JSON_CMD_FIELD_APPLY_AT         (1 << 5)
+#define JSON_CMD_FIELD_COMMANDS         (1 << 6)   // Array of at most JSON_CMD_MAX_BATCH objects
+#define JSON_CMD_FIELD_BRIGHTNESS       (1 << 7)
+
+typedef enum {
+    JSON_CMD_OK,
+    JSON_CMD_ERR_SYNTAX,     // Not valid JSON or the top level is not an object
+    JSON_CMD_ERR_DEPTH,      // Nested deeper than JSON_CMD_MAX_DEPTH
+} json_cmd_err_e;
+
+typedef struct {
+    int32_t red;
+    int32_t green;
+    int32_t blue;
+} json_cmd_color_t;
+
+/**
+ * State change carried by a command or by one element of its "commands" array
+ */
+typedef struct {
+    uint32_t fields;    // JSON_CMD_FIELD_STATE, JSON_CMD_FIELD_MODE, JSON_CMD_FIELD_COLOR and JSON_CMD_FIELD_BRIGHTNESS
+    uint32_t invalid;
+    int32_t state;
+    int32_t mode;
+    json_cmd_color_t color;
+    int32_t brightness;
+} json_cmd_step_t;
+
+/**
+ * Decoded LED strip command. Values are not range checked, only fields flagged in "fields" are valid.
+ */
+typedef struct {
+    uint32_t fields;
+    uint32_t invalid;   // Known fields present with a wrong type, non-integer value or too long string
+    char tag[JSON_CMD_TAG_MAX_LEN];
+    char cid[JSON_CMD_CID_MAX_LEN];
+    int64_t apply_at_ms;
+    json_cmd_step_t step;                      // Top level state, mode, color and brightness
+    size_t batch_count;
+    json_cmd_step_t batch[JSON_CMD_MAX_BATCH]; // Elements of "commands" in order
+} json_cmd_t;
+
+/**
+ * Decodes a command straight from the received buffer without copying it or allocating memory.
+ * Unknown fields are skipped, known fields with a wrong type are flagged in "invalid".
+ * @param data JSON text, doesn't need to be NUL terminated
+ * @param len length of the text
+ * @param cmd decoded command
+ * @param err_offset offset of the first invalid byte if decoding fails, can be NULL
+ * @return JSON_CMD_OK if the whole text is a valid object
+ */
+json_cmd_err_e json_cmd_parse(const char *data, size_t len, json_cmd_t *cmd, size_t *err_offset);
+
+/**
+ * Gets a readable description of an error
+ */
+const char *json_cmd_err_name(json_cmd_err_e err);
+
+#endif //JSON_CMD_H
@@ -0,0 +1,172 @@
+//
+// Created by kok on 19.10.26.
+//
+
+#include <stdio.h>
+#include <string.h>
+
+#include "esp_timer.h"
+
+#include "latency_trace.h"
+
+static const char *g_stage_names[LATENCY_TRACE_STAGES_COUNT] = {
+    [LATENCY_TRACE_STAGE_PARSE] = "parse",
+    [LATENCY_TRACE_STAGE_QUEUE] = "queue",
+    [LATENCY_TRACE_STAGE_RENDER] = "render",
+    [LATENCY_TRACE_STAGE_TOTAL] = "total",
+};
+
+/**
+ * Latency histogram of a single stage
+ */
+typedef struct {
+    uint32_t buckets[LATENCY_TRACE_BUCKETS_COUNT];
+    uint32_t count;
+    uint32_t max_us;
+} latency_trace_histogram_t;
+
+static portMUX_TYPE g_trace_lock = portMUX_INITIALIZER_UNLOCKED;
+static latency_trace_histogram_t g_histograms[LATENCY_TRACE_STAGES_COUNT];
+
+static latency_trace_ack_t g_acks[LATENCY_TRACE_ACK_QUEUE_SIZE];
+static size_t g_acks_head = 0;
+static size_t g_acks_count = 0;
+static TaskHandle_t g_ack_listener = NULL;
+
+// --------- HISTOGRAMS --------- //
+
+/**
+ * Adds a sample to the stage histogram. Must be called with g_trace_lock held.
+ */
+static void latency_trace_record(latency_trace_stage_e stage, uint32_t us) {
+    latency_trace_histogram_t *histogram = &g_histograms[stage];
+    uint32_t bucket = us == 0 ? 0 : 32 - __builtin_clz(us);
+    if (bucket >= LATENCY_TRACE_BUCKETS_COUNT) bucket = LATENCY_TRACE_BUCKETS_COUNT - 1;
+    histogram->buckets[bucket]++;
+    histogram->count++;
+    if (us > histogram->max_us) histogram->max_us = us;
+}
+
+static uint32_t latency_trace_elapsed(int64_t from_us, int64_t to_us) {
+    return to_us > from_us ? (uint32_t)(to_us - from_us) : 0;
+}
+
+/**
+ * Queues an acknowledgement, the oldest one is overwritten when full. Must be called with g_trace_lock held.
+ */
+static void latency_trace_push_ack(const latency_trace_ack_t *ack) {
+    const size_t tail = (g_acks_head + g_acks_count) % LATENCY_TRACE_ACK_QUEUE_SIZE;
+    g_acks[tail] = *ack;
+    if (g_acks_count < LATENCY_TRACE_ACK_QUEUE_SIZE) g_acks_count++;
+    else g_acks_head = (g_acks_head + 1) % LATENCY_TRACE_ACK_QUEUE_SIZE;
+}
+
+// --------- PUBLIC METHODS --------- //
+
+void latency_trace_begin(latency_trace_t *trace, const char *cid) {
+    memset(trace, 0, sizeof(latency_trace_t));
+    trace->recv_us = esp_timer_get_time();
+    if (cid != NULL) strlcpy(trace->cid, cid, sizeof(trace->cid));
+}
+
+bool latency_trace_cid_is_valid(const char *cid) {
+    const size_t len = strlen(cid);
+    if (len == 0 || len >= LATENCY_TRACE_CID_MAX_LEN) return false;
+    for (size_t i = 0; i < len; i++) {
+        const char c = cid[i];
+        if (!((c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') || c == '-' || c == '_' || c == '.' || c == ':'))
+            return false;
+    }
+    return true;
+}
+
+void latency_trace_complete(const latency_trace_t *trace, int64_t photon_us) {
+    if (trace->recv_us == 0) return;
+
+    latency_trace_ack_t ack = {.merged = false};
+    ack.stage_us[LATENCY_TRACE_STAGE_PARSE] = latency_trace_elapsed(trace->recv_us, trace->queued_us);
+    ack.stage_us[LATENCY_TRACE_STAGE_QUEUE] = latency_trace_elapsed(trace->queued_us, trace->applied_us);
+    ack.stage_us[LATENCY_TRACE_STAGE_RENDER] = latency_trace_elapsed(trace->applied_us, photon_us);
+    ack.stage_us[LATENCY_TRACE_STAGE_TOTAL] = latency_trace_elapsed(trace->recv_us, photon_us);
+
+    portENTER_CRITICAL(&g_trace_lock);
+    for (int stage = 0; stage < LATENCY_TRACE_STAGES_COUNT; stage++) latency_trace_record(stage, ack.stage_us[stage]);
+    if (trace->cid[0] != '\0') {
+        memcpy(ack.cid, trace->cid, sizeof(ack.cid));
+        latency_trace_push_ack(&ack);
+    }
+    const TaskHandle_t listener = g_ack_listener;
+    portEXIT_CRITICAL(&g_trace_lock);
+
+    if (trace->cid[0] != '\0' && listener != NULL) xTaskNotifyGive(listener);
+}
+
+bool latency_trace_merged(const latency_trace_t *trace) {
+    if (trace->recv_us == 0 || trace->cid[0] == '\0') return false;
+
+    latency_trace_ack_t ack = {.merged = true};
+    memcpy(ack.cid, trace->cid, sizeof(ack.cid));
+
+    portENTER_CRITICAL(&g_trace_lock);
+    latency_trace_push_ack(&ack);
+    portEXIT_CRITICAL(&g_trace_lock);
+    return true;
+}
+
+void latency_trace_notify(void) {
+    portENTER_CRITICAL(&g_trace_lock);
+    const TaskHandle_t listener = g_ack_listener;
+    portEXIT_CRITICAL(&g_trace_lock);
+
+    if (listener != NULL) xTaskNotifyGive(listener);
+}
+
+uint32_t latency_trace_get_count(void) {
+    portENTER_CRITICAL(&g_trace_lock);
+    const uint32_t count = g_histograms[LATENCY_TRACE_STAGE_TOTAL].count;
+    portEXIT_CRITICAL(&g_trace_lock);
+    return count;
+}
+
+bool latency_trace_pop_ack(latency_trace_ack_t *ack) {
+    bool popped = false;
+    portENTER_CRITICAL(&g_trace_lock);
+    if (g_acks_count > 0) {
+        *ack = g_acks[g_acks_head];
+        g_acks_head = (g_acks_head + 1) % LATENCY_TRACE_ACK_QUEUE_SIZE;
+        g_acks_count--;
+        popped = true;
+    }
+    portEXIT_CRITICAL(&g_trace_lock);
+    return popped;
+}
+
+void latency_trace_set_ack_listener(TaskHandle_t task) {
+    portENTER_CRITICAL(&g_trace_lock);
+    g_ack_listener = task;
+    portEXIT_CRITICAL(&g_trace_lock);
+}
+
+int latency_trace_format_json(char *buffer, size_t size) {
+    latency_trace_histogram_t histograms[LATENCY_TRACE_STAGES_COUNT];
+    portENTER_CRITICAL(&g_trace_lock);
+    memcpy(histograms, g_histograms, sizeof(histograms));
+    portEXIT_CRITICAL(&g_trace_lock);
+
+    size_t offset = snprintf(buffer, size, "{");
+    for (int stage = 0; stage < LATENCY_TRACE_STAGES_COUNT && offset < size; stage++) {
+        offset += snprintf(buffer + offset, size - offset, "\"%s\": {\"count\": %lu, \"max_us\": %lu, \"buckets\": [",
+            g_stage_names[stage], histograms[stage].count, histograms[stage].max_us);
+        for (int bucket = 0; bucket < LATENCY_TRACE_BUCKETS_COUNT && offset < size; bucket++) {
+            offset += snprintf(buffer + offset, size - offset, "%lu%s",
+                histograms[stage].buckets[bucket], bucket < LATENCY_TRACE_BUCKETS_COUNT - 1 ? "," : "");
+        }
+        if (offset < size) offset += snprintf(buffer + offset, size - offset, "]}%s", stage < LATENCY_TRACE_STAGES_COUNT - 1 ? ", " : "");
+    }
+    if (offset < size) offset += snprintf(buffer + offset, size - offset, "}");
+    return offset < size ? (int)offset : (int)size - 1;
+}
+
+const char *latency_trace_stage_name(latency_trace_stage_e stage) {
+    return stage < LATENCY_TRACE_STAGES_COUNT ? g_stage_names[stage] : "unknown";
+}
@@ -0,0 +1,109 @@
+//
+// Created by kok on 19.10.26.
+//
+
+#ifndef LATENCY_TRACE_H
+#define LATENCY_TRACE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+#define LATENCY_TRACE_BUCKETS_COUNT       20   // Bucket b counts latencies below 2^b us, the last one everything above
+#define LATENCY_TRACE_CID_MAX_LEN         24
+#define LATENCY_TRACE_ACK_QUEUE_SIZE      8
+
+/**
+ * Traced stages of a command
+ */
+typedef enum {
+    LATENCY_TRACE_STAGE_PARSE,    // MQTT receive -> queued in rmt_app
+    LATENCY_TRACE_STAGE_QUEUE,    // queued -> applied on a frame boundary, includes the hold of scheduled commands
+    LATENCY_TRACE_STAGE_RENDER,   // applied -> first frame transmitted with it
+    LATENCY_TRACE_STAGE_TOTAL,    // MQTT receive -> first frame transmitted with it
+    LATENCY_TRACE_STAGES_COUNT
+} latency_trace_stage_e;
+
+/**
+ * Timestamps carried along with a command. A zero recv_us means the command is not traced.
+ */
+typedef struct {
+    int64_t recv_us;
+    int64_t queued_us;
+    int64_t applied_us;
+    char cid[LATENCY_TRACE_CID_MAX_LEN];  // Optional client supplied correlation ID
+} latency_trace_t;
+
+/**
+ * Completed trace which should be echoed back to the client
+ */
+typedef struct {
+    char cid[LATENCY_TRACE_CID_MAX_LEN];
+    uint32_t stage_us[LATENCY_TRACE_STAGES_COUNT];
+    bool merged;  // Superseded by a later command before it was applied
+} latency_trace_ack_t;
+
+/**
+ * Starts a trace for a command which was just received
+ * @param trace trace to initialize
+ * @param cid correlation ID or NULL
+ */
+void latency_trace_begin(latency_trace_t *trace, const char *cid);
+
+/**
+ * Checks that a client supplied correlation ID fits and can be echoed back without escaping
+ */
+bool latency_trace_cid_is_valid(const char *cid);
+
+/**
+ * Records the stage latencies of a trace whose command reached the LEDs and queues its acknowledgement
+ * @param trace trace with recv, queued and applied timestamps
+ * @param photon_us time at which the first frame containing the command was transmitted
+ */
+void latency_trace_complete(const latency_trace_t *trace, int64_t photon_us);
+
+/**
+ * Acknowledges a command which was merged into a later one and never applied on its own.
+ * Doesn't notify the listener so it can be called inside a critical section, call latency_trace_notify() afterwards.
+ * @return true if an acknowledgement was queued
+ */
+bool latency_trace_merged(const latency_trace_t *trace);
+
+/**
+ * Wakes the acknowledgement listener up
+ */
+void latency_trace_notify(void);
+
+/**
+ * Gets the number of traces completed so far
+ */
+uint32_t latency_trace_get_count(void);
+
+/**
+ * Pops the next acknowledgement which should be published
+ * @return false if there are none
+ */
+bool latency_trace_pop_ack(latency_trace_ack_t *ack);
+
+/**
+ * Task which is notified whenever an acknowledgement is queued
+ */
+void latency_trace_set_ack_listener(TaskHandle_t task);
+
+/**
+ * Writes the per-stage histograms as a JSON object
+ * @param buffer output buffer
+ * @param size size of the buffer
+ * @return number of characters written
+ */
+int latency_trace_format_json(char *buffer, size_t size);
+
+/**
+ * Gets the name of the stage
+ */
+const char *latency_trace_stage_name(latency_trace_stage_e stage);
+
+#endif //LATENCY_TRACE_H
@@ -0,0 +1,142 @@
+//
+// Created by kok on 19.10.26.
+//
+
+#include <string.h>
+#include <stdlib.h>
+#include <sys/param.h>
+
+#include "esp_log.h"
+#include "esp_timer.h"
+
+#include "led_anim.h"
+
+static const char TAG[] = "led_anim";
+
+esp_err_t led_anim_decode_frame(led_anim_frame_type_e type, const uint8_t *payload, size_t payload_len, uint8_t *fb, size_t fb_len) {
+    size_t in = 0;
+    size_t out = 0;
+    while (in < payload_len) {
+        const uint8_t ctrl = payload[in++];
+        if (ctrl < LED_ANIM_RLE_LITERAL_MAX) {
+            const size_t count = ctrl + 1;
+            if (in + count > payload_len || out + count > fb_len) return ESP_ERR_INVALID_SIZE;
+            if (type == LED_ANIM_FRAME_KEY) memcpy(fb + out, payload + in, count);
+            else for (size_t i = 0; i < count; i++) fb[out + i] ^= payload[in + i];
+            in += count;
+            out += count;
+        } else {
+            const size_t count = ctrl - (LED_ANIM_RLE_LITERAL_MAX - 1);
+            if (in >= payload_len || out + count > fb_len) return ESP_ERR_INVALID_SIZE;
+            const uint8_t value = payload[in++];
+            if (type == LED_ANIM_FRAME_KEY) memset(fb + out, value, count);
+            else if (value != 0) for (size_t i = 0; i < count; i++) fb[out + i] ^= value;
+            // A zero XOR run leaves the pixels untouched
+            out += count;
+        }
+    }
+    return out == fb_len ? ESP_OK : ESP_ERR_INVALID_SIZE;
+}
+
+esp_err_t led_anim_open(const char *path, led_anim_player_t *player) {
+    memset(player, 0, sizeof(led_anim_player_t));
+
+    player->fp = fopen(path, "rb");
+    if (player->fp == NULL) {
+        ESP_LOGE(TAG, "Failed to open animation file: %s", path);
+        return ESP_ERR_NOT_FOUND;
+    }
+
+    if (fread(&player->header, sizeof(led_anim_header_t), 1, player->fp) != 1 ||
+        memcmp(player->header.magic, LED_ANIM_MAGIC, sizeof(player->header.magic)) != 0 ||
+        player->header.version != LED_ANIM_VERSION ||
+        player->header.led_count == 0 ||
+        player->header.frame_count == 0 ||
+        player->header.frame_interval_ms == 0) {
+        ESP_LOGE(TAG, "Invalid animation header: %s", path);
+        led_anim_close(player);
+        return ESP_ERR_INVALID_VERSION;
+    }
+
+    // Worst case RLE output is one control byte per 128 literal bytes
+    const size_t frame_size = player->header.led_count * 3;
+    player->payload_size = frame_size + frame_size / LED_ANIM_RLE_LITERAL_MAX + 1;
+    player->payload = malloc(player->payload_size);
+    if (player->payload == NULL) {
+        ESP_LOGE(TAG, "Failed to allocate memory for the animation payload!");
+        led_anim_close(player);
+        return ESP_ERR_NO_MEM;
+    }
+
+    ESP_LOGI(TAG, "Opened animation %s: %d LEDs, %d frames, %d ms/frame",
+        path, player->header.led_count, player->header.frame_count, player->header.frame_interval_ms);
+    return ESP_OK;
+}
+
+esp_err_t led_anim_next_frame(led_anim_player_t *player, uint8_t *fb, size_t fb_len) {
+    const size_t frame_size = player->header.led_count * 3;
+    if (player->fp == NULL || fb_len == 0) return ESP_ERR_INVALID_ARG;
+
+    // Delta frames need the whole previous frame, a shorter strip gets a copy of its part
+    if (fb_len < frame_size && player->frame == NULL) {
+        player->frame = calloc(1, frame_size);
+        if (player->frame == NULL) {
+            ESP_LOGE(TAG, "Failed to allocate memory for the animation frame!");
+            return ESP_ERR_NO_MEM;
+        }
+        ESP_LOGW(TAG, "Animation has %d LEDs, only the first %d are shown", player->header.led_count, (int)(fb_len / 3));
+    }
+    uint8_t *target = player->frame != NULL ? player->frame : fb;
+
+    // Loop back to the first frame which is always a keyframe
+    if (player->frame_index >= player->header.frame_count) {
+        const uint64_t raw_bytes = (uint64_t)player->stats.frames_decoded * frame_size;
+        ESP_LOGI(TAG, "Animation loop done: compression ratio %.2f, avg decode %llu us, max decode %lu us",
+            player->stats.file_bytes ? (double)raw_bytes / player->stats.file_bytes : 0.0,
+            player->stats.frames_decoded ? player->stats.total_decode_us / player->stats.frames_decoded : 0,
+            player->stats.max_decode_us);
+        if (fseek(player->fp, sizeof(led_anim_header_t), SEEK_SET) != 0) {
+            // The caller closes the player and reopens the file, or falls back
+            ESP_LOGE(TAG, "Failed to seek back to the first frame");
+            return ESP_FAIL;
+        }
+        player->frame_index = 0;
+    }
+
+    led_anim_frame_header_t frame_header;
+    if (fread(&frame_header, sizeof(led_anim_frame_header_t), 1, player->fp) != 1 ||
+        frame_header.payload_len > player->payload_size ||
+        (player->frame_index == 0 && frame_header.type != LED_ANIM_FRAME_KEY)) {
+        ESP_LOGE(TAG, "Corrupted frame header at frame %d", player->frame_index);
+        return ESP_ERR_INVALID_RESPONSE;
+    }
+    if (fread(player->payload, 1, frame_header.payload_len, player->fp) != frame_header.payload_len) {
+        ESP_LOGE(TAG, "Truncated frame payload at frame %d", player->frame_index);
+        return ESP_ERR_INVALID_SIZE;
+    }
+
+    const int64_t start_us = esp_timer_get_time();
+    const esp_err_t err = led_anim_decode_frame(frame_header.type, player->payload, frame_header.payload_len, target, frame_size);
+    const uint32_t decode_us = esp_timer_get_time() - start_us;
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to decode frame %d: %s", player->frame_index, esp_err_to_name(err));
+        return err;
+    }
+    if (player->frame != NULL) memcpy(fb, player->frame, MIN(fb_len, frame_size));
+
+    player->frame_index++;
+    player->stats.frames_decoded++;
+    player->stats.file_bytes += sizeof(led_anim_frame_header_t) + frame_header.payload_len;
+    player->stats.total_decode_us += decode_us;
+    if (decode_us > player->stats.max_decode_us) player->stats.max_decode_us = decode_us;
+    return ESP_OK;
+}
+
+void led_anim_close(led_anim_player_t *player) {
+    if (player->fp != NULL) fclose(player->fp);
+    free(player->payload);
+    free(player->frame);
+    player->fp = NULL;
+    player->payload = NULL;
+    player->frame = NULL;
+}
@@ -0,0 +1,107 @@
+//
+// Created by kok on 19.10.26.
+//
+
+#ifndef LED_ANIM_H
+#define LED_ANIM_H
+
+#include <stdio.h>
+#include <stdint.h>
+
+#include "esp_err.h"
+
+#define LED_ANIM_MAGIC                  "LANM"
+#define LED_ANIM_VERSION                1
+
+#define LED_ANIM_FLAG_ORDER_GRB         0x01
+
+#define LED_ANIM_RLE_LITERAL_MAX        0x80 // Control bytes 0x00 - 0x7F: copy (n + 1) literal bytes
+#define LED_ANIM_RLE_REPEAT_MAX         0x80 // Control bytes 0x80 - 0xFF: repeat next byte (n - 0x7F) times
+
+/**
+ * Animation frame types
+ */
+typedef enum {
+    LED_ANIM_FRAME_KEY = 0,   // RLE coded raw pixels
+    LED_ANIM_FRAME_DELTA = 1  // RLE coded XOR against the previous frame
+} led_anim_frame_type_e;
+
+/**
+ * Animation file header (little endian)
+ */
+typedef struct __attribute__((packed)) {
+    char magic[4];
+    uint8_t version;
+    uint8_t flags;
+    uint16_t led_count;
+    uint16_t frame_count;
+    uint16_t frame_interval_ms;
+} led_anim_header_t;
+
+/**
+ * Header which precedes every frame's payload
+ */
+typedef struct __attribute__((packed)) {
+    uint8_t type;
+    uint8_t reserved;
+    uint16_t payload_len;
+} led_anim_frame_header_t;
+
+/**
+ * Playback statistics
+ */
+typedef struct {
+    uint32_t frames_decoded;
+    uint32_t file_bytes;
+    uint64_t total_decode_us;
+    uint32_t max_decode_us;
+} led_anim_stats_t;
+
+/**
+ * Animation player structure
+ */
+typedef struct {
+    FILE *fp;
+    led_anim_header_t header;
+    uint8_t *payload;
+    size_t payload_size;
+    uint8_t *frame;          // Whole frame when the strip is shorter than the animation, NULL otherwise
+    uint16_t frame_index;
+    led_anim_stats_t stats;
+} led_anim_player_t;
+
+/**
+ * Decodes a single frame's payload straight into the framebuffer
+ * @param type led_anim_frame_type_e of the payload
+ * @param payload RLE coded frame data
+ * @param payload_len size of payload in bytes
+ * @param fb framebuffer holding the previous frame (required for delta frames)
+ * @param fb_len number of bytes the frame should cover
+ * @return ESP_OK if the payload covered exactly fb_len bytes
+ */
+esp_err_t led_anim_decode_frame(led_anim_frame_type_e type, const uint8_t *payload, size_t payload_len, uint8_t *fb, size_t fb_len);
+
+/**
+ * Opens an animation file and validates its header
+ * @param path path to the animation file
+ * @param player player structure which should be initialized
+ * @return ESP_OK if the animation can be played
+ */
+esp_err_t led_anim_open(const char *path, led_anim_player_t *player);
+
+/**
+ * Decodes the next frame into the framebuffer. Rewinds to the first frame after the last one.
+ * An animation with more LEDs than the framebuffer holds is cut to its first fb_len bytes.
+ * @param player opened animation player
+ * @param fb framebuffer, led_count * 3 bytes are written at most
+ * @param fb_len size of the framebuffer
+ * @return ESP_OK if a frame was decoded
+ */
+esp_err_t led_anim_next_frame(led_anim_player_t *player, uint8_t *fb, size_t fb_len);
+
+/**
+ * Closes the animation and releases its resources
+ */
+void led_anim_close(led_anim_player_t *player);
+
+#endif //LED_ANIM_H
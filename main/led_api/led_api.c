@@ -0,0 +1,176 @@
+//
+// Created by kok on 19.10.26.
+//
+
+#include <stdio.h>
+#include <string.h>
+#include <strings.h>
+
+#include "esp_log.h"
+#include "esp_timer.h"
+
+#include "rmt/rmt_app.h"
+#include "json_cmd/json_cmd.h"
+#include "latency_trace/latency_trace.h"
+#include "msgpack_cmd/msgpack_cmd.h"
+#include "led_status/led_status.h"
+#include "mqtt_app/mqtt_app.h"
+#include "http_server/http_server.h"
+#include "led_api.h"
+
+#define LED_API_RECV_RETRIES            3       // Socket timeouts tolerated while receiving a body
+#define LED_API_CONTENT_TYPE_LEN        48
+
+static const char TAG[] = "led_api";
+
+// Handlers run on the single HTTP server task, so the bodies and counters need no locking
+static char g_body[LED_API_MAX_BODY_LEN];
+static uint8_t g_frame[RMT_APP_LED_NUMBERS * 3];
+static led_api_stats_t g_stats;
+
+/**
+ * Receives the whole request body
+ * @return false if the connection failed, the socket should be closed
+ */
+static bool led_api_recv(httpd_req_t *req, void *buffer, size_t len) {
+    size_t received = 0;
+    int retries = 0;
+    while (received < len) {
+        const int ret = httpd_req_recv(req, (char*)buffer + received, len - received);
+        if (ret == HTTPD_SOCK_ERR_TIMEOUT && retries++ < LED_API_RECV_RETRIES) continue;
+        if (ret <= 0) {
+            ESP_LOGE(TAG, "Failed to receive the request body: %d", ret);
+            return false;
+        }
+        received += ret;
+    }
+    return true;
+}
+
+/**
+ * Checks the media type of the body, ignoring parameters such as the charset
+ */
+static bool led_api_content_type_is(httpd_req_t *req, const char *type) {
+    char value[LED_API_CONTENT_TYPE_LEN];
+    if (httpd_req_get_hdr_value_str(req, "Content-Type", value, sizeof(value)) != ESP_OK) return false;
+    const size_t len = strlen(type);
+    return strncasecmp(value, type, len) == 0 && (value[len] == '\0' || value[len] == ';' || value[len] == ' ');
+}
+
+static esp_err_t led_api_finish(int64_t start_us, esp_err_t err) {
+    const int64_t elapsed_us = esp_timer_get_time() - start_us;
+    g_stats.total_us += elapsed_us;
+    if (elapsed_us > g_stats.max_us) g_stats.max_us = elapsed_us;
+    return err;
+}
+
+/**
+ * Answers a request which can't be handled with an error status and a JSON message
+ */
+static esp_err_t led_api_reject(httpd_req_t *req, const char *status, const char *message, int64_t start_us) {
+    char responseJSON[160];
+    g_stats.rejected++;
+    snprintf(responseJSON, sizeof(responseJSON), "{\"status\": \"fail\", \"message\": \"%s\"}", message);
+    httpd_resp_set_status(req, status);
+    httpd_resp_send(req, responseJSON, HTTPD_RESP_USE_STRLEN);
+    return led_api_finish(start_us, ESP_OK);
+}
+
+// --------- URI HANDLERS --------- //
+
+esp_err_t led_api_get_handler(httpd_req_t *req) {
+    const int64_t start_us = esp_timer_get_time();
+    g_stats.requests++;
+    http_server_set_cors_headers(req);
+    httpd_resp_set_type(req, "application/json");
+
+    const rmt_app_active_config_t config = rmt_app_get_active_config();
+    const led_status_t status = {
+        .state = config.state,
+        .mode = config.mode,
+        .red = config.colors.red,
+        .green = config.colors.green,
+        .blue = config.colors.blue,
+    };
+    char responseJSON[LED_STATUS_LEN + 1];
+    const size_t len = led_status_format(responseJSON, &status);
+    return led_api_finish(start_us, httpd_resp_send(req, responseJSON, len));
+}
+
+esp_err_t led_api_command_handler(httpd_req_t *req) {
+    const int64_t start_us = esp_timer_get_time();
+    g_stats.requests++;
+    http_server_set_cors_headers(req);
+    httpd_resp_set_type(req, "application/json");
+
+    if (req->content_len == 0 || req->content_len > sizeof(g_body))
+        return led_api_reject(req, HTTPD_400, "The command body is missing or too large!", start_us);
+    if (!led_api_recv(req, g_body, req->content_len)) {
+        g_stats.rejected++;
+        return led_api_finish(start_us, ESP_FAIL);
+    }
+
+    // Decoded in place, the body is neither copied nor NUL terminated
+    json_cmd_t cmd;
+    size_t err_offset;
+    const bool msgpack = led_api_content_type_is(req, "application/msgpack") || led_api_content_type_is(req, "application/x-msgpack");
+    const json_cmd_err_e err = msgpack
+        ? msgpack_cmd_parse((const uint8_t*)g_body, req->content_len, &cmd, &err_offset)
+        : json_cmd_parse(g_body, req->content_len, &cmd, &err_offset);
+    if (err != JSON_CMD_OK) {
+        char message[80];
+        snprintf(message, sizeof(message), "%s at offset %d", json_cmd_err_name(err), (int)err_offset);
+        return led_api_reject(req, HTTPD_400, message, start_us);
+    }
+    if ((cmd.fields & JSON_CMD_FIELD_TAG) && strcmp(cmd.tag, MQTT_APP_TAG_LED_STRIP) != 0)
+        return led_api_reject(req, HTTPD_400, "Only the " MQTT_APP_TAG_LED_STRIP " tag is accepted!", start_us);
+    // The top level state changing fields are flagged in the step, not in the command
+    if (!(cmd.fields & JSON_CMD_FIELD_COMMANDS) && cmd.step.fields == 0 && cmd.invalid == 0 && cmd.step.invalid == 0)
+        return led_api_reject(req, HTTPD_400, "Please, provide a state, mode, color, brightness or commands!", start_us);
+
+    // Fields left out keep their value, nothing is applied if one is invalid
+    switch (rmt_app_set_from_command(&cmd, NULL, true)) {
+        case RMT_APP_CMD_INVALID:
+            return led_api_reject(req, HTTPD_400, "Invalid or out of range values, nothing was changed!", start_us);
+        case RMT_APP_CMD_QUEUE_FULL:
+            return led_api_reject(req, LED_API_503, "The command queue is full, please retry!", start_us);
+        default: break;
+    }
+    g_stats.commands++;
+
+    // The correlation ID is echoed so a client can match pipelined answers, only if it needs no escaping
+    char responseJSON[48 + JSON_CMD_CID_MAX_LEN];
+    if ((cmd.fields & JSON_CMD_FIELD_CID) && latency_trace_cid_is_valid(cmd.cid))
+        snprintf(responseJSON, sizeof(responseJSON), "{\"status\": \"success\", \"cid\": \"%s\"}", cmd.cid);
+    else
+        strlcpy(responseJSON, "{\"status\": \"success\"}", sizeof(responseJSON));
+    httpd_resp_set_status(req, HTTP_SERVER_202);
+    return led_api_finish(start_us, httpd_resp_send(req, responseJSON, HTTPD_RESP_USE_STRLEN));
+}
+
+esp_err_t led_api_pixels_handler(httpd_req_t *req) {
+    const int64_t start_us = esp_timer_get_time();
+    g_stats.requests++;
+    http_server_set_cors_headers(req);
+    httpd_resp_set_type(req, "application/json");
+
+    if (!led_api_content_type_is(req, "application/octet-stream"))
+        return led_api_reject(req, "415 Unsupported Media Type", "Pixel frames must be application/octet-stream!", start_us);
+    if (req->content_len == 0 || req->content_len > sizeof(g_frame))
+        return led_api_reject(req, HTTPD_400, "The frame is empty or longer than the strip!", start_us);
+    if (!led_api_recv(req, g_frame, req->content_len)) {
+        g_stats.rejected++;
+        return led_api_finish(start_us, ESP_FAIL);
+    }
+
+    // Published directly, the MQTT task may be streaming into the back buffer at the same time
+    rmt_app_pixels_show(g_frame, req->content_len, NULL);
+    g_stats.frames++;
+
+    httpd_resp_set_status(req, HTTP_SERVER_202);
+    return led_api_finish(start_us, httpd_resp_send(req, "{\"status\": \"success\"}", HTTPD_RESP_USE_STRLEN));
+}
+
+led_api_stats_t led_api_get_stats(void) {
+    return g_stats;
+}
@@ -0,0 +1,56 @@
+//
+// Created by kok on 19.10.26.
+//
+
+#ifndef LED_API_H
+#define LED_API_H
+
+#include <stdint.h>
+
+#include "esp_err.h"
+#include "esp_http_server.h"
+
+#define LED_API_URI                     "/api/led"
+#define LED_API_PIXELS_URI              "/api/led/pixels"
+#define LED_API_MAX_BODY_LEN            1024    // Largest command body, a full "commands" batch fits easily
+#define LED_API_503                     "503 Service Unavailable"
+
+/**
+ * REST API counters
+ */
+typedef struct {
+    uint32_t requests;
+    uint32_t commands;       // Commands handed to rmt_app
+    uint32_t frames;         // Pixel frames published
+    uint32_t rejected;       // Malformed, oversized or unsupported bodies
+    uint64_t total_us;       // Time spent in the handlers, including receiving the body
+    uint32_t max_us;
+} led_api_stats_t;
+
+/**
+ * GET /api/led: current state, mode and color in the format of the MQTT status message
+ */
+esp_err_t led_api_get_handler(httpd_req_t *req);
+
+/**
+ * POST or PUT /api/led: a command with the fields of an MQTT command ("tag" is optional).
+ * State, mode, color and brightness (0 to 255, scales every frame) can be set. rmt_app has no segments or effect parameters yet.
+ * The body is JSON, or MessagePack with Content-Type application/msgpack. It is decoded without building a tree
+ * and applied through rmt_app_set_from_command() as a strict command: fields left out keep their value and
+ * nothing changes if one is invalid. Answered with 202 once it is queued, 400 if invalid, 503 if the queue is full.
+ * A valid "cid" is echoed in the 202 answer. It is not traced, the latency acknowledgements are only published over MQTT.
+ */
+esp_err_t led_api_command_handler(httpd_req_t *req);
+
+/**
+ * POST or PUT /api/led/pixels: a raw RGB frame with Content-Type application/octet-stream,
+ * at most 3 bytes per LED. Selects the pixels mode.
+ */
+esp_err_t led_api_pixels_handler(httpd_req_t *req);
+
+/**
+ * Gets the REST API counters
+ */
+led_api_stats_t led_api_get_stats(void);
+
+#endif //LED_API_H
@@ -0,0 +1,37 @@
+//
+// Created by kok on 19.10.26.
+//
+
+#include <string.h>
+
+#include "led_status.h"
+
+/**
+ * Slot offsets follow from the template prefixes at compile time
+ */
+#define LED_STATUS_SLOT_STATE           (sizeof(LED_STATUS_TEMPLATE_STATE) - 1)
+#define LED_STATUS_SLOT_MODE            (sizeof(LED_STATUS_TEMPLATE_MODE) - 1)
+#define LED_STATUS_SLOT_RED             (sizeof(LED_STATUS_TEMPLATE_RED) - 1)
+#define LED_STATUS_SLOT_GREEN           (sizeof(LED_STATUS_TEMPLATE_GREEN) - 1)
+#define LED_STATUS_SLOT_BLUE            (sizeof(LED_STATUS_TEMPLATE_BLUE) - 1)
+
+static const char g_template[] = LED_STATUS_TEMPLATE;
+
+/**
+ * Writes a value right aligned into its three character slot
+ */
+static void led_status_patch(char *slot, uint8_t value) {
+    slot[2] = '0' + value % 10;
+    slot[1] = value >= 10 ? '0' + value / 10 % 10 : ' ';
+    slot[0] = value >= 100 ? '0' + value / 100 : ' ';
+}
+
+size_t led_status_format(char *buffer, const led_status_t *status) {
+    memcpy(buffer, g_template, sizeof(g_template));
+    led_status_patch(buffer + LED_STATUS_SLOT_STATE, status->state);
+    led_status_patch(buffer + LED_STATUS_SLOT_MODE, status->mode);
+    led_status_patch(buffer + LED_STATUS_SLOT_RED, status->red);
+    led_status_patch(buffer + LED_STATUS_SLOT_GREEN, status->green);
+    led_status_patch(buffer + LED_STATUS_SLOT_BLUE, status->blue);
+    return LED_STATUS_LEN;
+}
@@ -0,0 +1,45 @@
+//
+// Created by kok on 19.10.26.
+//
+
+#ifndef LED_STATUS_H
+#define LED_STATUS_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define LED_STATUS_TAG                  "led_strip"     // Tag of the status message and of the commands it answers
+
+/**
+ * Status message template. Every numeric field has a fixed three character slot which is
+ * patched in place, right aligned and padded with JSON whitespace.
+ */
+#define LED_STATUS_TEMPLATE_STATE       "{\"tag\":\"" LED_STATUS_TAG "\",\"state\":"
+#define LED_STATUS_TEMPLATE_MODE        LED_STATUS_TEMPLATE_STATE "___,\"mode\":"
+#define LED_STATUS_TEMPLATE_RED         LED_STATUS_TEMPLATE_MODE "___,\"color\":{\"red\":"
+#define LED_STATUS_TEMPLATE_GREEN       LED_STATUS_TEMPLATE_RED "___,\"green\":"
+#define LED_STATUS_TEMPLATE_BLUE        LED_STATUS_TEMPLATE_GREEN "___,\"blue\":"
+#define LED_STATUS_TEMPLATE             LED_STATUS_TEMPLATE_BLUE "___}}"
+
+#define LED_STATUS_LEN                  (sizeof(LED_STATUS_TEMPLATE) - 1)
+
+/**
+ * Values reported in the status message
+ */
+typedef struct {
+    uint8_t state;
+    uint8_t mode;
+    uint8_t red;
+    uint8_t green;
+    uint8_t blue;
+} led_status_t;
+
+/**
+ * Writes the status message without any allocation. The output always has LED_STATUS_LEN characters.
+ * @param buffer output buffer of at least LED_STATUS_LEN + 1 bytes
+ * @param status values to report
+ * @return number of characters written
+ */
+size_t led_status_format(char *buffer, const led_status_t *status);
+
+#endif //LED_STATUS_H
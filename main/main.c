@@ -1,5 +1,7 @@
+#include "freertos/FreeRTOS.h"
 #include "esp_log.h"
 
+#include "tasks_common.h"
 #include "app_nvs/app_nvs.h"
 #include "app_spiffs/app_spiffs.h"
 #include "wifi_app/wifi_app.h"
@@ -8,29 +10,87 @@
 #include "object_sensor/object_sensor.h"
 #include "mode_switcher/mode_switcher.h"
 #include "mqtt_app/mqtt_app.h"
+#include "audio_app/audio_app.h"
+#include "boot_stats/boot_stats.h"
+#include "time_sync/time_sync.h"
+#include "frame_sync/frame_sync.h"
+#include "cjson_arena/cjson_arena.h"
 
 /**
  * Callback function which is called upon establishing a WiFi connection
  */
 void wifi_app_connected_cb(void) {
+    boot_stats_mark(BOOT_STATS_PHASE_WIFI_UP);
+
+    // Scheduled commands need a synchronized wall clock
+    time_sync_init();
+
+    // Keep running effects phase aligned with the other controllers
+    frame_sync_init();
+
     // Start MQTT application
     mqtt_app_init();
 }
 
-void app_main() {
-
-    // Initialize NVS
-    app_nvs_init();
-
-    // Initialize SPIFFS
+#if !HTTP_SERVER_EMBED_ASSETS
+/**
+ * Mounts the filesystem in the background
+ */
+static void app_fs_boot_task(void *pvParams) {
     app_spiffs_init();
+    vTaskDelete(NULL);
+}
+#endif
 
-    // Start WiFi and HTTP server
+/**
+ * Brings up WiFi and the HTTP server in the background
+ */
+static void app_network_boot_task(void *pvParams) {
     wifi_app_cb_set(wifi_app_connected_cb);
+    http_server_monitor_init();
     wifi_app_init();
     http_server_init();
+    boot_stats_mark(BOOT_STATS_PHASE_HTTP_UP);
+    vTaskDelete(NULL);
+}
+
+void app_main() {
+
+    // cJSON allocates from a per-message arena instead of the heap
+    cjson_arena_init();
 
+    // Initialize NVS
+    app_nvs_init();
+
+    // Restore the last LED state and render the first frame before anything slow is started
     rmt_app_start();
     object_sensor_init();
     mode_switcher_init();
+
+    // Filesystem and network bring-up continue in parallel. With the web interface embedded in the app image,
+    // SPIFFS is only mounted once an animation is played, spiffs_up is marked then.
+#if !HTTP_SERVER_EMBED_ASSETS
+    xTaskCreatePinnedToCore(
+        &app_fs_boot_task,
+        "app_fs_boot_task",
+        APP_BOOT_TASK_STACK_SIZE,
+        NULL,
+        APP_BOOT_TASK_PRIORITY,
+        NULL,
+        APP_BOOT_TASK_CORE_ID
+    );
+#endif
+    xTaskCreatePinnedToCore(
+        &app_network_boot_task,
+        "app_network_boot_task",
+        APP_BOOT_TASK_STACK_SIZE,
+        NULL,
+        APP_BOOT_TASK_PRIORITY,
+        NULL,
+        APP_BOOT_TASK_CORE_ID
+    );
+
+#if AUDIO_APP_ENABLED
+    audio_app_init();
+#endif
 }
@@ -2,100 +2,546 @@
 // Created by kok on 08.09.24.
 //
 
+#include <stdatomic.h>
+
 #include "mqtt_client.h"
 #include "esp_log.h"
+#include "esp_timer.h"
+#include "sys/param.h"
 
 #include "tasks_common.h"
-#include "cjson/cJSON.h"
 #include "mqtt_app.h"
 
 #include "rmt/rmt_app.h"
+#include "boot_stats/boot_stats.h"
+#include "latency_trace/latency_trace.h"
+#include "json_cmd/json_cmd.h"
+#include "led_status/led_status.h"
+#include "msgpack_cmd/msgpack_cmd.h"
+
+#include "cjson/cJSON.h"
 
 static const char TAG[] = "mqtt_app";
 
 static esp_mqtt_client_handle_t mqtt_handle;
+static TaskHandle_t g_publish_task_handle = NULL;
+static atomic_bool g_state_resync = false;
+static atomic_bool g_connected = false;
 
-static void mqtt_app_publish_task(void *pvParams) {
-    ESP_LOGI(TAG, "Start publishing current LED config to MQTT broker");
-    while(1) {
-        const rmt_app_active_config_t led_config = rmt_app_get_active_config();
+// Guards every counter below, they are written by the MQTT client and publish tasks and read by the HTTP server
+static portMUX_TYPE g_stats_lock = portMUX_INITIALIZER_UNLOCKED;
 
-        cJSON *json = cJSON_CreateObject();
-        if (json == NULL) {
-            ESP_LOGE(TAG, "Failed to create JSON object!");
-            vTaskDelay(1000 / portTICK_PERIOD_MS);
-            continue;
-        }
+/**
+ * Messages waiting to be published. Only the publish task touches the entries, the counters are under g_stats_lock.
+ */
+typedef struct {
+    char key[MQTT_APP_OUTBOX_KEY_LEN];
+    const char *topic;
+    char msg[MQTT_APP_OUTBOX_MSG_SIZE];
+    size_t len;
+    bool retain;
+} mqtt_app_outbox_entry_t;
 
-        cJSON_AddStringToObject(json, "tag", MQTT_APP_TAG_LED_STRIP);
-        cJSON_AddNumberToObject(json, "state", led_config.state);
-        cJSON_AddNumberToObject(json, "mode", led_config.mode);
+static struct {
+    mqtt_app_outbox_entry_t entries[MQTT_APP_OUTBOX_SLOTS];
+    int head;
+    int count;
+    mqtt_app_outbox_stats_t stats;
+} g_outbox;
 
-        cJSON *color = cJSON_CreateObject();
-        if (color == NULL) {
-            ESP_LOGE(TAG, "Failed to create JSON object for field \"color\"!");
-            cJSON_Delete(json);  // Clean up the main object
-            vTaskDelay(1000 / portTICK_PERIOD_MS);
-            continue;
-        }
+/**
+ * Message being received, only touched by the MQTT client task
+ */
+typedef enum {
+    MQTT_APP_RX_NONE,
+    MQTT_APP_RX_COMMAND,       // Reassembled into g_rx_buffer
+    MQTT_APP_RX_PIXELS,        // Streamed into the RMT back buffer
+    MQTT_APP_RX_PIXELS_JSON,   // Reassembled into g_rx_buffer, then decoded into the RMT back buffer
+    MQTT_APP_RX_DISCARD
+} mqtt_app_rx_kind_e;
+
+/**
+ * Topics below MQTT_APP_TOPIC_BASE, all covered by one wildcard subscription
+ */
+typedef struct {
+    const char *suffix;
+    mqtt_app_rx_kind_e kind;
+    mqtt_app_format_e format;   // Encoding of commands
+    mqtt_app_handler_stats_t stats;
+} mqtt_app_route_t;
+
+static mqtt_app_route_t g_routes[] = {
+    {.suffix = "", .kind = MQTT_APP_RX_COMMAND, .format = MQTT_APP_FORMAT_JSON},
+    {.suffix = MQTT_APP_TOPIC_MSGPACK, .kind = MQTT_APP_RX_COMMAND, .format = MQTT_APP_FORMAT_MSGPACK},
+    {.suffix = MQTT_APP_TOPIC_PIXELS, .kind = MQTT_APP_RX_PIXELS},
+    {.suffix = MQTT_APP_TOPIC_PIXELS_JSON, .kind = MQTT_APP_RX_PIXELS_JSON, .format = MQTT_APP_FORMAT_JSON},
+};
+
+/**
+ * Payload sizes and coding times per format. Decoding happens on the MQTT client task,
+ * encoding on the publish task.
+ */
+static mqtt_app_codec_stats_t g_codec_stats[MQTT_APP_FORMATS_COUNT];
+static mqtt_app_codec_counter_t g_pixels_json_decoded;   // JSON pixel frames, kept apart from the commands
+
+// A compact JSON frame for the whole strip ("255," per channel) has to fit the reassembly buffer.
+// Longer strips need a larger MQTT_APP_RX_BUFFER_SIZE or the raw pixels topic, 1000 LEDs take about 10.7 kB of JSON.
+_Static_assert(RMT_APP_LED_NUMBERS * 3 * 4 + 1 <= MQTT_APP_RX_BUFFER_SIZE, "JSON pixel frames don't fit MQTT_APP_RX_BUFFER_SIZE");
+
+static void mqtt_app_codec_count(mqtt_app_codec_counter_t *counter, size_t bytes, int64_t us) {
+    portENTER_CRITICAL(&g_stats_lock);
+    counter->messages++;
+    counter->bytes += bytes;
+    counter->total_us += us;
+    portEXIT_CRITICAL(&g_stats_lock);
+}
+
+static struct {
+    mqtt_app_rx_kind_e kind;
+    mqtt_app_route_t *route;
+    int total_len;
+    int received;
+    int64_t busy_us;   // Processing time of the fragments so far
+    latency_trace_t trace;
+} g_rx;
+static char g_rx_buffer[MQTT_APP_RX_BUFFER_SIZE];
+
+/**
+ * Command handlers by tag. g_handler_slots is an open addressing index over the FNV-1a hash of the tag,
+ * slot values are handler indices + 1.
+ */
+typedef struct {
+    const char *tag;
+    void (*handle)(const json_cmd_t *cmd, latency_trace_t *trace);
+    uint32_t hash;
+    mqtt_app_handler_stats_t stats;
+} mqtt_app_handler_t;
+
+static void mqtt_app_handle_led_strip(const json_cmd_t *cmd, latency_trace_t *trace) {
+    rmt_app_set_from_command(cmd, trace, false);
+}
+
+static mqtt_app_handler_t g_handlers[] = {
+    {.tag = MQTT_APP_TAG_LED_STRIP, .handle = mqtt_app_handle_led_strip},
+};
+static uint8_t g_handler_slots[MQTT_APP_HANDLER_SLOTS];
+
+// --------- DISPATCH --------- //
+
+static uint32_t mqtt_app_hash(const char *str) {
+    uint32_t hash = 2166136261u;
+    while (*str) {
+        hash ^= (uint8_t)*str++;
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+/**
+ * Builds the handler index. Logs if two tags share a slot, lookups still work but need a probe.
+ */
+static void mqtt_app_build_handler_index(void) {
+    _Static_assert(sizeof(g_handlers) / sizeof(g_handlers[0]) < MQTT_APP_HANDLER_SLOTS, "Handler index is too small");
+    memset(g_handler_slots, 0, sizeof(g_handler_slots));
+    for (int i = 0; i < sizeof(g_handlers) / sizeof(g_handlers[0]); i++) {
+        g_handlers[i].hash = mqtt_app_hash(g_handlers[i].tag);
+        uint32_t slot = g_handlers[i].hash & (MQTT_APP_HANDLER_SLOTS - 1);
+        if (g_handler_slots[slot] != 0) ESP_LOGW(TAG, "Handler tag \"%s\" collides in the index", g_handlers[i].tag);
+        while (g_handler_slots[slot] != 0) slot = (slot + 1) & (MQTT_APP_HANDLER_SLOTS - 1);
+        g_handler_slots[slot] = i + 1;
+    }
+}
+
+/**
+ * Finds the handler of a tag in O(1)
+ * @return handler or NULL if none is registered
+ */
+static mqtt_app_handler_t *mqtt_app_find_handler(const char *tag) {
+    const uint32_t hash = mqtt_app_hash(tag);
+    for (uint32_t slot = hash & (MQTT_APP_HANDLER_SLOTS - 1); g_handler_slots[slot] != 0; slot = (slot + 1) & (MQTT_APP_HANDLER_SLOTS - 1)) {
+        mqtt_app_handler_t *handler = &g_handlers[g_handler_slots[slot] - 1];
+        if (handler->hash == hash && strcmp(handler->tag, tag) == 0) return handler;
+    }
+    return NULL;
+}
 
-        cJSON_AddNumberToObject(color, "red", led_config.colors.red);
-        cJSON_AddNumberToObject(color, "green", led_config.colors.green);
-        cJSON_AddNumberToObject(color, "blue", led_config.colors.blue);
+static void mqtt_app_stats_add(mqtt_app_handler_stats_t *stats, int64_t us) {
+    portENTER_CRITICAL(&g_stats_lock);
+    stats->calls++;
+    stats->total_us += us;
+    if (us > stats->max_us) stats->max_us = us;
+    portEXIT_CRITICAL(&g_stats_lock);
+}
 
-        cJSON_AddItemToObject(json, "color", color);
+// --------- OUTBOX --------- //
 
-        char *json_str = cJSON_Print(json);
-        if (json_str == NULL) {
-            ESP_LOGE(TAG, "Failed to print JSON object!");
-            cJSON_Delete(json);  // Clean up the main object
-            vTaskDelay(1000 / portTICK_PERIOD_MS);
-            continue;
+/**
+ * Drops a queued message, the others keep their order
+ * @param pos position in the queue, 0 is the oldest message
+ */
+static void mqtt_app_outbox_drop(int pos) {
+    ESP_LOGW(TAG, "Outbox full, dropping message %s", g_outbox.entries[(g_outbox.head + pos) % MQTT_APP_OUTBOX_SLOTS].key);
+    for (int i = pos; i > 0; i--)
+        g_outbox.entries[(g_outbox.head + i) % MQTT_APP_OUTBOX_SLOTS] = g_outbox.entries[(g_outbox.head + i - 1) % MQTT_APP_OUTBOX_SLOTS];
+    g_outbox.head = (g_outbox.head + 1) % MQTT_APP_OUTBOX_SLOTS;
+    portENTER_CRITICAL(&g_stats_lock);
+    g_outbox.count--;
+    g_outbox.stats.dropped++;
+    portEXIT_CRITICAL(&g_stats_lock);
+}
+
+/**
+ * Queues a message under a key. A message which is still queued under the same key is replaced.
+ * Retained messages are the status, acknowledgements are not retained. A new acknowledgement drops the oldest one
+ * once MQTT_APP_OUTBOX_ACK_SLOTS are taken, so the status never competes with them for a slot.
+ */
+static void mqtt_app_outbox_put(const char *key, const char *topic, const void *msg, size_t len, bool retain) {
+    if (len > MQTT_APP_OUTBOX_MSG_SIZE) {
+        ESP_LOGE(TAG, "Message for key %s is too large for the outbox (%d bytes)", key, (int)len);
+        return;
+    }
+
+    mqtt_app_outbox_entry_t *entry = NULL;
+    for (int i = 0; i < g_outbox.count && entry == NULL; i++) {
+        mqtt_app_outbox_entry_t *queued = &g_outbox.entries[(g_outbox.head + i) % MQTT_APP_OUTBOX_SLOTS];
+        if (strcmp(queued->key, key) == 0) entry = queued;
+    }
+
+    if (entry != NULL) {
+        portENTER_CRITICAL(&g_stats_lock);
+        g_outbox.stats.replaced++;
+        portEXIT_CRITICAL(&g_stats_lock);
+    } else {
+        // A burst of acknowledgements must not evict the retained state, a new subscriber would never get it
+        int oldest_ack = -1;
+        int acks = 0;
+        for (int i = 0; i < g_outbox.count; i++) {
+            if (g_outbox.entries[(g_outbox.head + i) % MQTT_APP_OUTBOX_SLOTS].retain) continue;
+            if (oldest_ack < 0) oldest_ack = i;
+            acks++;
         }
-        int result;
-        if ((result = esp_mqtt_client_publish(mqtt_handle, MQTT_APP_PUBLISH_TOPIC, json_str, strlen(json_str), MQTT_APP_QOS, false)) < 0) {
-            ESP_LOGE(TAG, "Failed to publish message to MQTT broker! Error code: %d", result);
-            vTaskDelay(1000 / portTICK_PERIOD_MS);
-            return;
+        if (!retain && acks >= MQTT_APP_OUTBOX_ACK_SLOTS) mqtt_app_outbox_drop(oldest_ack);
+        else if (g_outbox.count == MQTT_APP_OUTBOX_SLOTS) mqtt_app_outbox_drop(oldest_ack >= 0 ? oldest_ack : 0);
+        entry = &g_outbox.entries[(g_outbox.head + g_outbox.count) % MQTT_APP_OUTBOX_SLOTS];
+        strlcpy(entry->key, key, sizeof(entry->key));
+        portENTER_CRITICAL(&g_stats_lock);
+        g_outbox.count++;
+        g_outbox.stats.queued++;
+        portEXIT_CRITICAL(&g_stats_lock);
+    }
+    entry->topic = topic;
+    memcpy(entry->msg, msg, len);
+    entry->len = len;
+    entry->retain = retain;
+}
+
+/**
+ * Publishes up to MQTT_APP_OUTBOX_DRAIN_BURST messages in queue order
+ * @return false if a publish failed, the message stays queued
+ */
+static bool mqtt_app_outbox_drain(void) {
+    for (int sent = 0; sent < MQTT_APP_OUTBOX_DRAIN_BURST && g_outbox.count > 0; sent++) {
+        const mqtt_app_outbox_entry_t *entry = &g_outbox.entries[g_outbox.head];
+        const int result = esp_mqtt_client_publish(mqtt_handle, entry->topic, entry->msg, entry->len, MQTT_APP_QOS, entry->retain);
+        if (result < 0) {
+            ESP_LOGE(TAG, "Failed to publish message %s to MQTT broker! Error code: %d", entry->key, result);
+            return false;
         }
+        g_outbox.head = (g_outbox.head + 1) % MQTT_APP_OUTBOX_SLOTS;
+        portENTER_CRITICAL(&g_stats_lock);
+        g_outbox.count--;
+        g_outbox.stats.sent++;
+        portEXIT_CRITICAL(&g_stats_lock);
+    }
+    return true;
+}
 
-        cJSON_free(json_str);
-        cJSON_Delete(json);
+// --------- PUBLISHING --------- //
 
-        vTaskDelay(1000 / portTICK_PERIOD_MS);
+/**
+ * Queues the acknowledgements of completed traced commands, keyed by their correlation ID
+ */
+static void mqtt_app_queue_acks(void) {
+    latency_trace_ack_t ack;
+    char key[MQTT_APP_OUTBOX_KEY_LEN];
+    char msg[MQTT_APP_OUTBOX_MSG_SIZE];
+    while (latency_trace_pop_ack(&ack)) {
+        const int len = snprintf(
+            msg,
+            sizeof(msg),
+            "{\"tag\": \"%s\", \"cid\": \"%s\", \"merged\": %s, \"latency_us\": {\"%s\": %lu, \"%s\": %lu, \"%s\": %lu, \"%s\": %lu}}",
+            MQTT_APP_TAG_LED_STRIP_ACK, ack.cid, ack.merged ? "true" : "false",
+            latency_trace_stage_name(LATENCY_TRACE_STAGE_PARSE), ack.stage_us[LATENCY_TRACE_STAGE_PARSE],
+            latency_trace_stage_name(LATENCY_TRACE_STAGE_QUEUE), ack.stage_us[LATENCY_TRACE_STAGE_QUEUE],
+            latency_trace_stage_name(LATENCY_TRACE_STAGE_RENDER), ack.stage_us[LATENCY_TRACE_STAGE_RENDER],
+            latency_trace_stage_name(LATENCY_TRACE_STAGE_TOTAL), ack.stage_us[LATENCY_TRACE_STAGE_TOTAL]
+        );
+        snprintf(key, sizeof(key), "ack:%s", ack.cid);
+        mqtt_app_outbox_put(key, MQTT_APP_PUBLISH_TOPIC, msg, MIN(len, sizeof(msg) - 1), false);
     }
 }
 
 /**
- * Handle recieved data from the broker
- * @param event event handle which contains the published data received from the broker
+ * Publishes the per-stage command latency histograms. They are recomputed on every publish, so
+ * they are sent directly instead of being queued.
+ * @return true if the message was handed to the MQTT client
  */
-static void mqtt_app_handle_recv_data(esp_mqtt_event_handle_t event) {
-    char buffer[MQTT_APP_BROKER_MAX_MSG_SIZE];
-    snprintf(buffer, MQTT_APP_BROKER_MAX_MSG_SIZE, event->data, event->data_len);
-    if (event->data_len >= MQTT_APP_BROKER_MAX_MSG_SIZE) {
-        ESP_LOGE(TAG, "Buffer overflow! MQTT message could not be stored!");
-        return;
+static bool mqtt_app_publish_latency(void) {
+    static char msg[1024];
+    const int offset = snprintf(msg, sizeof(msg), "{\"tag\": \"%s\", \"stages\": ", MQTT_APP_TAG_LED_STRIP_LATENCY);
+    const int len = latency_trace_format_json(msg + offset, sizeof(msg) - offset - 1);
+    strcpy(msg + offset + len, "}");
+    const int result = esp_mqtt_client_publish(mqtt_handle, MQTT_APP_PUBLISH_TOPIC, msg, strlen(msg), MQTT_APP_QOS, false);
+    if (result < 0) ESP_LOGE(TAG, "Failed to publish latency histograms! Error code: %d", result);
+    return result >= 0;
+}
+
+/**
+ * Queues the LED state as a retained message so new subscribers get it right away.
+ * With MQTT_APP_PUBLISH_MSGPACK it is also queued as MessagePack on its own topic, and the broker retains both.
+ */
+static void mqtt_app_queue_state(const rmt_app_active_config_t *led_config) {
+    char msg[LED_STATUS_LEN + 1];
+    const led_status_t status = {
+        .state = led_config->state,
+        .mode = led_config->mode,
+        .red = led_config->colors.red,
+        .green = led_config->colors.green,
+        .blue = led_config->colors.blue,
+    };
+    int64_t start_us = esp_timer_get_time();
+    const size_t len = led_status_format(msg, &status);
+    mqtt_app_codec_count(&g_codec_stats[MQTT_APP_FORMAT_JSON].encoded, len, esp_timer_get_time() - start_us);
+    mqtt_app_outbox_put(MQTT_APP_OUTBOX_KEY_STATE, MQTT_APP_PUBLISH_TOPIC, msg, len, true);
+
+#if MQTT_APP_PUBLISH_MSGPACK
+    uint8_t packed[MSGPACK_CMD_STATUS_MAX_LEN];
+    start_us = esp_timer_get_time();
+    const size_t packed_len = msgpack_cmd_format_status(packed, &status);
+    mqtt_app_codec_count(&g_codec_stats[MQTT_APP_FORMAT_MSGPACK].encoded, packed_len, esp_timer_get_time() - start_us);
+    mqtt_app_outbox_put(MQTT_APP_OUTBOX_KEY_STATE_MSGPACK, MQTT_APP_PUBLISH_TOPIC_MSGPACK, packed, packed_len, true);
+#endif
+
+}
+
+/**
+ * Gets the ticks left until the period which started at "since" elapses
+ */
+static TickType_t mqtt_app_ticks_left(TickType_t now, TickType_t since, TickType_t period) {
+    const TickType_t elapsed = now - since;
+    return elapsed >= period ? 0 : period - elapsed;
+}
+
+/**
+ * Queues state changes and acknowledgements, and drains the outbox at a bounded rate while connected.
+ * Sleeps while nothing changes.
+ */
+static void mqtt_app_publish_task(void *pvParams) {
+    ESP_LOGI(TAG, "Start publishing LED state changes to MQTT broker");
+    latency_trace_set_ack_listener(xTaskGetCurrentTaskHandle());
+    rmt_app_set_state_listener(xTaskGetCurrentTaskHandle());
+
+    const TickType_t heartbeat = pdMS_TO_TICKS(MQTT_APP_STATE_HEARTBEAT_MS);
+    const TickType_t latency_period = pdMS_TO_TICKS(MQTT_APP_LATENCY_PUBLISH_MS);
+    const TickType_t state_hold = pdMS_TO_TICKS(MQTT_APP_STATE_MIN_INTERVAL_MS);
+    uint32_t queued_version = 0;
+    bool queued = false;
+    TickType_t last_state_queue = xTaskGetTickCount();
+    uint32_t published_traces = 0;
+    TickType_t last_latency_publish = xTaskGetTickCount();
+    TickType_t last_drain = xTaskGetTickCount();
+    TickType_t drain_hold = 0;  // Drain interval after a burst, or retry delay after a failure
+    TickType_t wait = 0;
+    while (1) {
+        // State changes, acknowledgements and (re)connects wake the task up
+        ulTaskNotifyTake(pdTRUE, wait);
+        mqtt_app_queue_acks();
+        const TickType_t now = xTaskGetTickCount();
+        const bool connected = atomic_load(&g_connected);
+
+        // Histograms only change when commands were traced
+        const uint32_t traces = latency_trace_get_count();
+        if (connected && traces != published_traces && mqtt_app_ticks_left(now, last_latency_publish, latency_period) == 0) {
+            if (mqtt_app_publish_latency()) published_traces = traces;
+            last_latency_publish = now;
+        }
+
+        // Changes arriving within the hold are coalesced into one message
+        const rmt_app_active_config_t led_config = rmt_app_get_active_config();
+        if (atomic_exchange(&g_state_resync, false)) queued = false;
+        const bool pending = !queued || led_config.version != queued_version;
+        const bool heartbeat_due = MQTT_APP_STATE_HEARTBEAT_MS > 0 && mqtt_app_ticks_left(now, last_state_queue, heartbeat) == 0;
+        const bool state_due = (pending || (connected && heartbeat_due)) && mqtt_app_ticks_left(now, last_state_queue, state_hold) == 0;
+        if (state_due) {
+            mqtt_app_queue_state(&led_config);
+            queued = true;
+            queued_version = led_config.version;
+            last_state_queue = now;
+        }
+
+        // Nothing is handed to the MQTT client while offline, it would buffer QoS 1 messages without a bound
+        if (connected && g_outbox.count > 0 && mqtt_app_ticks_left(now, last_drain, drain_hold) == 0) {
+            const bool ok = mqtt_app_outbox_drain();
+            drain_hold = pdMS_TO_TICKS(ok ? MQTT_APP_OUTBOX_DRAIN_INTERVAL_MS : MQTT_APP_PUBLISH_RETRY_MS);
+            last_drain = now;
+        }
+
+        // Sleep until the next deadline, notifications cut it short
+        wait = MQTT_APP_STATE_HEARTBEAT_MS > 0 && connected ? mqtt_app_ticks_left(now, last_state_queue, heartbeat) : portMAX_DELAY;
+        if (!state_due && pending) wait = MIN(wait, mqtt_app_ticks_left(now, last_state_queue, state_hold));
+        if (connected && g_outbox.count > 0) wait = MIN(wait, mqtt_app_ticks_left(now, last_drain, drain_hold));
+        if (connected && traces != published_traces) wait = MIN(wait, mqtt_app_ticks_left(now, last_latency_publish, latency_period));
     }
-    buffer[event->data_len] = '\0';
-    cJSON *json = cJSON_Parse(buffer);
-    if (json == NULL) {
-        ESP_LOGE(TAG, "Failed to parse JSON MQTT message!");
+}
+
+/**
+ * Decodes a complete command and hands it over to the RMT Application
+ * @param data JSON text or MessagePack payload, doesn't need to be NUL terminated
+ * @param len length of the payload
+ * @param format encoding of the payload
+ * @param trace latency trace started when the first fragment was received
+ */
+static void mqtt_app_handle_command(const char *data, size_t len, mqtt_app_format_e format, latency_trace_t *trace) {
+    // Decoded in place, the payload is neither copied nor NUL terminated
+    json_cmd_t cmd;
+    size_t err_offset;
+    const int64_t decode_start_us = esp_timer_get_time();
+    const json_cmd_err_e err = format == MQTT_APP_FORMAT_MSGPACK
+        ? msgpack_cmd_parse((const uint8_t*)data, len, &cmd, &err_offset)
+        : json_cmd_parse(data, len, &cmd, &err_offset);
+    mqtt_app_codec_count(&g_codec_stats[format].decoded, len, esp_timer_get_time() - decode_start_us);
+    if (err != JSON_CMD_OK) {
+        ESP_LOGE(TAG, "Failed to parse %s MQTT message: %s at offset %d!", mqtt_app_format_name(format), json_cmd_err_name(err), (int)err_offset);
         return;
     }
-    cJSON *tag = cJSON_GetObjectItemCaseSensitive(json, "tag");
-    if (tag == NULL || tag->valuestring == NULL) {
+    if (!(cmd.fields & JSON_CMD_FIELD_TAG)) {
         ESP_LOGE(TAG, "Tag field missing from JSON!");
         return;
     }
 
+    // Optional correlation ID which is echoed back in the acknowledgement
+    if ((cmd.fields & JSON_CMD_FIELD_CID) && latency_trace_cid_is_valid(cmd.cid))
+        strlcpy(trace->cid, cmd.cid, sizeof(trace->cid));
+
     // Run specific task depending on the provided tag
-    if (strcmp(tag->valuestring, MQTT_APP_TAG_LED_STRIP) == 0) {
-        rmt_app_set_from_json(json);
+    mqtt_app_handler_t *handler = mqtt_app_find_handler(cmd.tag);
+    if (handler == NULL) {
+        ESP_LOGW(TAG, "No handler registered for tag \"%s\"", cmd.tag);
+        return;
+    }
+    const int64_t start_us = esp_timer_get_time();
+    handler->handle(&cmd, trace);
+    mqtt_app_stats_add(&handler->stats, esp_timer_get_time() - start_us);
+}
+
+/**
+ * Decodes a JSON pixel array "[r, g, b, ...]" into the RMT back buffer without building a cJSON tree
+ * @param data JSON text, doesn't need to be NUL terminated
+ * @param len length of the text
+ * @param trace latency trace started when the first fragment was received
+ */
+static void mqtt_app_handle_json_pixels(const char *data, size_t len, latency_trace_t *trace) {
+    uint8_t rgb[RMT_APP_LED_NUMBERS * 3];
+    size_t count;
+    const int64_t decode_start_us = esp_timer_get_time();
+    const bool ok = cJSON_ParseUInt8Array(data, len, rgb, sizeof(rgb), &count);
+    mqtt_app_codec_count(&g_pixels_json_decoded, len, esp_timer_get_time() - decode_start_us);
+    if (!ok) {
+        // Also rejects frames with more values than the strip has channels, like the raw pixels topic
+        ESP_LOGE(TAG, "Invalid JSON pixel frame at offset %d!", (int)(cJSON_GetErrorPtr() - data));
+        return;
+    }
+    rmt_app_pixels_write(0, rgb, count);
+    rmt_app_pixels_commit(trace);
+}
+
+/**
+ * Handles a message which was reassembled in full
+ */
+static void mqtt_app_handle_complete(const char *data, size_t len) {
+    if (g_rx.kind == MQTT_APP_RX_COMMAND) mqtt_app_handle_command(data, len, g_rx.route->format, &g_rx.trace);
+    else if (g_rx.kind == MQTT_APP_RX_PIXELS_JSON) mqtt_app_handle_json_pixels(data, len, &g_rx.trace);
+}
+
+/**
+ * Routes a topic below MQTT_APP_TOPIC_BASE
+ * @return route or NULL if the topic is unknown
+ */
+static mqtt_app_route_t *mqtt_app_find_route(const esp_mqtt_event_handle_t event) {
+    const size_t base_len = strlen(MQTT_APP_TOPIC_BASE);
+    if (event->topic_len < base_len || memcmp(event->topic, MQTT_APP_TOPIC_BASE, base_len) != 0) return NULL;
+
+    const char *suffix = event->topic + base_len;
+    const size_t suffix_len = event->topic_len - base_len;
+    for (int i = 0; i < sizeof(g_routes) / sizeof(g_routes[0]); i++) {
+        if (strlen(g_routes[i].suffix) == suffix_len && memcmp(g_routes[i].suffix, suffix, suffix_len) == 0) return &g_routes[i];
     }
+    return NULL;
+}
+
+/**
+ * Handle recieved data from the broker. Messages larger than the client buffer arrive in several events,
+ * only the first one carries the topic.
+ * @param event event handle which contains the published data received from the broker
+ */
+static void mqtt_app_handle_recv_data(esp_mqtt_event_handle_t event) {
+    const int64_t start_us = esp_timer_get_time();
+    if (event->current_data_offset == 0) {
+        if (g_rx.kind != MQTT_APP_RX_NONE) ESP_LOGW(TAG, "Incomplete MQTT message of %d bytes dropped", g_rx.total_len);
+        latency_trace_begin(&g_rx.trace, NULL);
+        g_rx.total_len = event->total_data_len;
+        g_rx.received = 0;
+        g_rx.busy_us = 0;
 
-    free(json);
-    free(tag);
+        g_rx.route = mqtt_app_find_route(event);
+        g_rx.kind = g_rx.route != NULL ? g_rx.route->kind : MQTT_APP_RX_DISCARD;
+        if (g_rx.route == NULL) ESP_LOGW(TAG, "Message on unknown topic %.*s dropped", event->topic_len, event->topic);
+
+        // Single fragment messages are decoded straight from the client buffer
+        const bool reassembled = g_rx.kind == MQTT_APP_RX_COMMAND || g_rx.kind == MQTT_APP_RX_PIXELS_JSON;
+        if (reassembled && event->data_len == event->total_data_len) {
+            mqtt_app_handle_complete(event->data, event->data_len);
+            g_rx.kind = MQTT_APP_RX_NONE;
+            mqtt_app_stats_add(&g_rx.route->stats, esp_timer_get_time() - start_us);
+            return;
+        }
+        if (reassembled && event->total_data_len > sizeof(g_rx_buffer)) {
+            ESP_LOGE(TAG, "MQTT message of %d bytes exceeds the %d byte reassembly buffer!", event->total_data_len, (int)sizeof(g_rx_buffer));
+            g_rx.kind = MQTT_APP_RX_DISCARD;
+        }
+        if (g_rx.kind == MQTT_APP_RX_PIXELS && event->total_data_len > RMT_APP_LED_NUMBERS * 3) {
+            ESP_LOGE(TAG, "Pixel frame of %d bytes is longer than the strip, dropped!", event->total_data_len);
+            g_rx.kind = MQTT_APP_RX_DISCARD;
+        }
+    } else if (g_rx.kind == MQTT_APP_RX_NONE || event->current_data_offset != g_rx.received) {
+        // A fragment of a message whose start was missed
+        ESP_LOGE(TAG, "Unexpected MQTT fragment at offset %d dropped", event->current_data_offset);
+        g_rx.kind = MQTT_APP_RX_NONE;
+        return;
+    }
+
+    // Every fragment goes straight to its destination
+    switch (g_rx.kind) {
+        case MQTT_APP_RX_COMMAND:
+        case MQTT_APP_RX_PIXELS_JSON:
+            memcpy(g_rx_buffer + event->current_data_offset, event->data, event->data_len);
+            break;
+        case MQTT_APP_RX_PIXELS:
+            rmt_app_pixels_write(event->current_data_offset, (const uint8_t*)event->data, event->data_len);
+            break;
+        default:
+            break;
+    }
+    g_rx.received += event->data_len;
+    if (g_rx.received < g_rx.total_len) {
+        g_rx.busy_us += esp_timer_get_time() - start_us;
+        return;
+    }
+
+    if (g_rx.kind == MQTT_APP_RX_PIXELS) rmt_app_pixels_commit(&g_rx.trace);
+    else mqtt_app_handle_complete(g_rx_buffer, g_rx.total_len);
+    if (g_rx.route != NULL) mqtt_app_stats_add(&g_rx.route->stats, g_rx.busy_us + esp_timer_get_time() - start_us);
+    g_rx.kind = MQTT_APP_RX_NONE;
 }
 
 /**
@@ -109,6 +555,11 @@ static void mqtt_app_event_handler(void *args, esp_event_base_t event_base, int3
             break;
         case MQTT_EVENT_CONNECTED:
             ESP_LOGI(TAG, "MQTT_EVENT_CONNECTED");
+            boot_stats_mark(BOOT_STATS_PHASE_MQTT_UP);
+            // Republish the state, the broker may have lost the retained message
+            atomic_store(&g_connected, true);
+            atomic_store(&g_state_resync, true);
+            if (g_publish_task_handle != NULL) xTaskNotifyGive(g_publish_task_handle);
             // Subscribe to topic
             signed int subscribe_flag;
             if ((subscribe_flag = esp_mqtt_client_subscribe_single(mqtt_handle, MQTT_APP_SUBSCRIBE_TOPIC, MQTT_APP_QOS)) < 0) {
@@ -119,6 +570,7 @@ static void mqtt_app_event_handler(void *args, esp_event_base_t event_base, int3
             break;
         case MQTT_EVENT_DISCONNECTED:
             ESP_LOGI(TAG, "MQTT_EVENT_DISCONNECTED");
+            atomic_store(&g_connected, false);
             break;
         case MQTT_EVENT_SUBSCRIBED:
             ESP_LOGI(TAG, "MQTT_EVENT_SUBSCRIBED");
@@ -140,6 +592,7 @@ static void mqtt_app_event_handler(void *args, esp_event_base_t event_base, int3
 
 void mqtt_app_init(void) {
     ESP_LOGI(TAG, "Configuring MQTT Application...");
+    mqtt_app_build_handler_index();
 
     // Configure and initialize the MQTT's handle
     const esp_mqtt_client_config_t mqtt_config = {
@@ -187,9 +640,67 @@ void mqtt_app_init(void) {
         MQTT_APP_TASK_STACK_SIZE,
         NULL,
         MQTT_APP_TASK_PRIORITY,
-        NULL,
+        &g_publish_task_handle,
         MQTT_APP_TASK_CORE_ID
     );
 
     ESP_LOGI(TAG, "MQTT Application successfully initialized!");
 }
+
+int mqtt_app_format_handler_stats(char *buffer, size_t size) {
+    // One consistent snapshot, the 64-bit counters would tear when read while a task updates them
+    mqtt_app_handler_stats_t route_stats[sizeof(g_routes) / sizeof(g_routes[0])];
+    mqtt_app_handler_stats_t handler_stats[sizeof(g_handlers) / sizeof(g_handlers[0])];
+    mqtt_app_codec_stats_t codec_stats[MQTT_APP_FORMATS_COUNT];
+    portENTER_CRITICAL(&g_stats_lock);
+    for (int i = 0; i < sizeof(g_routes) / sizeof(g_routes[0]); i++) route_stats[i] = g_routes[i].stats;
+    for (int i = 0; i < sizeof(g_handlers) / sizeof(g_handlers[0]); i++) handler_stats[i] = g_handlers[i].stats;
+    memcpy(codec_stats, g_codec_stats, sizeof(codec_stats));
+    const mqtt_app_codec_counter_t pixels_json = g_pixels_json_decoded;
+    portEXIT_CRITICAL(&g_stats_lock);
+
+    size_t offset = snprintf(buffer, size, "{\"topics\": {");
+    for (int i = 0; i < sizeof(g_routes) / sizeof(g_routes[0]) && offset < size; i++) {
+        const mqtt_app_handler_stats_t stats = route_stats[i];
+        offset += snprintf(buffer + offset, size - offset, "\"%s%s\": {\"calls\": %lu, \"total_us\": %llu, \"max_us\": %lu}%s",
+            MQTT_APP_TOPIC_BASE, g_routes[i].suffix, stats.calls, stats.total_us, stats.max_us,
+            i < sizeof(g_routes) / sizeof(g_routes[0]) - 1 ? ", " : "");
+    }
+    if (offset < size) offset += snprintf(buffer + offset, size - offset, "}, \"tags\": {");
+    for (int i = 0; i < sizeof(g_handlers) / sizeof(g_handlers[0]) && offset < size; i++) {
+        const mqtt_app_handler_stats_t stats = handler_stats[i];
+        offset += snprintf(buffer + offset, size - offset, "\"%s\": {\"calls\": %lu, \"total_us\": %llu, \"max_us\": %lu}%s",
+            g_handlers[i].tag, stats.calls, stats.total_us, stats.max_us,
+            i < sizeof(g_handlers) / sizeof(g_handlers[0]) - 1 ? ", " : "");
+    }
+    if (offset < size) offset += snprintf(buffer + offset, size - offset, "}, \"formats\": {");
+    for (int i = 0; i < MQTT_APP_FORMATS_COUNT && offset < size; i++) {
+        const mqtt_app_codec_stats_t stats = codec_stats[i];
+        offset += snprintf(buffer + offset, size - offset,
+            "\"%s\": {\"decoded\": %lu, \"decoded_bytes\": %llu, \"decode_us\": %llu, "
+            "\"encoded\": %lu, \"encoded_bytes\": %llu, \"encode_us\": %llu}%s",
+            mqtt_app_format_name(i), stats.decoded.messages, stats.decoded.bytes, stats.decoded.total_us,
+            stats.encoded.messages, stats.encoded.bytes, stats.encoded.total_us,
+            i < MQTT_APP_FORMATS_COUNT - 1 ? ", " : "");
+    }
+    if (offset < size) offset += snprintf(buffer + offset, size - offset,
+        "}, \"pixels_json\": {\"decoded\": %lu, \"decoded_bytes\": %llu, \"decode_us\": %llu}}",
+        pixels_json.messages, pixels_json.bytes, pixels_json.total_us);
+    return offset < size ? (int)offset : (int)size - 1;
+}
+
+mqtt_app_outbox_stats_t mqtt_app_get_outbox_stats(void) {
+    portENTER_CRITICAL(&g_stats_lock);
+    mqtt_app_outbox_stats_t stats = g_outbox.stats;
+    stats.pending = g_outbox.count;
+    portEXIT_CRITICAL(&g_stats_lock);
+    return stats;
+}
+
+const char *mqtt_app_format_name(mqtt_app_format_e format) {
+    switch (format) {
+        case MQTT_APP_FORMAT_JSON: return "json";
+        case MQTT_APP_FORMAT_MSGPACK: return "msgpack";
+        default: return "unknown";
+    }
+}
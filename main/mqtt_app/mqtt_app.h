@@ -5,12 +5,26 @@
 #ifndef MQTT_APP_H
 #define MQTT_APP_H
 
+#include <stdint.h>
+#include <stddef.h>
+
+#include "led_status/led_status.h"
+
 #define MQTT_APP_BROKER_HOST           "mqtt-broker.lan"
 #define MQTT_APP_BROKER_PORT           1883
-#define MQTT_APP_BROKER_MAX_MSG_SIZE   1024
+#define MQTT_APP_RX_BUFFER_SIZE        4096    // Largest fragmented command or JSON pixel frame which can be reassembled
 
-#define MQTT_APP_SUBSCRIBE_TOPIC       "home/controllers/led/receive"
+#define MQTT_APP_TOPIC_BASE            "home/controllers/led/receive"
+#define MQTT_APP_SUBSCRIBE_TOPIC       MQTT_APP_TOPIC_BASE "/#"   // Also matches the base topic itself
+#define MQTT_APP_TOPIC_PIXELS          "/pixels"                  // Raw RGB frames, frames longer than the strip are dropped
+#define MQTT_APP_TOPIC_PIXELS_JSON     "/pixels/json"             // Pixel frames as a JSON array [r, g, b, ...], at most MQTT_APP_RX_BUFFER_SIZE bytes
+#define MQTT_APP_TOPIC_MSGPACK         "/msgpack"                 // MessagePack encoded commands
 #define MQTT_APP_PUBLISH_TOPIC         "home/controllers/led/send"
+#define MQTT_APP_PUBLISH_TOPIC_MSGPACK MQTT_APP_PUBLISH_TOPIC "/msgpack"
+// Also publish the status as MessagePack. Every state change then queues two retained messages, the JSON one on
+// MQTT_APP_PUBLISH_TOPIC and the MessagePack one on MQTT_APP_PUBLISH_TOPIC_MSGPACK, taking two outbox slots while
+// offline. Set to 0 when no subscriber reads MessagePack.
+#define MQTT_APP_PUBLISH_MSGPACK       1
 #define MQTT_APP_LAST_WILL_MSG         "{\"tag\": \"led_strip_diconnect\"}"
 #define MQTT_APP_QOS                   1
 
@@ -18,11 +32,95 @@
 #define MQTT_APP_USERNAME              "led-strip-client"
 #define MQTT_APP_PASSWORD              "NQXkhiDZtd7rZGWQNmV9"
 
-#define MQTT_APP_TAG_LED_STRIP         "led_strip"
+#define MQTT_APP_TAG_LED_STRIP         LED_STATUS_TAG
+#define MQTT_APP_TAG_LED_STRIP_ACK     "led_strip_ack"
+#define MQTT_APP_TAG_LED_STRIP_LATENCY "led_strip_latency"
+
+#define MQTT_APP_STATE_MIN_INTERVAL_MS 100     // Drag events within this window are coalesced
+#define MQTT_APP_PUBLISH_RETRY_MS      1000
+#define MQTT_APP_STATE_HEARTBEAT_MS    60000   // 0 disables the heartbeat
+#define MQTT_APP_LATENCY_PUBLISH_MS    10000
+
+// Outbox budget: one retained status per format, replaced in place, plus the command acknowledgements. Once the
+// acknowledgements use all of their slots the oldest one is dropped, so the status always has room. The latency
+// histograms are published directly and take no slot.
+#define MQTT_APP_OUTBOX_STATE_SLOTS    2       // MQTT_APP_OUTBOX_KEY_STATE and MQTT_APP_OUTBOX_KEY_STATE_MSGPACK
+#define MQTT_APP_OUTBOX_ACK_SLOTS      6
+#define MQTT_APP_OUTBOX_SLOTS          (MQTT_APP_OUTBOX_STATE_SLOTS + MQTT_APP_OUTBOX_ACK_SLOTS)
+#define MQTT_APP_OUTBOX_MSG_SIZE       256
+#define MQTT_APP_OUTBOX_KEY_LEN        32
+#define MQTT_APP_OUTBOX_KEY_STATE      "state"
+#define MQTT_APP_OUTBOX_KEY_STATE_MSGPACK "state.msgpack"
+#define MQTT_APP_OUTBOX_DRAIN_BURST    4       // Messages per drain round after a reconnect
+#define MQTT_APP_OUTBOX_DRAIN_INTERVAL_MS 50
+
+#define MQTT_APP_HANDLER_SLOTS         16      // Power of two, larger than the number of handlers
+
+/**
+ * Per topic / per tag dispatch counters
+ */
+typedef struct {
+    uint32_t calls;
+    uint64_t total_us;
+    uint32_t max_us;
+} mqtt_app_handler_stats_t;
+
+/**
+ * Payload encodings, selected per topic
+ */
+typedef enum {
+    MQTT_APP_FORMAT_JSON,
+    MQTT_APP_FORMAT_MSGPACK,
+    MQTT_APP_FORMATS_COUNT
+} mqtt_app_format_e;
+
+typedef struct {
+    uint32_t messages;
+    uint64_t bytes;
+    uint64_t total_us;
+} mqtt_app_codec_counter_t;
+
+/**
+ * Payload sizes and coding times of one format
+ */
+typedef struct {
+    mqtt_app_codec_counter_t decoded;   // Received commands
+    mqtt_app_codec_counter_t encoded;   // Published status messages
+} mqtt_app_codec_stats_t;
+
+/**
+ * Offline outbox counters
+ */
+typedef struct {
+    uint32_t queued;
+    uint32_t replaced;   // Messages superseded by a newer one with the same key
+    uint32_t dropped;    // Messages lost because the outbox was full
+    uint32_t sent;
+    uint32_t pending;
+} mqtt_app_outbox_stats_t;
 
 /**
 * Start the MQTT Communication Application
 */
 void mqtt_app_init(void);
 
+/**
+ * Writes the dispatch counters of every topic route and tag handler, and the coding counters of
+ * every format as a JSON object. The counters are copied in one snapshot, any task can call it.
+ * @param buffer output buffer
+ * @param size size of the buffer
+ * @return number of characters written
+ */
+int mqtt_app_format_handler_stats(char *buffer, size_t size);
+
+/**
+ * Gets the name of a payload format
+ */
+const char *mqtt_app_format_name(mqtt_app_format_e format);
+
+/**
+ * Gets a consistent snapshot of the offline outbox counters, any task can call it
+ */
+mqtt_app_outbox_stats_t mqtt_app_get_outbox_stats(void);
+
 #endif //MQTT_APP_H
@@ -0,0 +1,432 @@
+//
+// Created by kok on 19.10.26.
+//
+
+#include <stddef.h>
+#include <string.h>
+
+#include "msgpack_cmd.h"
+
+/**
+ * Cursor over the input payload
+ */
+typedef struct {
+    const uint8_t *data;
+    size_t len;
+    size_t pos;
+    json_cmd_err_e err;
+} msgpack_cmd_reader_t;
+
+/**
+ * Value families which the command decoder distinguishes
+ */
+typedef enum {
+    MSGPACK_CMD_INT,      // "value" holds the integer
+    MSGPACK_CMD_STR,      // "size" bytes of text follow
+    MSGPACK_CMD_MAP,      // "size" key / value pairs follow
+    MSGPACK_CMD_ARRAY,    // "size" values follow
+    MSGPACK_CMD_OTHER,    // nil, booleans, floats, bin, ext and unsigned integers above INT64_MAX, "size" bytes follow
+} msgpack_cmd_type_e;
+
+typedef struct {
+    msgpack_cmd_type_e type;
+    uint64_t size;
+    int64_t value;
+} msgpack_cmd_head_t;
+
+/**
+ * Key of a known field, compared against the raw key bytes
+ */
+typedef struct {
+    const char *name;
+    size_t len;
+} msgpack_cmd_key_t;
+
+#define MSGPACK_CMD_KEY(name) {name, sizeof(name) - 1}
+
+// --------- READER --------- //
+
+static bool msgpack_cmd_fail(msgpack_cmd_reader_t *r, json_cmd_err_e err) {
+    r->err = err;
+    return false;
+}
+
+/**
+ * Reads a big endian unsigned integer of n bytes
+ */
+static bool msgpack_cmd_read_be(msgpack_cmd_reader_t *r, size_t n, uint64_t *out) {
+    if (r->len - r->pos < n) return msgpack_cmd_fail(r, JSON_CMD_ERR_SYNTAX);
+    uint64_t value = 0;
+    for (size_t i = 0; i < n; i++) value = value << 8 | r->data[r->pos++];
+    *out = value;
+    return true;
+}
+
+/**
+ * Reads the type byte and the length or value which follows it
+ */
+static bool msgpack_cmd_read_head(msgpack_cmd_reader_t *r, msgpack_cmd_head_t *head) {
+    if (r->pos >= r->len) return msgpack_cmd_fail(r, JSON_CMD_ERR_SYNTAX);
+    const uint8_t b = r->data[r->pos++];
+    uint64_t raw;
+    head->size = 0;
+
+    if (b <= 0x7f) { head->type = MSGPACK_CMD_INT; head->value = b; return true; }
+    if (b >= 0xe0) { head->type = MSGPACK_CMD_INT; head->value = (int8_t)b; return true; }
+    if (b <= 0x8f) { head->type = MSGPACK_CMD_MAP; head->size = b & 0x0f; return true; }
+    if (b <= 0x9f) { head->type = MSGPACK_CMD_ARRAY; head->size = b & 0x0f; return true; }
+    if (b <= 0xbf) { head->type = MSGPACK_CMD_STR; head->size = b & 0x1f; return true; }
+
+    head->type = MSGPACK_CMD_OTHER;
+    switch (b) {
+        case 0xc0: case 0xc2: case 0xc3:                                              // nil, false, true
+            return true;
+        case 0xc4: case 0xc5: case 0xc6:                                              // bin 8 / 16 / 32
+            return msgpack_cmd_read_be(r, 1 << (b - 0xc4), &head->size);
+        case 0xc7: case 0xc8: case 0xc9:                                              // ext 8 / 16 / 32
+            if (!msgpack_cmd_read_be(r, 1 << (b - 0xc7), &head->size)) return false;
+            head->size++;
+            return true;
+        case 0xca: head->size = 4; return true;                                       // float 32
+        case 0xcb: head->size = 8; return true;                                       // float 64
+        case 0xcc: case 0xcd: case 0xce: case 0xcf:                                   // uint 8 / 16 / 32 / 64
+            if (!msgpack_cmd_read_be(r, 1 << (b - 0xcc), &raw)) return false;
+            if (raw > INT64_MAX) return true;
+            head->type = MSGPACK_CMD_INT;
+            head->value = (int64_t)raw;
+            return true;
+        case 0xd0: case 0xd1: case 0xd2: case 0xd3: {                                 // int 8 / 16 / 32 / 64
+            const size_t n = 1 << (b - 0xd0);
+            if (!msgpack_cmd_read_be(r, n, &raw)) return false;
+            head->type = MSGPACK_CMD_INT;
+            head->value = n == 8 ? (int64_t)raw : (int64_t)(raw ^ 1ull << (n * 8 - 1)) - (int64_t)(1ull << (n * 8 - 1));
+            return true;
+        }
+        case 0xd4: case 0xd5: case 0xd6: case 0xd7: case 0xd8:                        // fixext 1 / 2 / 4 / 8 / 16
+            head->size = 1 + (1 << (b - 0xd4));
+            return true;
+        case 0xd9: case 0xda: case 0xdb:                                              // str 8 / 16 / 32
+            head->type = MSGPACK_CMD_STR;
+            return msgpack_cmd_read_be(r, 1 << (b - 0xd9), &head->size);
+        case 0xdc: case 0xdd:                                                         // array 16 / 32
+            head->type = MSGPACK_CMD_ARRAY;
+            return msgpack_cmd_read_be(r, 2 << (b - 0xdc), &head->size);
+        case 0xde: case 0xdf:                                                         // map 16 / 32
+            head->type = MSGPACK_CMD_MAP;
+            return msgpack_cmd_read_be(r, 2 << (b - 0xde), &head->size);
+        default:                                                                      // 0xc1 is never used
+            r->pos--;
+            return msgpack_cmd_fail(r, JSON_CMD_ERR_SYNTAX);
+    }
+}
+
+/**
+ * Skips the raw bytes of a string, bin, ext or float
+ */
+static bool msgpack_cmd_skip_bytes(msgpack_cmd_reader_t *r, uint64_t size) {
+    if (r->len - r->pos < size) return msgpack_cmd_fail(r, JSON_CMD_ERR_SYNTAX);
+    r->pos += size;
+    return true;
+}
+
+/**
+ * Checks that enough bytes are left for the announced number of values, every value takes at least one
+ */
+static bool msgpack_cmd_check_count(msgpack_cmd_reader_t *r, uint64_t values) {
+    if (r->len - r->pos < values) return msgpack_cmd_fail(r, JSON_CMD_ERR_SYNTAX);
+    return true;
+}
+
+static bool msgpack_cmd_skip_value(msgpack_cmd_reader_t *r, int depth);
+
+/**
+ * Validates and skips whatever follows an already read head
+ */
+static bool msgpack_cmd_skip_body(msgpack_cmd_reader_t *r, const msgpack_cmd_head_t *head, int depth) {
+    switch (head->type) {
+        case MSGPACK_CMD_INT:
+            return true;
+        case MSGPACK_CMD_STR:
+        case MSGPACK_CMD_OTHER:
+            return msgpack_cmd_skip_bytes(r, head->size);
+        case MSGPACK_CMD_MAP:
+        case MSGPACK_CMD_ARRAY: {
+            if (depth > JSON_CMD_MAX_DEPTH) return msgpack_cmd_fail(r, JSON_CMD_ERR_DEPTH);
+            const uint64_t values = head->type == MSGPACK_CMD_MAP ? head->size * 2 : head->size;
+            if (!msgpack_cmd_check_count(r, values)) return false;
+            for (uint64_t i = 0; i < values; i++) {
+                if (!msgpack_cmd_skip_value(r, depth + 1)) return false;
+            }
+            return true;
+        }
+    }
+    return msgpack_cmd_fail(r, JSON_CMD_ERR_SYNTAX);
+}
+
+/**
+ * Validates and skips any value
+ */
+static bool msgpack_cmd_skip_value(msgpack_cmd_reader_t *r, int depth) {
+    msgpack_cmd_head_t head;
+    return msgpack_cmd_read_head(r, &head) && msgpack_cmd_skip_body(r, &head, depth);
+}
+
+/**
+ * Reads a key. Keys which are not strings never match a known field.
+ * @param key start of the key bytes, NULL for keys which are not strings
+ */
+static bool msgpack_cmd_read_key(msgpack_cmd_reader_t *r, const char **key, size_t *key_len) {
+    msgpack_cmd_head_t head;
+    if (!msgpack_cmd_read_head(r, &head)) return false;
+    if (head.type != MSGPACK_CMD_STR) {
+        *key = NULL;
+        *key_len = 0;
+        return msgpack_cmd_skip_body(r, &head, 2);
+    }
+    *key = (const char*)r->data + r->pos;
+    *key_len = head.size;
+    return msgpack_cmd_skip_bytes(r, head.size);
+}
+
+// --------- FIELD DECODERS --------- //
+
+static bool msgpack_cmd_key_is(const char *key, size_t key_len, const msgpack_cmd_key_t *known) {
+    return key != NULL && key_len == known->len && memcmp(key, known->name, key_len) == 0;
+}
+
+/**
+ * Copies a string value into a fixed buffer
+ * @param valid false if the value is not a string fitting the buffer
+ */
+static bool msgpack_cmd_read_string(msgpack_cmd_reader_t *r, char *out, size_t out_size, bool *valid) {
+    *valid = false;
+    msgpack_cmd_head_t head;
+    if (!msgpack_cmd_read_head(r, &head)) return false;
+    if (head.type != MSGPACK_CMD_STR || head.size >= out_size) return msgpack_cmd_skip_body(r, &head, 1);
+    if (!msgpack_cmd_check_count(r, head.size)) return false;
+
+    memcpy(out, r->data + r->pos, head.size);
+    out[head.size] = '\0';
+    r->pos += head.size;
+    *valid = true;
+    return true;
+}
+
+/**
+ * Reads an integer value
+ * @param valid false if the value is not an integer within [min, max]
+ */
+static bool msgpack_cmd_read_int(msgpack_cmd_reader_t *r, int64_t min, int64_t max, int64_t *out, bool *valid) {
+    *valid = false;
+    msgpack_cmd_head_t head;
+    if (!msgpack_cmd_read_head(r, &head)) return false;
+    if (head.type != MSGPACK_CMD_INT) return msgpack_cmd_skip_body(r, &head, 1);
+
+    *valid = head.value >= min && head.value <= max;
+    if (*valid) *out = head.value;
+    return true;
+}
+
+static bool msgpack_cmd_read_int32(msgpack_cmd_reader_t *r, int32_t *out, bool *valid) {
+    int64_t value;
+    if (!msgpack_cmd_read_int(r, INT32_MIN, INT32_MAX, &value, valid)) return false;
+    if (*valid) *out = (int32_t)value;
+    return true;
+}
+
+static const msgpack_cmd_key_t KEY_RED = MSGPACK_CMD_KEY("red");
+static const msgpack_cmd_key_t KEY_GREEN = MSGPACK_CMD_KEY("green");
+static const msgpack_cmd_key_t KEY_BLUE = MSGPACK_CMD_KEY("blue");
+
+/**
+ * Reads the color map
+ * @param valid false unless all three channels are present and valid
+ */
+static bool msgpack_cmd_read_color(msgpack_cmd_reader_t *r, json_cmd_color_t *color, bool *valid) {
+    *valid = false;
+    msgpack_cmd_head_t head;
+    if (!msgpack_cmd_read_head(r, &head)) return false;
+    if (head.type != MSGPACK_CMD_MAP) return msgpack_cmd_skip_body(r, &head, 1);
+    if (!msgpack_cmd_check_count(r, head.size * 2)) return false;
+
+    uint8_t channels = 0;
+    bool channels_valid = true;
+    for (uint64_t i = 0; i < head.size; i++) {
+        const char *key;
+        size_t key_len;
+        if (!msgpack_cmd_read_key(r, &key, &key_len)) return false;
+
+        bool ok;
+        bool channel_valid = true;
+        if (msgpack_cmd_key_is(key, key_len, &KEY_RED)) { ok = msgpack_cmd_read_int32(r, &color->red, &channel_valid); channels |= 1; }
+        else if (msgpack_cmd_key_is(key, key_len, &KEY_GREEN)) { ok = msgpack_cmd_read_int32(r, &color->green, &channel_valid); channels |= 2; }
+        else if (msgpack_cmd_key_is(key, key_len, &KEY_BLUE)) { ok = msgpack_cmd_read_int32(r, &color->blue, &channel_valid); channels |= 4; }
+        else ok = msgpack_cmd_skip_value(r, 2);
+        if (!ok) return false;
+        channels_valid &= channel_valid;
+    }
+
+    *valid = channels == 7 && channels_valid;
+    return true;
+}
+
+static const msgpack_cmd_key_t KEY_STATE = MSGPACK_CMD_KEY("state");
+static const msgpack_cmd_key_t KEY_MODE = MSGPACK_CMD_KEY("mode");
+static const msgpack_cmd_key_t KEY_COLOR = MSGPACK_CMD_KEY("color");
+static const msgpack_cmd_key_t KEY_BRIGHTNESS = MSGPACK_CMD_KEY("brightness");
+
+/**
+ * Reads the value of a state changing field into the step
+ * @param handled false if the key is not a step field, nothing is consumed then
+ */
+static bool msgpack_cmd_read_step_field(msgpack_cmd_reader_t *r, const char *key, size_t key_len, json_cmd_step_t *step, bool *handled) {
+    uint32_t field;
+    bool valid;
+    bool ok;
+    *handled = true;
+    if (msgpack_cmd_key_is(key, key_len, &KEY_STATE)) { ok = msgpack_cmd_read_int32(r, &step->state, &valid); field = JSON_CMD_FIELD_STATE; }
+    else if (msgpack_cmd_key_is(key, key_len, &KEY_MODE)) { ok = msgpack_cmd_read_int32(r, &step->mode, &valid); field = JSON_CMD_FIELD_MODE; }
+    else if (msgpack_cmd_key_is(key, key_len, &KEY_COLOR)) { ok = msgpack_cmd_read_color(r, &step->color, &valid); field = JSON_CMD_FIELD_COLOR; }
+    else if (msgpack_cmd_key_is(key, key_len, &KEY_BRIGHTNESS)) { ok = msgpack_cmd_read_int32(r, &step->brightness, &valid); field = JSON_CMD_FIELD_BRIGHTNESS; }
+    else {
+        *handled = false;
+        return true;
+    }
+    if (valid) step->fields |= field;
+    else step->invalid |= field;
+    return ok;
+}
+
+/**
+ * Reads one map of the batch
+ * @param valid false if the element is not a map
+ */
+static bool msgpack_cmd_read_step(msgpack_cmd_reader_t *r, json_cmd_step_t *step, bool *valid) {
+    *valid = false;
+    msgpack_cmd_head_t head;
+    if (!msgpack_cmd_read_head(r, &head)) return false;
+    if (head.type != MSGPACK_CMD_MAP) return msgpack_cmd_skip_body(r, &head, 2);
+    if (!msgpack_cmd_check_count(r, head.size * 2)) return false;
+    *valid = true;
+
+    for (uint64_t i = 0; i < head.size; i++) {
+        const char *key;
+        size_t key_len;
+        bool handled;
+        if (!msgpack_cmd_read_key(r, &key, &key_len)) return false;
+        if (!msgpack_cmd_read_step_field(r, key, key_len, step, &handled)) return false;
+        if (!handled && !msgpack_cmd_skip_value(r, 3)) return false;
+    }
+    return true;
+}
+
+/**
+ * Reads the batch array
+ * @param valid false if it is not an array of maps or has more than JSON_CMD_MAX_BATCH elements
+ */
+static bool msgpack_cmd_read_batch(msgpack_cmd_reader_t *r, json_cmd_t *cmd, bool *valid) {
+    *valid = false;
+    msgpack_cmd_head_t head;
+    if (!msgpack_cmd_read_head(r, &head)) return false;
+    if (head.type != MSGPACK_CMD_ARRAY) return msgpack_cmd_skip_body(r, &head, 1);
+    if (!msgpack_cmd_check_count(r, head.size)) return false;
+    *valid = true;
+
+    for (uint64_t i = 0; i < head.size; i++) {
+        // Elements past the limit are still validated so the error offset stays meaningful
+        json_cmd_step_t overflow;
+        json_cmd_step_t *step = cmd->batch_count < JSON_CMD_MAX_BATCH ? &cmd->batch[cmd->batch_count] : &overflow;
+        memset(step, 0, sizeof(json_cmd_step_t));
+        bool step_valid;
+        if (!msgpack_cmd_read_step(r, step, &step_valid)) return false;
+        if (!step_valid || step == &overflow) *valid = false;
+        else cmd->batch_count++;
+    }
+    return true;
+}
+
+// --------- WRITER --------- //
+
+static uint8_t *msgpack_cmd_write_str(uint8_t *out, const char *str, size_t len) {
+    *out++ = 0xa0 | len;
+    memcpy(out, str, len);
+    return out + len;
+}
+
+static uint8_t *msgpack_cmd_write_uint8(uint8_t *out, uint8_t value) {
+    if (value > 0x7f) *out++ = 0xcc;
+    *out++ = value;
+    return out;
+}
+
+#define MSGPACK_CMD_WRITE_KEY(out, key) msgpack_cmd_write_str(out, key, sizeof(key) - 1)
+
+// --------- PUBLIC METHODS --------- //
+
+static const msgpack_cmd_key_t KEY_TAG = MSGPACK_CMD_KEY("tag");
+static const msgpack_cmd_key_t KEY_CID = MSGPACK_CMD_KEY("cid");
+static const msgpack_cmd_key_t KEY_APPLY_AT = MSGPACK_CMD_KEY("apply_at");
+static const msgpack_cmd_key_t KEY_COMMANDS = MSGPACK_CMD_KEY("commands");
+
+json_cmd_err_e msgpack_cmd_parse(const uint8_t *data, size_t len, json_cmd_t *cmd, size_t *err_offset) {
+    msgpack_cmd_reader_t r = {.data = data, .len = len, .pos = 0, .err = JSON_CMD_OK};
+    memset(cmd, 0, offsetof(json_cmd_t, batch));
+
+    msgpack_cmd_head_t head;
+    bool ok = msgpack_cmd_read_head(&r, &head);
+    if (ok && head.type != MSGPACK_CMD_MAP) {
+        r.pos = 0;
+        ok = msgpack_cmd_fail(&r, JSON_CMD_ERR_SYNTAX);
+    }
+    if (ok) ok = msgpack_cmd_check_count(&r, head.size * 2);
+
+    for (uint64_t i = 0; ok && i < head.size; i++) {
+        const char *key;
+        size_t key_len;
+        ok = msgpack_cmd_read_key(&r, &key, &key_len);
+        if (!ok) break;
+
+        // Known fields with a wrong type are skipped and reported, the rest of the command still counts
+        bool handled;
+        ok = msgpack_cmd_read_step_field(&r, key, key_len, &cmd->step, &handled);
+        if (!ok) break;
+        if (handled) continue;
+
+        uint32_t field = 0;
+        bool valid = true;
+        if (msgpack_cmd_key_is(key, key_len, &KEY_TAG)) { ok = msgpack_cmd_read_string(&r, cmd->tag, sizeof(cmd->tag), &valid); field = JSON_CMD_FIELD_TAG; }
+        else if (msgpack_cmd_key_is(key, key_len, &KEY_CID)) { ok = msgpack_cmd_read_string(&r, cmd->cid, sizeof(cmd->cid), &valid); field = JSON_CMD_FIELD_CID; }
+        else if (msgpack_cmd_key_is(key, key_len, &KEY_APPLY_AT)) { ok = msgpack_cmd_read_int(&r, 0, JSON_CMD_MAX_APPLY_AT_MS, &cmd->apply_at_ms, &valid); field = JSON_CMD_FIELD_APPLY_AT; }
+        else if (msgpack_cmd_key_is(key, key_len, &KEY_COMMANDS)) { ok = msgpack_cmd_read_batch(&r, cmd, &valid); field = JSON_CMD_FIELD_COMMANDS; }
+        else ok = msgpack_cmd_skip_value(&r, 1);
+        if (!ok) break;
+        if (valid) cmd->fields |= field;
+        else cmd->invalid |= field;
+    }
+
+    // Nothing may follow the map
+    if (ok && r.pos != r.len) ok = msgpack_cmd_fail(&r, JSON_CMD_ERR_SYNTAX);
+
+    if (!ok && err_offset != NULL) *err_offset = r.pos;
+    return ok ? JSON_CMD_OK : r.err;
+}
+
+size_t msgpack_cmd_format_status(uint8_t *buffer, const led_status_t *status) {
+    uint8_t *out = buffer;
+    *out++ = 0x84;
+    out = MSGPACK_CMD_WRITE_KEY(out, "tag");
+    out = MSGPACK_CMD_WRITE_KEY(out, LED_STATUS_TAG);
+    out = MSGPACK_CMD_WRITE_KEY(out, "state");
+    out = msgpack_cmd_write_uint8(out, status->state);
+    out = MSGPACK_CMD_WRITE_KEY(out, "mode");
+    out = msgpack_cmd_write_uint8(out, status->mode);
+    out = MSGPACK_CMD_WRITE_KEY(out, "color");
+    *out++ = 0x83;
+    out = MSGPACK_CMD_WRITE_KEY(out, "red");
+    out = msgpack_cmd_write_uint8(out, status->red);
+    out = MSGPACK_CMD_WRITE_KEY(out, "green");
+    out = msgpack_cmd_write_uint8(out, status->green);
+    out = MSGPACK_CMD_WRITE_KEY(out, "blue");
+    out = msgpack_cmd_write_uint8(out, status->blue);
+    return out - buffer;
+}
@@ -0,0 +1,39 @@
+//
+// Created by kok on 19.10.26.
+//
+
+#ifndef MSGPACK_CMD_H
+#define MSGPACK_CMD_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include "json_cmd/json_cmd.h"
+#include "led_status/led_status.h"
+
+/**
+ * Largest MessagePack status: a map of four entries, the color map of three, and every value above 127
+ */
+#define MSGPACK_CMD_STATUS_MAX_LEN      (1 + 4 + 10 + 6 + 2 + 5 + 2 + 6 + 1 + 4 + 2 + 6 + 2 + 5 + 2)
+
+/**
+ * Decodes a MessagePack command into the same structure as json_cmd_parse(), without allocating memory.
+ * The top level must be a map with the keys of the JSON command, unknown keys are skipped and known
+ * keys with a wrong type are flagged in "invalid".
+ * @param data MessagePack payload
+ * @param len length of the payload
+ * @param cmd decoded command
+ * @param err_offset offset of the first invalid byte if decoding fails, can be NULL
+ * @return JSON_CMD_OK if the whole payload is a single valid map
+ */
+json_cmd_err_e msgpack_cmd_parse(const uint8_t *data, size_t len, json_cmd_t *cmd, size_t *err_offset);
+
+/**
+ * Writes the status message as a MessagePack map with the same keys as the JSON status
+ * @param buffer output buffer of at least MSGPACK_CMD_STATUS_MAX_LEN bytes
+ * @param status values to report
+ * @return number of bytes written
+ */
+size_t msgpack_cmd_format_status(uint8_t *buffer, const led_status_t *status);
+
+#endif //MSGPACK_CMD_H
@@ -5,32 +5,82 @@
 #include <string.h>
 
 #include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
 #include "esp_log.h"
 #include "portmacro.h"
-#include "nvs.h"
 
 #include "led_encoder/led_encoder.h"
+#include "led_anim/led_anim.h"
+#include "audio_app/audio_app.h"
+#include "seqlock/seqlock.h"
+#include "rmt_store/rmt_store.h"
+#include "boot_stats/boot_stats.h"
+#include "time_sync/time_sync.h"
+#include "frame_sync/frame_sync.h"
+#include "app_spiffs/app_spiffs.h"
+#include "esp_timer.h"
 #include "tasks_common.h"
 #include "rmt_app.h"
 
 
-/**
- * RMT Applicatiom messaging queue handle
- */
-QueueHandle_t rmt_app_message_queue_handle = NULL;
-
 static const char TAG[] = "rmt_app";
-static const char NVS_NAMESPACE[] = "rmt_app";
 
 static rmt_channel_handle_t g_tx_chan = NULL;
 static rmt_encoder_handle_t g_rmt_encoder = NULL;
 static rmt_transmit_config_t g_tx_config;
-static rmt_app_state_e g_rmt_app_state = RMT_APP_LED_OFF;
-static rmt_app_mode_e g_rmt_app_sel_mode = RMT_APP_LED_MODE_RAINBOW;
 
-static uint8_t g_red_value = 255;
-static uint8_t g_green_value = 0;
-static uint8_t g_blue_value = 0;
+/**
+ * Published LED state. Writers are serialized by g_state_write_mutex, readers use the seqlock.
+ */
+static SemaphoreHandle_t g_state_write_mutex = NULL;
+static seqlock_t g_state_lock;
+static rmt_app_active_config_t g_state = {
+    .state = RMT_APP_LED_OFF,
+    .mode = RMT_APP_LED_MODE_RAINBOW,
+    .colors = {.red = 255, .green = 0, .blue = 0},
+    .brightness = 255
+};
+static TaskHandle_t g_state_listener = NULL;
+
+/**
+ * Pending messages which are applied by the render task on the next frame
+ */
+static portMUX_TYPE g_msg_lock = portMUX_INITIALIZER_UNLOCKED;
+static rmt_app_message_t g_msg_pending[RMT_APP_MAX_QUEUE_SIZE];
+static size_t g_msg_pending_count = 0;
+static rmt_app_msg_stats_t g_msg_stats;
+
+/**
+ * Scheduled messages sorted by due time, protected by g_msg_lock
+ */
+static rmt_app_scheduled_msg_t g_msg_scheduled[RMT_APP_MAX_SCHEDULED];
+static size_t g_msg_scheduled_count = 0;
+
+/**
+ * Traces of the messages applied on the current frame, completed once the frame is transmitted
+ */
+static latency_trace_t g_frame_traces[RMT_APP_MAX_SCHEDULED + RMT_APP_MAX_QUEUE_SIZE];
+static size_t g_frame_traces_count = 0;
+static int64_t g_last_flush_us = 0;
+
+/**
+ * Brightness of the frame being rendered, set by the render task. Scaled frames are built in g_scaled_pixels.
+ */
+static uint8_t g_frame_brightness = 255;
+static uint8_t g_scaled_pixels[RMT_APP_LED_NUMBERS * 3];
+
+/**
+ * Streamed frames in GRB order. The back buffer is filled slice by slice, the front buffer is published by the seqlock.
+ */
+static uint8_t g_pixels_back[RMT_APP_LED_NUMBERS * 3];
+static uint8_t g_pixels_front[RMT_APP_LED_NUMBERS * 3];
+static uint32_t g_pixels_frame = 0;
+static seqlock_t g_pixels_lock;
+static portMUX_TYPE g_pixels_write_lock = portMUX_INITIALIZER_UNLOCKED;   // Serializes the seqlock writers
+
+static led_anim_player_t g_anim_player;
+static uint8_t g_anim_pixels[RMT_APP_LED_NUMBERS * 3];
+static bool g_anim_fallback = false;   // The static color is shown because the animation can't be played
 
 
 // --------- AUX RMT METHODS --------- //
@@ -83,94 +133,194 @@ static void led_strip_hsv2rgb(uint32_t hue, const uint32_t saturation, const uin
     }
 }
 
-// --------- NVS STORAGE --------- //
-
-static void rmt_app_save_config_to_flash() {
-    ESP_LOGI(TAG, "Saving RMT configuration to NVS...");
-    nvs_handle_t nvs_handle;
-    esp_err_t err = nvs_open(NVS_NAMESPACE, NVS_READWRITE, &nvs_handle);
-    if (err != ESP_OK) ESP_LOGE(TAG, "Failed to open NVS in order to save RMT configuration! %s", esp_err_to_name(err));
-
-    err = nvs_set_u8(nvs_handle, "state", g_rmt_app_state);
-    if (err != ESP_OK) ESP_LOGE(TAG, "Failed to set rmt state in NVS: %s", esp_err_to_name(err));
-
-    err = nvs_set_u8(nvs_handle, "mode", g_rmt_app_sel_mode);
-    if (err != ESP_OK) ESP_LOGE(TAG, "Failed to set rmt mode in NVS: %s", esp_err_to_name(err));
+// --------- STATE SNAPSHOT --------- //
 
-    err = nvs_set_u8(nvs_handle, "red", g_red_value);
-    if (err != ESP_OK) ESP_LOGE(TAG, "Failed to set red value in NVS: %s", esp_err_to_name(err));
-
-    err = nvs_set_u8(nvs_handle, "green", g_green_value);
-    if (err != ESP_OK) ESP_LOGE(TAG, "Failed to set green value in NVS: %s", esp_err_to_name(err));
-
-    err = nvs_set_u8(nvs_handle, "blue", g_blue_value);
-    if (err != ESP_OK) ESP_LOGE(TAG, "Failed to set blue value in NVS: %s", esp_err_to_name(err));
-
-    err = nvs_commit(nvs_handle);
-    if (err != ESP_OK) ESP_LOGE(TAG, "Failed to commit RMT configuration to NVS: %s", esp_err_to_name(err));
-
-    nvs_close(nvs_handle);
+/**
+ * Starts a state update. Writers are serialized, readers are never blocked.
+ * @return copy of the current state which should be modified and passed to rmt_app_state_commit()
+ */
+static rmt_app_active_config_t rmt_app_state_begin(void) {
+    xSemaphoreTake(g_state_write_mutex, portMAX_DELAY);
+    return g_state;
 }
 
-static void rmt_app_get_config_from_flash() {
-    ESP_LOGI(TAG, "Fetching RMT configuration from NVS...");
-    nvs_handle_t nvs_handle;
-    esp_err_t err = nvs_open(NVS_NAMESPACE, NVS_READWRITE, &nvs_handle);
-    if (err != ESP_OK) ESP_LOGE(TAG, "Failed to open NVS in order to save RMT configuration! %s", esp_err_to_name(err));
-
-    err = nvs_get_u8(nvs_handle, "state", (uint8_t*)&g_rmt_app_state);
-    if (err != ESP_OK) ESP_LOGE(TAG, "Failed to get rmt state from NVS: %s", esp_err_to_name(err));
-
-    err = nvs_get_u8(nvs_handle, "mode", (uint8_t*)&g_rmt_app_sel_mode);
-    if (err != ESP_OK) ESP_LOGE(TAG, "Failed to get red value from NVS: %s", esp_err_to_name(err));
+/**
+ * Publishes the modified state as a new version and ends the update
+ * @param next state returned by rmt_app_state_begin()
+ */
+static void rmt_app_state_commit(rmt_app_active_config_t *next) {
+    next->version = g_state.version + 1;
+    seqlock_write_begin(&g_state_lock);
+    g_state = *next;
+    seqlock_write_end(&g_state_lock);
+    const TaskHandle_t listener = g_state_listener;
+    xSemaphoreGive(g_state_write_mutex);
+
+    if (listener != NULL) xTaskNotifyGive(listener);
+}
 
-    err = nvs_get_u8(nvs_handle, "red", &g_red_value);
-    if (err != ESP_OK) ESP_LOGE(TAG, "Failed to get red value from NVS: %s", esp_err_to_name(err));
+/**
+ * Ends a state update without publishing anything
+ */
+static void rmt_app_state_abort(void) {
+    xSemaphoreGive(g_state_write_mutex);
+}
 
-    err = nvs_get_u8(nvs_handle, "green", &g_green_value);
-    if (err != ESP_OK) ESP_LOGE(TAG, "Failed to get green value from NVS: %s", esp_err_to_name(err));
+// --------- RMT MESSAGE QUEUE --------- //
 
-    err = nvs_get_u8(nvs_handle, "blue", &g_blue_value);
-    if (err != ESP_OK) ESP_LOGE(TAG, "Failed to get blue value from NVS: %s", esp_err_to_name(err));
+// Modes the button and /toggle cycle through. Streamed pixels are only entered by a client,
+// the audio mode only exists when the microphone is built in.
+static const uint8_t g_cycle_modes[] = {
+    RMT_APP_LED_MODE_RAINBOW,
+    RMT_APP_LED_MODE_STATIC,
+    RMT_APP_LED_MODE_ANIMATION,
+#if AUDIO_APP_ENABLED
+    RMT_APP_LED_MODE_AUDIO,
+#endif
+};
+#define RMT_APP_CYCLE_MODES_COUNT   (sizeof(g_cycle_modes) / sizeof(g_cycle_modes[0]))
 
-    nvs_close(nvs_handle);
+/**
+ * Steps through g_cycle_modes. A mode outside of the cycle goes to its first entry on the first step.
+ */
+static rmt_app_mode_e rmt_app_cycle_mode(rmt_app_mode_e mode, uint8_t cycles) {
+    if (cycles == 0) return mode;
+    for (int i = 0; i < RMT_APP_CYCLE_MODES_COUNT; i++) {
+        if (g_cycle_modes[i] == mode) return g_cycle_modes[(i + cycles) % RMT_APP_CYCLE_MODES_COUNT];
+    }
+    return g_cycle_modes[(cycles - 1) % RMT_APP_CYCLE_MODES_COUNT];
 }
 
-// --------- RMT MESSAGE QUEUE --------- //
+/**
+ * Merges the message into the last pending one if possible. Must be called with g_msg_lock held.
+ * @param acked set if a merged trace was acknowledged, the listener should be notified after unlocking
+ * @return true if the message was merged
+ */
+static bool rmt_app_merge_message(const rmt_app_message_t *msg, bool *acked) {
+    if (g_msg_pending_count == 0) return false;
+    rmt_app_message_t *last = &g_msg_pending[g_msg_pending_count - 1];
+    if (last->msgID != msg->msgID) return false;
+
+    // The merged message carries the newest trace, older ones are acknowledged as merged
+    *acked |= latency_trace_merged(&last->trace);
+    switch (msg->msgID) {
+        case RMT_APP_MSG_TOGGLE_LED:
+            // Two toggles cancel each other out
+            *acked |= latency_trace_merged(&msg->trace);
+            g_msg_pending_count--;
+            return true;
+        case RMT_APP_MSG_CYCLE_MODE:
+            // Kept at 1..count, a full turn still has to leave a mode outside of the cycle
+            last->cycles = (last->cycles + msg->cycles - 1) % RMT_APP_CYCLE_MODES_COUNT + 1;
+            last->trace = msg->trace;
+            return true;
+        default:
+            // Only the latest value of a setter matters
+            *last = *msg;
+            return true;
+    }
+}
 
 /**
- * RMT Application's message queue task
+ * Applies a single message to the next state version
+ * @param next state which is being built
+ * @param msg message to apply
  */
-static void rmt_app_msg_queue_task(void *pvParams) {
-    rmt_app_message_t msg;
-    while(1) {
-        if (xQueueReceive(rmt_app_message_queue_handle, &msg, portMAX_DELAY)) {
-            switch (msg.msgID) {
-                case RMT_APP_MSG_TOGGLE_LED:
-                    if (g_rmt_app_state == RMT_APP_LED_ON) {
-                        ESP_LOGI(TAG, "LED turned OFF");
-                        g_rmt_app_state = RMT_APP_LED_OFF;
-                    } else {
-                        g_rmt_app_state = RMT_APP_LED_ON;
-                        ESP_LOGI(TAG, "Selected LED mode: %d", g_rmt_app_sel_mode);
-                    }
-                    break;
-                case RMT_APP_MSG_CYCLE_MODE:
-                    if (g_rmt_app_state == RMT_APP_LED_OFF) {
-                        ESP_LOGI(TAG, "LED mode could not be changed because it's turned OFF");
-                        continue;
-                    }
-                    if (g_rmt_app_sel_mode == RMT_APP_LED_MODES_COUNT - 1) g_rmt_app_sel_mode = RMT_APP_LED_MODE_RAINBOW;
-                    else g_rmt_app_sel_mode++;
-                    ESP_LOGI(TAG, "Selected LED Mode: %d", g_rmt_app_sel_mode);
+static void rmt_app_apply_message(rmt_app_active_config_t *next, const rmt_app_message_t *msg) {
+    switch (msg->msgID) {
+        case RMT_APP_MSG_TOGGLE_LED:
+            next->state = next->state == RMT_APP_LED_ON ? RMT_APP_LED_OFF : RMT_APP_LED_ON;
+            ESP_LOGI(TAG, "LED turned %s", next->state == RMT_APP_LED_ON ? "ON" : "OFF");
+            break;
+        case RMT_APP_MSG_CYCLE_MODE:
+            if (next->state == RMT_APP_LED_OFF) {
+                ESP_LOGI(TAG, "LED mode could not be changed because it's turned OFF");
+                break;
             }
-            rmt_app_save_config_to_flash();
+            next->mode = rmt_app_cycle_mode(next->mode, msg->cycles);
+            ESP_LOGI(TAG, "Selected LED Mode: %d", next->mode);
+            break;
+        case RMT_APP_MSG_SET_STATE:
+            next->state = msg->state;
+            break;
+        case RMT_APP_MSG_SET_MODE:
+            // Mode is ignored when the LED is turned off
+            if (next->state == RMT_APP_LED_ON) next->mode = msg->mode;
+            break;
+        case RMT_APP_MSG_SET_COLOR:
+            next->colors = msg->colors;
+            break;
+        case RMT_APP_MSG_SET_BRIGHTNESS:
+            next->brightness = msg->brightness;
+            break;
+    }
+}
+
+/**
+ * Applies all due scheduled messages and all pending messages as one state version.
+ * Called once per frame by the render task.
+ */
+static void rmt_app_apply_pending_messages(void) {
+    rmt_app_message_t batch[RMT_APP_MAX_SCHEDULED + RMT_APP_MAX_QUEUE_SIZE];
+    const int64_t applied_us = esp_timer_get_time();
+
+    portENTER_CRITICAL(&g_msg_lock);
+    // Scheduled messages were sent before the pending ones, so they are applied first
+    size_t count = 0;
+    while (count < g_msg_scheduled_count && g_msg_scheduled[count].due_us <= applied_us) {
+        const uint32_t error_us = applied_us - g_msg_scheduled[count].due_us;
+        if (error_us > g_msg_stats.max_schedule_error_us) g_msg_stats.max_schedule_error_us = error_us;
+        batch[count] = g_msg_scheduled[count].msg;
+        count++;
+    }
+    g_msg_scheduled_count -= count;
+    memmove(g_msg_scheduled, g_msg_scheduled + count, g_msg_scheduled_count * sizeof(rmt_app_scheduled_msg_t));
+
+    memcpy(batch + count, g_msg_pending, g_msg_pending_count * sizeof(rmt_app_message_t));
+    count += g_msg_pending_count;
+    g_msg_pending_count = 0;
+    portEXIT_CRITICAL(&g_msg_lock);
+
+    if (count == 0) return;
+
+    rmt_app_active_config_t next = rmt_app_state_begin();
+    const rmt_app_active_config_t prev = next;
+    for (size_t i = 0; i < count; i++) {
+        rmt_app_apply_message(&next, &batch[i]);
+        if (batch[i].trace.recv_us != 0) {
+            g_frame_traces[g_frame_traces_count] = batch[i].trace;
+            g_frame_traces[g_frame_traces_count++].applied_us = applied_us;
         }
     }
+
+    if (next.state == prev.state && next.mode == prev.mode && next.brightness == prev.brightness &&
+        next.colors.red == prev.colors.red && next.colors.green == prev.colors.green && next.colors.blue == prev.colors.blue) {
+        rmt_app_state_abort();
+        return;
+    }
+    rmt_app_state_commit(&next);
+    rmt_store_mark_dirty(&next);
 }
 
 // --------- TRANSMIT RMT DATA --------- //
 
+/**
+ * Flush the GRB ordered pixels to the LED strip, scaled by the brightness of the current frame
+ * @param pixels RMT_APP_LED_NUMBERS * 3 bytes in GRB order
+ */
+static void rmt_app_flush_pixels(const uint8_t *pixels) {
+    if (g_frame_brightness != 255) {
+        // 255 maps to itself, so full brightness never needs the copy
+        const uint32_t scale = g_frame_brightness + 1;
+        for (int i = 0; i < RMT_APP_LED_NUMBERS * 3; i++) g_scaled_pixels[i] = pixels[i] * scale >> 8;
+        pixels = g_scaled_pixels;
+    }
+    ESP_ERROR_CHECK(rmt_transmit(g_tx_chan, g_rmt_encoder, pixels, RMT_APP_LED_NUMBERS * 3, &g_tx_config));
+    ESP_ERROR_CHECK(rmt_tx_wait_all_done(g_tx_chan, portMAX_DELAY));
+    g_last_flush_us = esp_timer_get_time();
+    boot_stats_mark(BOOT_STATS_PHASE_FIRST_PHOTON);
+}
+
 /**
  *  Creates a new RMT transmit configuration which is suited when using hue value
  * @return RMT transmit configuration
@@ -255,8 +405,7 @@ static void rmt_app_transmit_data(rmt_app_transmit_config_t *config, rmt_app_tra
         led_strip_pixels[i + 2] = blue;
     }
     // Flush RGB values to LEDs
-    ESP_ERROR_CHECK(rmt_transmit(g_tx_chan, g_rmt_encoder, led_strip_pixels, RMT_APP_LED_NUMBERS * 3, &g_tx_config));
-    ESP_ERROR_CHECK(rmt_tx_wait_all_done(g_tx_chan, portMAX_DELAY));
+    rmt_app_flush_pixels(led_strip_pixels);
 }
 
 // --------- RMT LED MODE METHODS --------- //
@@ -270,25 +419,163 @@ static void rmt_app_led_off(void) {
     free(config);
 }
 
-static void rmt_app_led_mode_rainbow(void) {
-    uint32_t hue = 0;
-    static uint32_t start_rgb = 0;
-    for (int i = 0; i < 3; i++) {
-        rmt_app_transmit_hue_config_t *hue_config = rmt_app_new_transmit_hue_config(hue, NULL, NULL, &start_rgb);
-        rmt_app_transmit_data(NULL, hue_config);
-        vTaskDelay(pdMS_TO_TICKS(RMT_APP_LED_CHASE_SPEED));
-        rmt_app_transmit_data(NULL, hue_config);
+/**
+ * Rainbow chase. The phase is derived from the shared frame clock, so every synchronized controller shows the same frame.
+ */
+static void rmt_app_led_mode_rainbow(const rmt_app_effect_params_t *params) {
+    const uint32_t start_rgb = (uint64_t)frame_sync_now_us() * RMT_APP_RAINBOW_SPEED_DEG_PER_S / 1000000 % 360;
+    rmt_app_transmit_hue_config_t *hue_config = rmt_app_new_transmit_hue_config(0, NULL, NULL, &start_rgb);
+    rmt_app_transmit_data(NULL, hue_config);
+    free(hue_config);
+    vTaskDelay(pdMS_TO_TICKS(RMT_APP_LED_CHASE_SPEED));
+}
+
+static void rmt_app_led_mode_static(const rmt_app_effect_params_t *params) {
+    // The strip latches the last frame, so only retransmit when the colour or the brightness changes
+    if (params->changed) {
+        const rmt_app_transmit_config_t *colors = &params->config.colors;
+        rmt_app_transmit_config_t *config = rmt_app_new_transmit_config(colors->red, colors->green, colors->blue);
+        rmt_app_transmit_data(config, NULL);
+        free(config);
+    }
+    vTaskDelay(pdMS_TO_TICKS(RMT_APP_LED_CHASE_SPEED));
+}
+
+/**
+ * Shows the static color instead of the animation. The first fallback after animation frames always retransmits,
+ * otherwise the strip would keep the last animation frame latched.
+ */
+static void rmt_app_led_mode_animation_fallback(const rmt_app_effect_params_t *params) {
+    rmt_app_effect_params_t fallback = *params;
+    fallback.changed = params->changed || !g_anim_fallback;
+    g_anim_fallback = true;
+    rmt_app_led_mode_static(&fallback);
+}
+
+/**
+ * Plays the animation stored in RMT_APP_ANIM_FILE_PATH. Falls back to the static mode if it can't be played.
+ */
+static void rmt_app_led_mode_animation(const rmt_app_effect_params_t *params) {
+    static TickType_t last_open_attempt = 0;
+    static bool mounted_at_last_attempt = false;
+
+    // Retry opening the file on a change, and periodically while SPIFFS is still mounting.
+    // A file which is missing or broken once SPIFFS is up stays on the fallback until the config changes.
+    if (g_anim_player.fp == NULL) {
+        app_spiffs_mount_async();
+        const TickType_t now = xTaskGetTickCount();
+        const bool retry = params->changed
+            || (!mounted_at_last_attempt && now - last_open_attempt >= pdMS_TO_TICKS(RMT_APP_ANIM_RETRY_MS));
+        if (retry) {
+            last_open_attempt = now;
+            mounted_at_last_attempt = app_spiffs_is_mounted();
+        }
+        if (!retry || led_anim_open(RMT_APP_ANIM_FILE_PATH, &g_anim_player) != ESP_OK) {
+            rmt_app_led_mode_animation_fallback(params);
+            return;
+        }
+    }
+
+    // Files made for a longer strip are cut to RMT_APP_LED_NUMBERS by the player
+    if (led_anim_next_frame(&g_anim_player, g_anim_pixels, sizeof(g_anim_pixels)) != ESP_OK) {
+        led_anim_close(&g_anim_player);
+        rmt_app_led_mode_animation_fallback(params);
+        return;
+    }
+    g_anim_fallback = false;
+
+    if (g_anim_player.header.flags & LED_ANIM_FLAG_ORDER_GRB) rmt_app_flush_pixels(g_anim_pixels);
+    else {
+        uint8_t led_strip_pixels[RMT_APP_LED_NUMBERS * 3];
+        for (int i = 0; i < RMT_APP_LED_NUMBERS * 3; i += 3) {
+            led_strip_pixels[i + 0] = g_anim_pixels[i + 1];
+            led_strip_pixels[i + 1] = g_anim_pixels[i + 0];
+            led_strip_pixels[i + 2] = g_anim_pixels[i + 2];
+        }
+        rmt_app_flush_pixels(led_strip_pixels);
+    }
+    vTaskDelay(pdMS_TO_TICKS(g_anim_player.header.frame_interval_ms));
+}
+
+/**
+ * Spectrum effect. Every band lights its own segment of the strip, beats desaturate the whole strip.
+ */
+static void rmt_app_led_mode_audio(const rmt_app_effect_params_t *params) {
+    if (!params->audio_valid) {
+        rmt_app_led_off();
         vTaskDelay(pdMS_TO_TICKS(RMT_APP_LED_CHASE_SPEED));
-        free(hue_config);
+        return;
+    }
+
+    uint8_t red, green, blue;
+    uint8_t led_strip_pixels[RMT_APP_LED_NUMBERS * 3];
+    const uint32_t saturation = params->audio.beat ? 30 : 100;
+    for (int led = 0; led < RMT_APP_LED_NUMBERS; led++) {
+        const int band = led * AUDIO_DSP_BANDS_COUNT / RMT_APP_LED_NUMBERS;
+        const uint32_t value = params->audio.levels[band] * 100 / 255;
+        led_strip_hsv2rgb(band * 360 / AUDIO_DSP_BANDS_COUNT, saturation, value, &red, &green, &blue);
+        led_strip_pixels[led * 3 + 0] = green;
+        led_strip_pixels[led * 3 + 1] = red;
+        led_strip_pixels[led * 3 + 2] = blue;
     }
-    start_rgb += 60;
+    rmt_app_flush_pixels(led_strip_pixels);
+    vTaskDelay(pdMS_TO_TICKS(RMT_APP_LED_CHASE_SPEED));
 }
 
-static void rmt_app_led_mode_static(void) {
-    rmt_app_transmit_config_t *config = rmt_app_new_transmit_config(g_red_value, g_green_value, g_blue_value);
-    rmt_app_transmit_data(config, NULL);
+/**
+ * Shows the last frame streamed by the client
+ */
+static void rmt_app_led_mode_pixels(const rmt_app_effect_params_t *params) {
+    static uint32_t last_frame = 0;
+    uint8_t led_strip_pixels[RMT_APP_LED_NUMBERS * 3];
+    uint32_t frame;
+    uint32_t seq;
+    do {
+        seq = seqlock_read_begin(&g_pixels_lock);
+        frame = g_pixels_frame;
+        memcpy(led_strip_pixels, g_pixels_front, sizeof(led_strip_pixels));
+    } while (seqlock_read_retry(&g_pixels_lock, seq));
+
+    // The strip latches the last frame, so only retransmit when a new one arrives
+    if (params->changed || frame != last_frame) {
+        rmt_app_flush_pixels(led_strip_pixels);
+        last_frame = frame;
+    }
     vTaskDelay(pdMS_TO_TICKS(RMT_APP_LED_CHASE_SPEED));
-    free(config);
+}
+
+// --------- EFFECT PIPELINE --------- //
+
+static const rmt_app_effect_t g_rmt_app_effects[RMT_APP_LED_MODES_COUNT] = {
+    [RMT_APP_LED_MODE_RAINBOW] = {.name = "rainbow", .render = rmt_app_led_mode_rainbow},
+    [RMT_APP_LED_MODE_STATIC] = {.name = "static", .render = rmt_app_led_mode_static},
+    [RMT_APP_LED_MODE_ANIMATION] = {.name = "animation", .render = rmt_app_led_mode_animation},
+    [RMT_APP_LED_MODE_AUDIO] = {.name = "audio", .render = rmt_app_led_mode_audio},
+    [RMT_APP_LED_MODE_PIXELS] = {.name = "pixels", .render = rmt_app_led_mode_pixels},
+};
+
+/**
+ * Collects the inputs of the current frame and feeds them to the effect
+ */
+static void rmt_app_effect_params_update(rmt_app_effect_params_t *params) {
+    const uint32_t last_version = params->config.version;
+    params->config = rmt_app_get_active_config();
+    params->changed = params->config.version != last_version;
+    params->audio_valid = audio_app_get_bands(&params->audio);
+}
+
+/**
+ * Completes the traces of the messages applied on this frame
+ */
+static void rmt_app_complete_frame_traces(void) {
+    if (g_frame_traces_count == 0) return;
+
+    // Commands without a visible change complete when they are applied
+    for (size_t i = 0; i < g_frame_traces_count; i++) {
+        const int64_t applied_us = g_frame_traces[i].applied_us;
+        latency_trace_complete(&g_frame_traces[i], g_last_flush_us >= applied_us ? g_last_flush_us : applied_us);
+    }
+    g_frame_traces_count = 0;
 }
 
 // --------- MAIN RMT METHODS --------- //
@@ -297,17 +584,25 @@ static void rmt_app_led_mode_static(void) {
  * RMT Application task
  */
 static void rmt_app_task(void *pvParams) {
+    // Start from an impossible version so the first frame is always rendered
+    rmt_app_effect_params_t params = {.config = {.version = UINT32_MAX}};
     while (1) {
-        if (g_rmt_app_state == RMT_APP_LED_ON) {
-            switch (g_rmt_app_sel_mode) {
-                case RMT_APP_LED_MODE_RAINBOW:
-                    rmt_app_led_mode_rainbow();
-                break;
-                case RMT_APP_LED_MODE_STATIC:
-                    rmt_app_led_mode_static();
-                break;
-            }
-        } else rmt_app_led_off();
+        rmt_app_apply_pending_messages();
+        rmt_app_effect_params_update(&params);
+        const rmt_app_active_config_t *config = &params.config;
+        g_frame_brightness = config->brightness;
+
+        // Release the animation file once another mode is selected
+        if (g_anim_player.fp != NULL && (config->state == RMT_APP_LED_OFF || config->mode != RMT_APP_LED_MODE_ANIMATION))
+            led_anim_close(&g_anim_player);
+
+        if (config->state == RMT_APP_LED_ON && config->mode < RMT_APP_LED_MODES_COUNT) {
+            g_rmt_app_effects[config->mode].render(&params);
+        } else {
+            if (params.changed) rmt_app_led_off();
+            vTaskDelay(pdMS_TO_TICKS(RMT_APP_LED_CHASE_SPEED));
+        }
+        rmt_app_complete_frame_traces();
     }
 }
 
@@ -334,11 +629,16 @@ void rmt_app_start(void) {
     // Configure the TX transmition
     g_tx_config.loop_count = 0;
 
-    // Create message queue
-    rmt_app_message_queue_handle = xQueueCreate(RMT_APP_MAX_QUEUE_SIZE, sizeof(rmt_app_message_t));
+    // Create the state writer lock
+    g_state_write_mutex = xSemaphoreCreateMutex();
 
     // Fetch saved configuration from NVS
-    rmt_app_get_config_from_flash();
+    rmt_app_active_config_t next = rmt_app_state_begin();
+    rmt_store_load(&next);
+    // Streamed frames don't survive a restart
+    if (next.mode == RMT_APP_LED_MODE_PIXELS) next.mode = RMT_APP_LED_MODE_STATIC;
+    rmt_app_state_commit(&next);
+    rmt_store_start();
 
     // Start RMT Application task
     xTaskCreatePinnedToCore(
@@ -350,82 +650,274 @@ void rmt_app_start(void) {
         NULL,
         RMT_APP_TASK_CORE_ID
     );
+}
 
-    // Start RMT Application's message queue task
-    xTaskCreatePinnedToCore(
-        &rmt_app_msg_queue_task,
-        "rmt_app_msg_queue_task",
-        RMT_APP_MSG_QUEUE_TASK_STACK_SIZE,
-        NULL,
-        RMT_APP_MSG_QUEUE_TASK_PRIORITY,
-        NULL,
-        RMT_APP_MSG_QUEUE_TASK_CORE_ID
-    );
+
+/**
+ * Counts the pending slots the messages need after merging. Must be called with g_msg_lock held.
+ */
+static size_t rmt_app_slots_needed(const rmt_app_message_t *msgs, size_t count) {
+    size_t slots = 0;
+    int last_id = g_msg_pending_count > 0 ? (int)g_msg_pending[g_msg_pending_count - 1].msgID : -1;
+    for (size_t i = 0; i < count; i++) {
+        if ((int)msgs[i].msgID != last_id) slots++;
+        last_id = msgs[i].msgID;
+    }
+    return slots;
 }
 
+bool rmt_app_send_messages(const rmt_app_message_t *msgs, size_t count) {
+    bool queued = true;
+    bool acked = false;
+    portENTER_CRITICAL(&g_msg_lock);
+    g_msg_stats.received += count;
+    if (g_msg_pending_count + rmt_app_slots_needed(msgs, count) > RMT_APP_MAX_QUEUE_SIZE) {
+        // Drop the whole batch so it's never applied partially
+        g_msg_stats.dropped += count;
+        queued = false;
+    } else {
+        const int64_t queued_us = esp_timer_get_time();
+        for (size_t i = 0; i < count; i++) {
+            rmt_app_message_t msg = msgs[i];
+            if (msg.trace.recv_us != 0) msg.trace.queued_us = queued_us;
+            if (rmt_app_merge_message(&msg, &acked)) g_msg_stats.merged++;
+            else g_msg_pending[g_msg_pending_count++] = msg;
+        }
+    }
+    portEXIT_CRITICAL(&g_msg_lock);
 
-void rmt_app_send_message(rmt_app_msg_e msgID) {
-    rmt_app_message_t msg = {.msgID = msgID};
-    xQueueSend(rmt_app_message_queue_handle, &msg, portMAX_DELAY);
+    if (acked) latency_trace_notify();
+    if (!queued) ESP_LOGW(TAG, "RMT message queue is full, %d message(s) dropped", (int)count);
+    return queued;
 }
 
+bool rmt_app_schedule_messages(const rmt_app_message_t *msgs, size_t count, int64_t due_us) {
+    const int64_t now_us = esp_timer_get_time();
+    if (due_us <= now_us) {
+        portENTER_CRITICAL(&g_msg_lock);
+        g_msg_stats.late += count;
+        portEXIT_CRITICAL(&g_msg_lock);
+        ESP_LOGW(TAG, "Scheduled command arrived %lld ms late, applying it right away", (now_us - due_us) / 1000);
+        return rmt_app_send_messages(msgs, count);
+    }
+
+    if (due_us - now_us > (int64_t)RMT_APP_SCHEDULE_MAX_AHEAD_MS * 1000) {
+        portENTER_CRITICAL(&g_msg_lock);
+        g_msg_stats.received += count;
+        g_msg_stats.dropped += count;
+        portEXIT_CRITICAL(&g_msg_lock);
+        ESP_LOGE(TAG, "Scheduled command is %lld ms ahead, the limit is %d ms", (due_us - now_us) / 1000, RMT_APP_SCHEDULE_MAX_AHEAD_MS);
+        return false;
+    }
+
+    bool queued = true;
+    portENTER_CRITICAL(&g_msg_lock);
+    g_msg_stats.received += count;
+    if (g_msg_scheduled_count + count > RMT_APP_MAX_SCHEDULED) {
+        g_msg_stats.dropped += count;
+        queued = false;
+    } else {
+        // Insert after every entry due at the same time so the send order is kept
+        size_t pos = g_msg_scheduled_count;
+        while (pos > 0 && g_msg_scheduled[pos - 1].due_us > due_us) pos--;
+        memmove(g_msg_scheduled + pos + count, g_msg_scheduled + pos, (g_msg_scheduled_count - pos) * sizeof(rmt_app_scheduled_msg_t));
+        for (size_t i = 0; i < count; i++) {
+            rmt_app_scheduled_msg_t *entry = &g_msg_scheduled[pos + i];
+            entry->due_us = due_us;
+            entry->msg = msgs[i];
+            if (entry->msg.trace.recv_us != 0) entry->msg.trace.queued_us = now_us;
+        }
+        g_msg_scheduled_count += count;
+        g_msg_stats.scheduled += count;
+    }
+    portEXIT_CRITICAL(&g_msg_lock);
+
+    if (!queued) ESP_LOGW(TAG, "RMT schedule is full, %d message(s) dropped", (int)count);
+    return queued;
+}
+
+bool rmt_app_send_message(rmt_app_msg_e msgID) {
+    const rmt_app_message_t msg = {.msgID = msgID, .cycles = 1};
+    return rmt_app_send_messages(&msg, 1);
+}
+
+void rmt_app_set_state_listener(TaskHandle_t task) {
+    xSemaphoreTake(g_state_write_mutex, portMAX_DELAY);
+    g_state_listener = task;
+    xSemaphoreGive(g_state_write_mutex);
+}
+
+rmt_app_msg_stats_t rmt_app_get_msg_stats(void) {
+    portENTER_CRITICAL(&g_msg_lock);
+    const rmt_app_msg_stats_t stats = g_msg_stats;
+    portEXIT_CRITICAL(&g_msg_lock);
+    return stats;
+}
 
 void rmt_app_set_rgb_color(uint8_t r, uint8_t g, uint8_t b) {
-    g_red_value = r;
-    g_green_value = g;
-    g_blue_value = b;
-    rmt_app_save_config_to_flash();
+    const rmt_app_message_t msg = {
+        .msgID = RMT_APP_MSG_SET_COLOR,
+        .colors = {.red = r, .green = g, .blue = b}
+    };
+    rmt_app_send_messages(&msg, 1);
 }
 
-void rmt_app_set_from_json(cJSON *json) {
-    const cJSON *state = cJSON_GetObjectItemCaseSensitive(json, "state");
-    if (state == NULL || !cJSON_IsNumber(state) || state->valueint < 0 || state->valueint > 1)
+/**
+ * Converts a decoded state change to messages
+ * @param step state change
+ * @param msgs output messages, up to JSON_CMD_MAX_STEP_MSGS are added
+ * @param count number of messages in msgs, updated
+ * @param require_all log missing fields as errors too, except the mode of a step turning the LED off
+ * @return false if a field is missing (with require_all) or invalid
+ */
+static bool rmt_app_step_to_messages(const json_cmd_step_t *step, rmt_app_message_t *msgs, size_t *count, bool require_all) {
+    bool valid = true;
+    if (step->fields & JSON_CMD_FIELD_STATE && step->state >= 0 && step->state <= 1)
+        msgs[(*count)++] = (rmt_app_message_t){.msgID = RMT_APP_MSG_SET_STATE, .state = step->state};
+    else if (require_all || step->fields & JSON_CMD_FIELD_STATE || step->invalid & JSON_CMD_FIELD_STATE) {
         ESP_LOGE(TAG, "Missing or invalid state provided by JSON!");
-    else g_rmt_app_state = state->valueint;
-
-    // Check if LED was turned off
-    if (g_rmt_app_state == RMT_APP_LED_OFF) return;
+        valid = false;
+    }
 
-    const cJSON *mode = cJSON_GetObjectItemCaseSensitive(json, "mode");
-    if (mode == NULL || !cJSON_IsNumber(mode) || mode->valueint < 0 || mode->valueint > RMT_APP_LED_MODES_COUNT - 1)
+    // The mode is ignored while the LED is off, so a command turning it off doesn't need one
+    const bool turns_off = step->fields & JSON_CMD_FIELD_STATE && step->state == RMT_APP_LED_OFF;
+    if (step->fields & JSON_CMD_FIELD_MODE && step->mode >= 0 && step->mode < RMT_APP_LED_MODES_COUNT)
+        msgs[(*count)++] = (rmt_app_message_t){.msgID = RMT_APP_MSG_SET_MODE, .mode = step->mode};
+    else if ((require_all && !turns_off) || step->fields & JSON_CMD_FIELD_MODE || step->invalid & JSON_CMD_FIELD_MODE) {
         ESP_LOGE(TAG, "Missing or invalid mode provided by JSON!");
-    else g_rmt_app_sel_mode = mode->valueint;
+        valid = false;
+    }
 
-    // Check if LED mode was set rainbow
-    if (g_rmt_app_sel_mode == RMT_APP_LED_MODE_RAINBOW) return;
+    const json_cmd_color_t *color = &step->color;
+    if (step->fields & JSON_CMD_FIELD_COLOR &&
+        color->red >= 0 && color->red <= 255 && color->green >= 0 && color->green <= 255 && color->blue >= 0 && color->blue <= 255)
+        msgs[(*count)++] = (rmt_app_message_t){
+            .msgID = RMT_APP_MSG_SET_COLOR,
+            .colors = {.red = color->red, .green = color->green, .blue = color->blue}
+        };
+    else if (step->fields & JSON_CMD_FIELD_COLOR || step->invalid & JSON_CMD_FIELD_COLOR) {
+        ESP_LOGE(TAG, "Missing or invalid color values provided by JSON!");
+        valid = false;
+    }
 
-    const cJSON *color_json = cJSON_GetObjectItemCaseSensitive(json, "color");
-    if (color_json == NULL) {
-        ESP_LOGE(TAG, "Missing or invalid color object provided by JSON!");
-        return;
+    if (step->fields & JSON_CMD_FIELD_BRIGHTNESS && step->brightness >= 0 && step->brightness <= 255)
+        msgs[(*count)++] = (rmt_app_message_t){.msgID = RMT_APP_MSG_SET_BRIGHTNESS, .brightness = step->brightness};
+    else if (step->fields & JSON_CMD_FIELD_BRIGHTNESS || step->invalid & JSON_CMD_FIELD_BRIGHTNESS) {
+        ESP_LOGE(TAG, "Invalid brightness provided by JSON, expected 0 to 255!");
+        valid = false;
     }
+    return valid;
+}
 
-    const cJSON *red = cJSON_GetObjectItemCaseSensitive(color_json, "red");
-    if (red == NULL || !cJSON_IsNumber(red) || red->valueint < 0 || red->valueint > 255)
-        ESP_LOGE(TAG, "Missing or invalid red value provided by JSON!");
-    else g_red_value = red->valueint;
+// Every "apply_at" accepted by the parsers can be converted without overflowing
+_Static_assert(JSON_CMD_MAX_APPLY_AT_MS <= TIME_SYNC_MAX_WALL_MS, "JSON_CMD_MAX_APPLY_AT_MS exceeds the time_sync range");
 
-    const cJSON *green = cJSON_GetObjectItemCaseSensitive(color_json, "green");
-    if (green == NULL || !cJSON_IsNumber(green) || green->valueint < 0 || green->valueint > 255)
-        ESP_LOGE(TAG, "Missing or invalid green value provided by JSON!");
-    else g_green_value = green->valueint;
+// A batch is queued at once, the largest one has to fit an empty queue
+_Static_assert(JSON_CMD_MAX_BATCH * JSON_CMD_MAX_STEP_MSGS <= RMT_APP_MAX_QUEUE_SIZE, "JSON_CMD_MAX_BATCH exceeds the rmt_app queue");
 
-    const cJSON *blue = cJSON_GetObjectItemCaseSensitive(color_json, "blue");
-    if (blue == NULL || !cJSON_IsNumber(blue) || blue->valueint < 0 || blue->valueint > 255)
-        ESP_LOGE(TAG, "Missing or invalid blue value provided by JSON!");
-    else g_blue_value = blue->valueint;
+rmt_app_cmd_result_e rmt_app_set_from_command(const json_cmd_t *cmd, const latency_trace_t *trace, bool strict) {
+    rmt_app_message_t msgs[RMT_APP_MAX_QUEUE_SIZE];
+    size_t count = 0;
+    bool valid = true;
+
+    if (cmd->fields & JSON_CMD_FIELD_COMMANDS || cmd->invalid & JSON_CMD_FIELD_COMMANDS) {
+        // A batch is validated in full and applied on one frame, or not at all
+        if (cmd->invalid & JSON_CMD_FIELD_COMMANDS) {
+            ESP_LOGE(TAG, "Invalid \"commands\" array, at most %d objects are allowed!", JSON_CMD_MAX_BATCH);
+            return RMT_APP_CMD_INVALID;
+        }
+        if (cmd->step.fields || cmd->step.invalid) {
+            ESP_LOGE(TAG, "State, mode, color or brightness next to \"commands\" is ambiguous, the batch is rejected!");
+            return RMT_APP_CMD_INVALID;
+        }
+        for (size_t i = 0; i < cmd->batch_count; i++) {
+            if (!rmt_app_step_to_messages(&cmd->batch[i], msgs, &count, false)) {
+                ESP_LOGE(TAG, "Command %d of the batch is invalid, the batch is rejected!", (int)i);
+                return RMT_APP_CMD_INVALID;
+            }
+        }
+    } else {
+        valid = rmt_app_step_to_messages(&cmd->step, msgs, &count, !strict);
+        if (strict && !valid) return RMT_APP_CMD_INVALID;
+    }
+
+    if (count == 0) return RMT_APP_CMD_INVALID;
+
+    // The trace follows the last message, which is the one applied last
+    if (trace != NULL) msgs[count - 1].trace = *trace;
+
+    // Applying a change meant for later right away would be worse than dropping it
+    if (cmd->invalid & JSON_CMD_FIELD_APPLY_AT) {
+        ESP_LOGE(TAG, "Invalid \"apply_at\", expected Unix time in ms up to %lld!", JSON_CMD_MAX_APPLY_AT_MS);
+        return RMT_APP_CMD_INVALID;
+    }
+
+    bool queued;
+    int64_t due_us;
+    if (cmd->fields & JSON_CMD_FIELD_APPLY_AT && time_sync_is_synced()) {
+        if (!time_sync_wall_to_local_us(cmd->apply_at_ms, &due_us)) return RMT_APP_CMD_INVALID;
+        if (due_us - esp_timer_get_time() > (int64_t)RMT_APP_SCHEDULE_MAX_AHEAD_MS * 1000) valid = false;
+        queued = rmt_app_schedule_messages(msgs, count, due_us);
+    } else {
+        if (cmd->fields & JSON_CMD_FIELD_APPLY_AT) ESP_LOGW(TAG, "Wall clock is not synchronized yet, \"apply_at\" is ignored");
+        queued = rmt_app_send_messages(msgs, count);
+    }
+    if (!valid) return RMT_APP_CMD_INVALID;
+    return queued ? RMT_APP_CMD_OK : RMT_APP_CMD_QUEUE_FULL;
 }
 
-rmt_app_active_config_t rmt_app_get_active_config() {
-    const rmt_app_active_config_t active_config = {
-    .state = g_rmt_app_state,
-    .mode = g_rmt_app_sel_mode,
-    .colors = {
-        .red = g_red_value,
-        .green = g_green_value,
-        .blue = g_blue_value
+/**
+ * Copies a slice of an RGB frame into a GRB buffer. Bytes beyond the strip are ignored.
+ */
+static void rmt_app_pixels_copy(uint8_t *grb, size_t offset, const uint8_t *rgb, size_t len) {
+    // RGB byte order on the wire, GRB on the strip
+    static const uint8_t grb_index[3] = {1, 0, 2};
+    for (size_t i = 0; i < len && offset + i < RMT_APP_LED_NUMBERS * 3; i++) {
+        const size_t pos = offset + i;
+        grb[pos - pos % 3 + grb_index[pos % 3]] = rgb[i];
     }
-    };
+}
+
+/**
+ * Selects the pixels mode for the frame which was just published
+ */
+static void rmt_app_pixels_select(const latency_trace_t *trace) {
+    rmt_app_message_t msg = {.msgID = RMT_APP_MSG_SET_MODE, .mode = RMT_APP_LED_MODE_PIXELS};
+    if (trace != NULL) msg.trace = *trace;
+    rmt_app_send_messages(&msg, 1);
+}
+
+void rmt_app_pixels_write(size_t offset, const uint8_t *rgb, size_t len) {
+    rmt_app_pixels_copy(g_pixels_back, offset, rgb, len);
+}
+
+void rmt_app_pixels_commit(const latency_trace_t *trace) {
+    taskENTER_CRITICAL(&g_pixels_write_lock);
+    seqlock_write_begin(&g_pixels_lock);
+    memcpy(g_pixels_front, g_pixels_back, sizeof(g_pixels_front));
+    g_pixels_frame++;
+    seqlock_write_end(&g_pixels_lock);
+    taskEXIT_CRITICAL(&g_pixels_write_lock);
+    rmt_app_pixels_select(trace);
+}
+
+void rmt_app_pixels_show(const uint8_t *rgb, size_t len, const latency_trace_t *trace) {
+    taskENTER_CRITICAL(&g_pixels_write_lock);
+    seqlock_write_begin(&g_pixels_lock);
+    rmt_app_pixels_copy(g_pixels_front, 0, rgb, len);
+    g_pixels_frame++;
+    seqlock_write_end(&g_pixels_lock);
+    taskEXIT_CRITICAL(&g_pixels_write_lock);
+    rmt_app_pixels_select(trace);
+}
+
+rmt_app_active_config_t rmt_app_get_active_config() {
+    rmt_app_active_config_t active_config;
+    uint32_t seq;
+    do {
+        seq = seqlock_read_begin(&g_state_lock);
+        active_config = g_state;
+    } while (seqlock_read_retry(&g_state_lock, seq));
 
     return active_config;
 }
@@ -5,9 +5,13 @@
 #ifndef RMT_APP_H
 #define RMT_APP_H
 
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
 #include "driver/rmt_tx.h"
-#include "cjson/cJSON.h"
 #include "driver/rmt_encoder.h"
+#include "audio_app/audio_dsp.h"
+#include "latency_trace/latency_trace.h"
+#include "json_cmd/json_cmd.h"
 
 #define RMT_APP_SRC_CLK                       RMT_CLK_SRC_DEFAULT
 #define RMT_APP_LED_GPIO_NUM                  27
@@ -17,8 +21,14 @@
 
 #define RMT_APP_LED_NUMBERS                   30
 #define RMT_APP_LED_CHASE_SPEED               10
+#define RMT_APP_RAINBOW_SPEED_DEG_PER_S       1000
 
-#define RMT_APP_MAX_QUEUE_SIZE                3
+#define RMT_APP_MAX_QUEUE_SIZE                20
+#define RMT_APP_MAX_SCHEDULED                 16
+#define RMT_APP_SCHEDULE_MAX_AHEAD_MS         60000
+
+#define RMT_APP_ANIM_FILE_PATH                "/spiffs/anim.lanm"
+#define RMT_APP_ANIM_RETRY_MS                 1000
 
 /**
  * ON / OFF States
@@ -31,10 +41,13 @@ typedef enum {
 /**
  * Types of LED strip modes
  */
-#define RMT_APP_LED_MODES_COUNT               2
+#define RMT_APP_LED_MODES_COUNT               5
 typedef enum {
     RMT_APP_LED_MODE_RAINBOW,
-    RMT_APP_LED_MODE_STATIC
+    RMT_APP_LED_MODE_STATIC,
+    RMT_APP_LED_MODE_ANIMATION,
+    RMT_APP_LED_MODE_AUDIO,
+    RMT_APP_LED_MODE_PIXELS    // Frames streamed by the client
 } rmt_app_mode_e;
 
 /**
@@ -42,16 +55,13 @@ typedef enum {
  */
 typedef enum {
     RMT_APP_MSG_TOGGLE_LED,
-    RMT_APP_MSG_CYCLE_MODE
+    RMT_APP_MSG_CYCLE_MODE,
+    RMT_APP_MSG_SET_STATE,
+    RMT_APP_MSG_SET_MODE,
+    RMT_APP_MSG_SET_COLOR,
+    RMT_APP_MSG_SET_BRIGHTNESS
 } rmt_app_msg_e;
 
-/**
- * RMT Application message structure
- */
-typedef struct {
-    rmt_app_msg_e msgID;
-} rmt_app_message_t;
-
 /**
  * Transmit configuration suitable when using hue value
  */
@@ -72,24 +82,110 @@ typedef struct {
 } rmt_app_transmit_config_t;
 
 /**
- * Structure containing the current active RMT configuration
+ * RMT Application message structure
+ */
+typedef struct {
+    rmt_app_msg_e msgID;
+    union {
+        uint8_t cycles;                     // RMT_APP_MSG_CYCLE_MODE, filled in when merging
+        rmt_app_state_e state;              // RMT_APP_MSG_SET_STATE
+        rmt_app_mode_e mode;                // RMT_APP_MSG_SET_MODE
+        rmt_app_transmit_config_t colors;   // RMT_APP_MSG_SET_COLOR
+        uint8_t brightness;                 // RMT_APP_MSG_SET_BRIGHTNESS
+    };
+    latency_trace_t trace;
+} rmt_app_message_t;
+
+/**
+ * Message held back until its due time
+ */
+typedef struct {
+    int64_t due_us;  // esp_timer time base
+    rmt_app_message_t msg;
+} rmt_app_scheduled_msg_t;
+
+/**
+ * Message channel counters
+ */
+typedef struct {
+    uint32_t received;
+    uint32_t merged;
+    uint32_t dropped;
+    uint32_t scheduled;
+    uint32_t late;                  // Scheduled messages which arrived after their due time
+    uint32_t max_schedule_error_us; // Largest delay between the due time and the frame applying it
+} rmt_app_msg_stats_t;
+
+/**
+ * Structure containing the current active RMT configuration.
+ * Every published change gets a new version.
  */
 typedef struct {
+  uint32_t version;
   rmt_app_state_e state;
   rmt_app_mode_e mode;
   rmt_app_transmit_config_t colors;
+  uint8_t brightness;  // Scale of every transmitted frame, 255 leaves the pixels as rendered
 } rmt_app_active_config_t;
 
+/**
+ * Parameters fed to the active effect on every frame
+ */
+typedef struct {
+  rmt_app_active_config_t config;
+  bool changed;  // config differs from the one of the previous frame
+  bool audio_valid;
+  audio_dsp_bands_t audio;
+} rmt_app_effect_params_t;
+
+/**
+ * Effect pipeline entry. Effects are indexed by rmt_app_mode_e.
+ */
+typedef struct {
+  const char *name;
+  void (*render)(const rmt_app_effect_params_t *params);
+} rmt_app_effect_t;
+
 /**
  * Initialized the rmt application
  */
 void rmt_app_start(void);
 
 /**
- * Sends message to the RMT Application message queue
+ * Sends message to the RMT Application message queue. Never blocks.
  * @param msgID rmt_app_msg_e (RMT Application message ID)
+ * @return false if the message was dropped because the queue is full
+ */
+bool rmt_app_send_message(rmt_app_msg_e msgID);
+
+/**
+ * Sends messages which should be applied together on the same frame. Never blocks.
+ * @param msgs messages in the order they should be applied
+ * @param count number of messages
+ * @return false if the messages were dropped because the queue is full
+ */
+bool rmt_app_send_messages(const rmt_app_message_t *msgs, size_t count);
+
+/**
+ * Schedules messages which should be applied together on the first frame starting at or after the due time. Never blocks.
+ * Messages which are already due are sent right away.
+ * @param msgs messages in the order they should be applied
+ * @param count number of messages
+ * @param due_us due time in the esp_timer time base
+ * @return false if the messages were dropped because the schedule is full or the due time is too far ahead
+ */
+bool rmt_app_schedule_messages(const rmt_app_message_t *msgs, size_t count, int64_t due_us);
+
+/**
+ * Sets the task which is notified whenever a new state version is published
+ * @param task task handle or NULL
+ */
+void rmt_app_set_state_listener(TaskHandle_t task);
+
+/**
+ * Gets the message channel counters
  */
-void rmt_app_send_message(rmt_app_msg_e msgID);
+rmt_app_msg_stats_t rmt_app_get_msg_stats(void);
 
 /**
  * Sets the RGB values
@@ -100,13 +196,54 @@ void rmt_app_send_message(rmt_app_msg_e msgID);
 void rmt_app_set_rgb_color(uint8_t r, uint8_t g, uint8_t b);
 
 /**
- * Configure the RMT Application using JSON object
- * @param json pointer to cJSON object
+ * Outcome of applying a decoded command
+ */
+typedef enum {
+    RMT_APP_CMD_OK,
+    RMT_APP_CMD_INVALID,      // A field is missing or out of range, or the due time is too far ahead
+    RMT_APP_CMD_QUEUE_FULL,   // Valid, but dropped because the queue or the schedule is full
+} rmt_app_cmd_result_e;
+
+/**
+ * Configure the RMT Application using a decoded command.
+ * A "commands" array is validated in full and applied as one state version, or rejected as a whole.
+ * An optional "apply_at" field (Unix time in ms) schedules the change on the synchronized wall clock.
+ * By default a single command needs state and mode (only state if it turns the LED off), and its valid fields
+ * are applied even if others are invalid.
+ * A strict command may leave any field out, which keeps its pending value, and is rejected as a whole if one is invalid.
+ * @param cmd command decoded by json_cmd_parse()
+ * @param trace latency trace started when the command was received or NULL
+ * @param strict partial update which is applied completely or not at all
+ * @return RMT_APP_CMD_OK if every field was valid and the messages were queued
+ */
+rmt_app_cmd_result_e rmt_app_set_from_command(const json_cmd_t *cmd, const latency_trace_t *trace, bool strict);
+
+/**
+ * Writes a slice of a raw RGB frame into the back buffer. Bytes beyond the strip are ignored.
+ * Must only be called from one task at a time, together with rmt_app_pixels_commit().
+ * @param offset byte offset of the slice within the RGB frame
+ * @param rgb slice data
+ * @param len length of the slice
+ */
+void rmt_app_pixels_write(size_t offset, const uint8_t *rgb, size_t len);
+
+/**
+ * Publishes the back buffer as the next streamed frame and selects the pixels mode
+ * @param trace latency trace started when the frame was received or NULL
+ */
+void rmt_app_pixels_commit(const latency_trace_t *trace);
+
+/**
+ * Publishes a whole RGB frame as the next streamed frame without going through the back buffer,
+ * so it can be called from any task while another one streams slices. LEDs beyond len keep their color.
+ * @param rgb frame data
+ * @param len length of the frame
+ * @param trace latency trace started when the frame was received or NULL
  */
-void rmt_app_set_from_json(cJSON *json);
+void rmt_app_pixels_show(const uint8_t *rgb, size_t len, const latency_trace_t *trace);
 
 /**
- * Gets the current active RMT configuration
+ * Gets a consistent snapshot of the current active RMT configuration without taking any locks
  * @return rmt_app_active_config_t structure
  */
 rmt_app_active_config_t rmt_app_get_active_config();
@@ -0,0 +1,265 @@
+//
+// Created by kok on 19.10.26.
+//
+
+#include <stddef.h>
+#include <string.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "esp_log.h"
+#include "esp_system.h"
+#include "esp_rom_crc.h"
+#include "nvs.h"
+
+#include "tasks_common.h"
+#include "rmt_store.h"
+
+static const char TAG[] = "rmt_store";
+static const char NVS_NAMESPACE[] = "rmt_app";
+
+static TaskHandle_t g_store_task_handle = NULL;
+static SemaphoreHandle_t g_write_mutex = NULL;
+
+static portMUX_TYPE g_pending_lock = portMUX_INITIALIZER_UNLOCKED;
+static rmt_store_blob_t g_pending;
+static bool g_dirty = false;
+static rmt_store_stats_t g_stats;    // Updated by the store task and every task applying state, guarded by g_pending_lock
+
+static uint32_t g_interval_ms = RMT_STORE_DEFAULT_INTERVAL_MS;
+
+/**
+ * Blob written before the brightness was stored, it is read as full brightness
+ */
+typedef struct __attribute__((packed)) {
+    uint8_t version;
+    uint8_t state;
+    uint8_t mode;
+    uint8_t red;
+    uint8_t green;
+    uint8_t blue;
+    uint32_t crc;
+} rmt_store_blob_v1_t;
+
+// --------- NVS STORAGE --------- //
+
+static void rmt_store_count_failure(void) {
+    portENTER_CRITICAL(&g_pending_lock);
+    g_stats.failures++;
+    portEXIT_CRITICAL(&g_pending_lock);
+}
+
+static uint32_t rmt_store_blob_crc(const rmt_store_blob_t *blob) {
+    return esp_rom_crc32_le(0, (const uint8_t*)blob, offsetof(rmt_store_blob_t, crc));
+}
+
+/**
+ * Writes the blob with a single NVS commit
+ */
+static esp_err_t rmt_store_write_blob(rmt_store_blob_t *blob) {
+    blob->crc = rmt_store_blob_crc(blob);
+
+    nvs_handle_t nvs_handle;
+    esp_err_t err = nvs_open(NVS_NAMESPACE, NVS_READWRITE, &nvs_handle);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to open NVS in order to save LED state! %s", esp_err_to_name(err));
+        rmt_store_count_failure();
+        return err;
+    }
+
+    err = nvs_set_blob(nvs_handle, RMT_STORE_BLOB_KEY, blob, sizeof(rmt_store_blob_t));
+    if (err == ESP_OK) err = nvs_commit(nvs_handle);
+    nvs_close(nvs_handle);
+
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to save LED state to NVS: %s", esp_err_to_name(err));
+        rmt_store_count_failure();
+        return err;
+    }
+
+    portENTER_CRITICAL(&g_pending_lock);
+    const rmt_store_stats_t stats = {.commits = ++g_stats.commits, .marks = g_stats.marks};
+    portEXIT_CRITICAL(&g_pending_lock);
+    ESP_LOGI(TAG, "LED state saved (%lu commits for %lu state changes)", stats.commits, stats.marks);
+    return ESP_OK;
+}
+
+/**
+ * Reads the per-field keys written by older firmware and removes them once the blob is committed.
+ * The keys are kept if the blob can't be written, so the migration is retried on the next boot.
+ */
+static esp_err_t rmt_store_load_legacy(nvs_handle_t nvs_handle, rmt_store_blob_t *blob) {
+    esp_err_t err = nvs_get_u8(nvs_handle, "state", &blob->state);
+    if (err == ESP_OK) err = nvs_get_u8(nvs_handle, "mode", &blob->mode);
+    if (err == ESP_OK) err = nvs_get_u8(nvs_handle, "red", &blob->red);
+    if (err == ESP_OK) err = nvs_get_u8(nvs_handle, "green", &blob->green);
+    if (err == ESP_OK) err = nvs_get_u8(nvs_handle, "blue", &blob->blue);
+    if (err != ESP_OK) return err;
+    blob->brightness = 255;
+
+    ESP_LOGI(TAG, "Migrating legacy LED state keys");
+    blob->version = RMT_STORE_BLOB_VERSION;
+    blob->crc = rmt_store_blob_crc(blob);
+    err = nvs_set_blob(nvs_handle, RMT_STORE_BLOB_KEY, blob, sizeof(rmt_store_blob_t));
+    if (err == ESP_OK) err = nvs_commit(nvs_handle);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to migrate legacy LED state, the old keys are kept: %s", esp_err_to_name(err));
+        return ESP_OK;
+    }
+
+    nvs_erase_key(nvs_handle, "state");
+    nvs_erase_key(nvs_handle, "mode");
+    nvs_erase_key(nvs_handle, "red");
+    nvs_erase_key(nvs_handle, "green");
+    nvs_erase_key(nvs_handle, "blue");
+    err = nvs_commit(nvs_handle);
+    if (err != ESP_OK) ESP_LOGE(TAG, "Failed to erase the legacy LED state keys: %s", esp_err_to_name(err));
+    return ESP_OK;
+}
+
+/**
+ * Converts a version 1 blob read into the start of the current one. It is rewritten with the next state change.
+ */
+static esp_err_t rmt_store_upgrade_v1(rmt_store_blob_t *blob) {
+    rmt_store_blob_v1_t v1;
+    memcpy(&v1, blob, sizeof(v1));
+    if (v1.crc != esp_rom_crc32_le(0, (const uint8_t*)&v1, offsetof(rmt_store_blob_v1_t, crc))) return ESP_ERR_INVALID_CRC;
+    blob->brightness = 255;
+    blob->version = RMT_STORE_BLOB_VERSION;
+    blob->crc = rmt_store_blob_crc(blob);
+    return ESP_OK;
+}
+
+/**
+ * Writes the pending state if it is dirty. A state which failed to be written stays dirty, unless a newer one replaced it.
+ * @return true if a write was attempted
+ */
+static bool rmt_store_write_pending(void) {
+    xSemaphoreTake(g_write_mutex, portMAX_DELAY);
+
+    portENTER_CRITICAL(&g_pending_lock);
+    const bool dirty = g_dirty;
+    rmt_store_blob_t blob = g_pending;
+    g_dirty = false;
+    portEXIT_CRITICAL(&g_pending_lock);
+
+    if (dirty && rmt_store_write_blob(&blob) != ESP_OK) {
+        portENTER_CRITICAL(&g_pending_lock);
+        g_dirty = true;
+        portEXIT_CRITICAL(&g_pending_lock);
+    }
+
+    xSemaphoreGive(g_write_mutex);
+    return dirty;
+}
+
+// --------- WRITE-BEHIND TASK --------- //
+
+/**
+ * Waits for dirty state and writes it at most once per interval
+ */
+static void rmt_store_task(void *pvParams) {
+    TickType_t last_commit = xTaskGetTickCount() - pdMS_TO_TICKS(g_interval_ms);
+    while (1) {
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+
+        // Changes arriving during the hold back are coalesced into the same commit
+        const TickType_t interval = pdMS_TO_TICKS(g_interval_ms);
+        const TickType_t elapsed = xTaskGetTickCount() - last_commit;
+        if (elapsed < interval) vTaskDelay(interval - elapsed);
+
+        if (rmt_store_write_pending()) last_commit = xTaskGetTickCount();
+
+        // Retried after the next interval if the write failed
+        portENTER_CRITICAL(&g_pending_lock);
+        const bool retry = g_dirty;
+        portEXIT_CRITICAL(&g_pending_lock);
+        if (retry) xTaskNotifyGive(g_store_task_handle);
+    }
+}
+
+// --------- PUBLIC METHODS --------- //
+
+esp_err_t rmt_store_load(rmt_app_active_config_t *config) {
+    ESP_LOGI(TAG, "Fetching LED state from NVS...");
+    nvs_handle_t nvs_handle;
+    esp_err_t err = nvs_open(NVS_NAMESPACE, NVS_READWRITE, &nvs_handle);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to open NVS in order to load LED state! %s", esp_err_to_name(err));
+        return err;
+    }
+
+    rmt_store_blob_t blob;
+    size_t blob_size = sizeof(blob);
+    err = nvs_get_blob(nvs_handle, RMT_STORE_BLOB_KEY, &blob, &blob_size);
+    if (err == ESP_ERR_NVS_NOT_FOUND) err = rmt_store_load_legacy(nvs_handle, &blob);
+    else if (err == ESP_OK && blob_size == sizeof(rmt_store_blob_v1_t) && blob.version == 1) err = rmt_store_upgrade_v1(&blob);
+    else if (err == ESP_OK && (blob_size != sizeof(blob) || blob.version != RMT_STORE_BLOB_VERSION)) err = ESP_ERR_INVALID_VERSION;
+    else if (err == ESP_OK && blob.crc != rmt_store_blob_crc(&blob)) err = ESP_ERR_INVALID_CRC;
+    nvs_close(nvs_handle);
+
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "No valid LED state in NVS: %s", esp_err_to_name(err));
+        return err;
+    }
+
+    config->state = blob.state == RMT_APP_LED_ON ? RMT_APP_LED_ON : RMT_APP_LED_OFF;
+    if (blob.mode < RMT_APP_LED_MODES_COUNT) config->mode = blob.mode;
+    config->colors.red = blob.red;
+    config->colors.green = blob.green;
+    config->colors.blue = blob.blue;
+    config->brightness = blob.brightness;
+    return ESP_OK;
+}
+
+void rmt_store_start(void) {
+    g_write_mutex = xSemaphoreCreateMutex();
+
+    xTaskCreatePinnedToCore(
+        &rmt_store_task,
+        "rmt_store_task",
+        RMT_STORE_TASK_STACK_SIZE,
+        NULL,
+        RMT_STORE_TASK_PRIORITY,
+        &g_store_task_handle,
+        RMT_STORE_TASK_CORE_ID
+    );
+
+    // Don't lose a pending change on esp_restart()
+    const esp_err_t err = esp_register_shutdown_handler(rmt_store_flush);
+    if (err != ESP_OK) ESP_LOGE(TAG, "Failed to register shutdown handler: %s", esp_err_to_name(err));
+}
+
+void rmt_store_mark_dirty(const rmt_app_active_config_t *config) {
+    portENTER_CRITICAL(&g_pending_lock);
+    g_pending = (rmt_store_blob_t){
+        .version = RMT_STORE_BLOB_VERSION,
+        .state = config->state,
+        .mode = config->mode,
+        .red = config->colors.red,
+        .green = config->colors.green,
+        .blue = config->colors.blue,
+        .brightness = config->brightness,
+    };
+    g_dirty = true;
+    g_stats.marks++;
+    portEXIT_CRITICAL(&g_pending_lock);
+
+    if (g_store_task_handle != NULL) xTaskNotifyGive(g_store_task_handle);
+}
+
+void rmt_store_flush(void) {
+    if (g_write_mutex == NULL) return;
+    rmt_store_write_pending();
+}
+
+void rmt_store_set_interval(uint32_t interval_ms) {
+    g_interval_ms = interval_ms;
+}
+
+rmt_store_stats_t rmt_store_get_stats(void) {
+    portENTER_CRITICAL(&g_pending_lock);
+    const rmt_store_stats_t stats = g_stats;
+    portEXIT_CRITICAL(&g_pending_lock);
+    return stats;
+}
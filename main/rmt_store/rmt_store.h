@@ -0,0 +1,73 @@
+//
+// Created by kok on 19.10.26.
+//
+
+#ifndef RMT_STORE_H
+#define RMT_STORE_H
+
+#include "esp_err.h"
+
+#include "rmt/rmt_app.h"
+
+#define RMT_STORE_BLOB_KEY                  "led_state"
+#define RMT_STORE_BLOB_VERSION              2
+#define RMT_STORE_DEFAULT_INTERVAL_MS       5000
+
+/**
+ * Persisted LED state. The CRC covers every field before it.
+ */
+typedef struct __attribute__((packed)) {
+    uint8_t version;
+    uint8_t state;
+    uint8_t mode;
+    uint8_t red;
+    uint8_t green;
+    uint8_t blue;
+    uint8_t brightness;
+    uint32_t crc;
+} rmt_store_blob_t;
+
+/**
+ * Persistence counters
+ */
+typedef struct {
+    uint32_t marks;      // State changes handed to the store
+    uint32_t commits;    // NVS commits actually performed
+    uint32_t failures;
+} rmt_store_stats_t;
+
+/**
+ * Loads the persisted LED state. Migrates the legacy per-field keys if no blob exists yet.
+ * @param config configuration which is updated with the stored values
+ * @return ESP_OK if a valid state was found
+ */
+esp_err_t rmt_store_load(rmt_app_active_config_t *config);
+
+/**
+ * Starts the write-behind task and registers the shutdown flush
+ */
+void rmt_store_start(void);
+
+/**
+ * Marks the state as dirty. It is written at most once per interval.
+ * @param config state which should be persisted
+ */
+void rmt_store_mark_dirty(const rmt_app_active_config_t *config);
+
+/**
+ * Writes the pending state immediately if there is one
+ */
+void rmt_store_flush(void);
+
+/**
+ * Sets the minimum interval between two NVS commits
+ * @param interval_ms interval in milliseconds
+ */
+void rmt_store_set_interval(uint32_t interval_ms);
+
+/**
+ * Gets the persistence counters
+ */
+rmt_store_stats_t rmt_store_get_stats(void);
+
+#endif //RMT_STORE_H
@@ -0,0 +1,66 @@
+//
+// Created by kok on 19.10.26.
+//
+
+#ifndef SEQLOCK_H
+#define SEQLOCK_H
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+#define SEQLOCK_SPIN_LIMIT              64   // Spins before a reader sleeps to let a preempted writer finish
+
+/**
+ * Sequence lock for publishing small structures across cores.
+ * Readers never block, writers must be serialized by the caller.
+ * An odd sequence means a write is in progress.
+ */
+typedef struct {
+    _Atomic uint32_t seq;
+} seqlock_t;
+
+/**
+ * Marks the start of a write
+ */
+static inline void seqlock_write_begin(seqlock_t *lock) {
+    const uint32_t seq = atomic_load_explicit(&lock->seq, memory_order_relaxed);
+    atomic_store_explicit(&lock->seq, seq + 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+}
+
+/**
+ * Publishes the written data
+ */
+static inline void seqlock_write_end(seqlock_t *lock) {
+    const uint32_t seq = atomic_load_explicit(&lock->seq, memory_order_relaxed);
+    atomic_store_explicit(&lock->seq, seq + 1, memory_order_release);
+}
+
+/**
+ * Starts a read. Spins while a write is in progress, then sleeps for a tick at a time, so a reader which
+ * preempted a lower priority writer on the same core lets it finish. Must be called from a task.
+ * @return sequence which should be passed to seqlock_read_retry()
+ */
+static inline uint32_t seqlock_read_begin(const seqlock_t *lock) {
+    uint32_t seq;
+    uint32_t spins = 0;
+    while ((seq = atomic_load_explicit(&lock->seq, memory_order_acquire)) & 1) {
+        if (++spins >= SEQLOCK_SPIN_LIMIT) vTaskDelay(1);
+    }
+    return seq;
+}
+
+/**
+ * Checks whether the data read since seqlock_read_begin() may be torn
+ * @return true if the read should be repeated
+ */
+static inline bool seqlock_read_retry(const seqlock_t *lock, uint32_t seq) {
+    atomic_thread_fence(memory_order_acquire);
+    return atomic_load_explicit(&lock->seq, memory_order_relaxed) != seq;
+}
+
+#endif //SEQLOCK_H
@@ -8,13 +8,9 @@
 // --------- CORE 0 --------- //
 
 #define RMT_APP_TASK_PRIORITY                 5
-#define RMT_APP_TASK_STACK_SIZE               4096
+#define RMT_APP_TASK_STACK_SIZE               4608
 #define RMT_APP_TASK_CORE_ID                  0
 
-#define RMT_APP_MSG_QUEUE_TASK_PRIORITY       4
-#define RMT_APP_MSG_QUEUE_TASK_STACK_SIZE     4096
-#define RMT_APP_MSG_QUEUE_TASK_CORE_ID        0
-
 // --------- CORE 1 --------- //
 
 #define OBJECT_SENSOR_TASK_PRIORITY           5
@@ -25,6 +21,22 @@
 #define MODE_SWITCHER_TASK_STACK_SIZE         2048
 #define MODE_SWITCHER_TASK_CORE_ID            1
 
+#define AUDIO_APP_TASK_PRIORITY               4
+#define AUDIO_APP_TASK_STACK_SIZE             4096
+#define AUDIO_APP_TASK_CORE_ID                1
+
+#define RMT_STORE_TASK_PRIORITY               1
+#define RMT_STORE_TASK_STACK_SIZE             4096
+#define RMT_STORE_TASK_CORE_ID                1
+
+#define APP_BOOT_TASK_PRIORITY                3
+#define APP_BOOT_TASK_STACK_SIZE              4096
+#define APP_BOOT_TASK_CORE_ID                 1
+
+#define FRAME_SYNC_TASK_PRIORITY              3
+#define FRAME_SYNC_TASK_STACK_SIZE            3072
+#define FRAME_SYNC_TASK_CORE_ID               1
+
 #define WIFI_APP_TASK_PRIORITY                4
 #define WIFI_APP_TASK_STACK_SIZE              8192
 #define WIFI_APP_TASK_CORE_ID                 1
@@ -39,4 +51,9 @@
 #define HTTP_SERVER_TASK_STACK_SIZE           8192
 #define HTTP_SERVER_TASK_CORE_ID              1
 
+// Answers a POST /remote/ap/connect?wait=1 once the attempt is over
+#define HTTP_SERVER_CONNECT_WAIT_TASK_PRIORITY   2
+#define HTTP_SERVER_CONNECT_WAIT_TASK_STACK_SIZE 3072
+#define HTTP_SERVER_CONNECT_WAIT_TASK_CORE_ID    1
+
 #endif //TASKS_COMMON_H
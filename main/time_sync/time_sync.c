@@ -0,0 +1,60 @@
+//
+// Created by kok on 19.10.26.
+//
+
+#include <stdatomic.h>
+#include <sys/time.h>
+
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "esp_netif_sntp.h"
+
+#include "time_sync.h"
+
+static const char TAG[] = "time_sync";
+
+static bool g_started = false;
+static atomic_bool g_synced = false;
+
+/**
+ * Called by the SNTP client after every successful synchronization
+ */
+static void time_sync_cb(struct timeval *tv) {
+    if (!atomic_exchange(&g_synced, true)) ESP_LOGI(TAG, "Wall clock synchronized");
+}
+
+void time_sync_init(void) {
+    if (g_started) return;
+
+    // Smooth sync slews the clock instead of jumping, so pending schedules don't shift suddenly
+    esp_sntp_config_t config = ESP_NETIF_SNTP_DEFAULT_CONFIG(TIME_SYNC_NTP_SERVER);
+    config.smooth_sync = true;
+    config.sync_cb = time_sync_cb;
+    const esp_err_t err = esp_netif_sntp_init(&config);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to start SNTP: %s", esp_err_to_name(err));
+        return;
+    }
+    g_started = true;
+}
+
+bool time_sync_is_synced(void) {
+    return atomic_load(&g_synced);
+}
+
+int64_t time_sync_now_ms(void) {
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return (int64_t)tv.tv_sec * 1000 + tv.tv_usec / 1000;
+}
+
+bool time_sync_wall_to_local_us(int64_t wall_ms, int64_t *local_us) {
+    if (!time_sync_is_synced()) return false;
+
+    // Sample both clocks back to back so the conversion error stays in the microsecond range
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    const int64_t now_us = esp_timer_get_time();
+    const int64_t wall_now_us = (int64_t)tv.tv_sec * 1000000 + tv.tv_usec;
+    return time_sync_convert_us(wall_ms, wall_now_us, now_us, local_us);
+}
@@ -0,0 +1,53 @@
+//
+// Created by kok on 19.10.26.
+//
+
+#ifndef TIME_SYNC_H
+#define TIME_SYNC_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#define TIME_SYNC_NTP_SERVER                "pool.ntp.org"
+#define TIME_SYNC_MAX_WALL_MS               253402300799999LL   // End of year 9999, keeps every conversion in range
+
+/**
+ * Starts SNTP. Safe to call again after every reconnect.
+ */
+void time_sync_init(void);
+
+/**
+ * Checks whether the wall clock has been synchronized at least once
+ */
+bool time_sync_is_synced(void);
+
+/**
+ * Gets the synchronized wall clock
+ * @return milliseconds since the Unix epoch
+ */
+int64_t time_sync_now_ms(void);
+
+/**
+ * Converts a wall clock timestamp to the local esp_timer time base
+ * @param wall_ms milliseconds since the Unix epoch
+ * @param local_us converted time in esp_timer microseconds
+ * @return false if the wall clock is not synchronized yet or wall_ms is out of range
+ */
+bool time_sync_wall_to_local_us(int64_t wall_ms, int64_t *local_us);
+
+/**
+ * Converts a wall clock timestamp using a pair of clock samples taken at the same instant
+ * @param wall_ms milliseconds since the Unix epoch
+ * @param wall_now_us wall clock sample in microseconds since the Unix epoch
+ * @param local_now_us esp_timer sample
+ * @param local_us converted time in esp_timer microseconds
+ * @return false if a timestamp is outside of 0..TIME_SYNC_MAX_WALL_MS
+ */
+static inline bool time_sync_convert_us(int64_t wall_ms, int64_t wall_now_us, int64_t local_now_us, int64_t *local_us) {
+    // Checked before scaling, a larger value would overflow the microsecond arithmetic
+    if (wall_ms < 0 || wall_ms > TIME_SYNC_MAX_WALL_MS || wall_now_us < 0 || wall_now_us / 1000 > TIME_SYNC_MAX_WALL_MS) return false;
+    *local_us = local_now_us + (wall_ms * 1000 - wall_now_us);
+    return true;
+}
+
+#endif //TIME_SYNC_H
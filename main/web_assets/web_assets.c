@@ -0,0 +1,408 @@
+//
+// Created by kok on 19.10.26.
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/param.h>
+
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "esp_rom_crc.h"
+
+#include "web_assets.h"
+
+static const char TAG[] = "web_assets";
+
+static web_assets_stats_t g_stats;
+
+/**
+ * Body of a response
+ */
+typedef struct {
+    const char *mime;
+    const char *etag;
+    bool gzip;                       // The precompressed variant is served
+    const uint8_t *data;             // NULL if the file has to be streamed from flash
+    size_t size;
+    const void *source;              // Entry to stream from
+} web_assets_file_t;
+
+#if HTTP_SERVER_EMBED_ASSETS
+
+// --------- EMBEDDED BUNDLE --------- //
+
+/**
+ * Index entry of the bundle. A variant with a NULL ETag is not present.
+ */
+typedef struct {
+    const char *path;
+    const char *mime;
+    uint32_t offset;
+    uint32_t size;
+    const char *etag;
+    uint32_t gz_offset;
+    uint32_t gz_size;
+    const char *gz_etag;
+} web_assets_bundle_entry_t;
+
+// Generated by tools/pack_assets.py during the build
+#include "web_assets_bundle.h"
+
+extern const uint8_t g_bundle_start[] asm("_binary_web_assets_bundle_bin_start");
+
+static uint32_t web_assets_bundle_hash(const char *path) {
+    uint32_t hash = 2166136261u ^ WEB_ASSETS_BUNDLE_SEED;
+    while (*path) {
+        hash ^= (uint8_t)*path++;
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+/**
+ * Looks the path up in the perfect hash index, the content is served straight from the mapped app image
+ * @return false if the bundle has no such file
+ */
+static bool web_assets_resolve(const char *uri, bool accept_gzip, web_assets_file_t *file) {
+    const uint16_t slot = g_bundle_slots[web_assets_bundle_hash(uri) & (WEB_ASSETS_BUNDLE_SLOTS - 1)];
+    if (slot == 0) return false;
+    const web_assets_bundle_entry_t *entry = &g_bundle_entries[slot - 1];
+    if (strcmp(entry->path, uri) != 0) return false;
+
+    file->mime = entry->mime;
+    file->gzip = accept_gzip && entry->gz_etag != NULL;
+    if (!file->gzip && entry->etag == NULL) return false;
+    file->etag = file->gzip ? entry->gz_etag : entry->etag;
+    file->data = g_bundle_start + (file->gzip ? entry->gz_offset : entry->offset);
+    file->size = file->gzip ? entry->gz_size : entry->size;
+    file->source = entry;
+    return true;
+}
+
+#else
+
+#define WEB_ASSETS_ETAG_LEN             24
+#define WEB_ASSETS_FILE_PATH_LEN        (sizeof(WEB_ASSETS_BASE_PATH) + WEB_ASSETS_PATH_MAX_LEN + sizeof(".gz"))
+#define WEB_ASSETS_BLOCKS               (WEB_ASSETS_CACHE_BUDGET / WEB_ASSETS_BLOCK_SIZE)
+
+_Static_assert(WEB_ASSETS_BLOCKS <= 64, "The block map of the cache pool is a uint64_t");
+_Static_assert(WEB_ASSETS_CACHE_BUDGET % WEB_ASSETS_BLOCK_SIZE == 0, "The cache budget has to be a multiple of the block size");
+
+/**
+ * A served file. The ETag is remembered for every entry, the content only for files which fit the cache.
+ */
+typedef struct {
+    char uri[WEB_ASSETS_PATH_MAX_LEN];   // Request path, empty if the slot is free
+    bool accept_gzip;                    // The client accepts a precompressed variant
+    bool gzip;                           // The ".gz" variant is served
+    const char *mime;
+    size_t size;
+    char etag[WEB_ASSETS_ETAG_LEN];
+    uint8_t *data;                       // Inside g_pool, NULL while the content is not cached
+    uint8_t first_block;
+    uint8_t blocks;
+    uint32_t last_used;
+} web_assets_entry_t;
+
+// Only the HTTP server task touches the cache
+static web_assets_entry_t g_entries[WEB_ASSETS_ENTRIES];
+static uint8_t g_pool[WEB_ASSETS_CACHE_BUDGET] __attribute__((aligned(4)));
+static uint64_t g_pool_used = 0;        // One bit per block of g_pool
+static uint32_t g_clock = 0;
+static uint8_t g_chunk[WEB_ASSETS_CHUNK_SIZE];
+
+typedef struct {
+    const char *extension;
+    const char *mime;
+} web_assets_mime_t;
+
+static const web_assets_mime_t g_mime_types[] = {
+    {".html", "text/html"},
+    {".css", "text/css"},
+    {".js", "application/javascript"},
+    {".json", "application/json"},
+    {".svg", "image/svg+xml"},
+    {".png", "image/png"},
+    {".jpg", "image/jpeg"},
+    {".ico", "image/x-icon"},
+    {".woff2", "font/woff2"},
+    {".txt", "text/plain"},
+};
+
+static const char *web_assets_mime(const char *uri) {
+    const char *extension = strrchr(uri, '.');
+    if (extension == NULL) return "application/octet-stream";
+    for (int i = 0; i < sizeof(g_mime_types) / sizeof(g_mime_types[0]); i++) {
+        if (strcmp(extension, g_mime_types[i].extension) == 0) return g_mime_types[i].mime;
+    }
+    return "application/octet-stream";
+}
+
+// --------- RAM CACHE --------- //
+
+static uint64_t web_assets_block_mask(uint8_t first, uint8_t blocks) {
+    return (blocks >= 64 ? UINT64_MAX : (1ULL << blocks) - 1) << first;
+}
+
+static void web_assets_drop_data(web_assets_entry_t *entry) {
+    if (entry->data == NULL) return;
+    g_pool_used &= ~web_assets_block_mask(entry->first_block, entry->blocks);
+    entry->data = NULL;
+    g_stats.cached_bytes -= entry->size;
+    g_stats.evictions++;
+}
+
+/**
+ * Finds the first run of free blocks in the pool
+ * @return index of the first block or -1
+ */
+static int web_assets_find_blocks(uint8_t blocks) {
+    for (int first = 0; first + blocks <= WEB_ASSETS_BLOCKS; first++) {
+        if ((g_pool_used & web_assets_block_mask(first, blocks)) == 0) return first;
+    }
+    return -1;
+}
+
+/**
+ * Reserves room for a file in the static pool, evicting the least recently used contents until a run of blocks is free.
+ * The pool never fragments the heap, whatever mix of files the clients ask for.
+ * @return buffer or NULL if the file has to be streamed
+ */
+static uint8_t *web_assets_alloc(web_assets_entry_t *owner) {
+    const size_t size = owner->size;
+    if (size == 0 || size > WEB_ASSETS_MAX_CACHED_SIZE) return NULL;
+    const uint8_t blocks = (size + WEB_ASSETS_BLOCK_SIZE - 1) / WEB_ASSETS_BLOCK_SIZE;
+
+    int first;
+    while ((first = web_assets_find_blocks(blocks)) < 0) {
+        web_assets_entry_t *oldest = NULL;
+        for (int i = 0; i < WEB_ASSETS_ENTRIES; i++) {
+            if (g_entries[i].data != NULL && &g_entries[i] != owner && (oldest == NULL || g_entries[i].last_used < oldest->last_used))
+                oldest = &g_entries[i];
+        }
+        if (oldest == NULL) return NULL;
+        web_assets_drop_data(oldest);
+    }
+
+    g_pool_used |= web_assets_block_mask(first, blocks);
+    owner->first_block = first;
+    owner->blocks = blocks;
+    g_stats.cached_bytes += size;
+    return g_pool + first * WEB_ASSETS_BLOCK_SIZE;
+}
+
+static void web_assets_file_path(const web_assets_entry_t *entry, char *path, size_t size) {
+    snprintf(path, size, WEB_ASSETS_BASE_PATH "%s%s", entry->uri, entry->gzip ? ".gz" : "");
+}
+
+/**
+ * Reads a file once to compute its ETag, and keeps the content if it fits the cache
+ * @return ESP_ERR_NOT_FOUND if the file doesn't exist
+ */
+static esp_err_t web_assets_load(web_assets_entry_t *entry) {
+    char path[WEB_ASSETS_FILE_PATH_LEN];
+    web_assets_file_path(entry, path, sizeof(path));
+
+    struct stat st;
+    if (stat(path, &st) != 0) return ESP_ERR_NOT_FOUND;
+    FILE *fp = fopen(path, "rb");
+    if (fp == NULL) return ESP_ERR_NOT_FOUND;
+
+    entry->size = st.st_size;
+    entry->data = web_assets_alloc(entry);
+
+    uint32_t crc = 0;
+    size_t offset = 0;
+    while (offset < entry->size) {
+        uint8_t *dest = entry->data != NULL ? entry->data + offset : g_chunk;
+        const size_t want = entry->data != NULL ? entry->size - offset : MIN(sizeof(g_chunk), entry->size - offset);
+        const size_t read = fread(dest, 1, want, fp);
+        g_stats.flash_reads++;
+        g_stats.flash_bytes += read;
+        if (read == 0) break;
+        crc = esp_rom_crc32_le(crc, dest, read);
+        offset += read;
+    }
+    fclose(fp);
+
+    if (offset != entry->size) {
+        ESP_LOGE(TAG, "Short read of %s: %d of %d bytes", path, (int)offset, (int)entry->size);
+        web_assets_drop_data(entry);
+        return ESP_FAIL;
+    }
+    snprintf(entry->etag, sizeof(entry->etag), "\"%08lx-%x\"", crc, (unsigned)entry->size);
+    return ESP_OK;
+}
+
+/**
+ * Finds the entry of a request path, loading the file on the first request
+ * @return entry or NULL if the file doesn't exist
+ */
+static web_assets_entry_t *web_assets_lookup(const char *uri, bool accept_gzip) {
+    web_assets_entry_t *entry = NULL;
+    web_assets_entry_t *victim = &g_entries[0];
+    for (int i = 0; i < WEB_ASSETS_ENTRIES && entry == NULL; i++) {
+        if (g_entries[i].uri[0] != '\0' && g_entries[i].accept_gzip == accept_gzip && strcmp(g_entries[i].uri, uri) == 0)
+            entry = &g_entries[i];
+        else if (g_entries[i].uri[0] == '\0' || (victim->uri[0] != '\0' && g_entries[i].last_used < victim->last_used))
+            victim = &g_entries[i];
+    }
+
+    if (entry != NULL) {
+        entry->last_used = ++g_clock;
+        // Content which was evicted is brought back on the next request
+        if (entry->data == NULL && entry->size <= WEB_ASSETS_MAX_CACHED_SIZE && web_assets_load(entry) != ESP_OK) {
+            entry->uri[0] = '\0';
+            return NULL;
+        }
+        return entry;
+    }
+
+    // The least recently used file makes room
+    web_assets_drop_data(victim);
+    entry = victim;
+    strlcpy(entry->uri, uri, sizeof(entry->uri));
+    entry->accept_gzip = accept_gzip;
+    entry->mime = web_assets_mime(uri);
+    entry->last_used = ++g_clock;
+
+    entry->gzip = accept_gzip;
+    esp_err_t err = web_assets_load(entry);
+    if (err == ESP_ERR_NOT_FOUND && accept_gzip) {
+        entry->gzip = false;
+        err = web_assets_load(entry);
+    }
+    if (err != ESP_OK) {
+        entry->uri[0] = '\0';
+        return NULL;
+    }
+    return entry;
+}
+
+/**
+ * Looks the path up in the RAM cache, loading the file from SPIFFS on a miss
+ * @return false if the file doesn't exist
+ */
+static bool web_assets_resolve(const char *uri, bool accept_gzip, web_assets_file_t *file) {
+    const web_assets_entry_t *entry = web_assets_lookup(uri, accept_gzip);
+    if (entry == NULL) return false;
+
+    // The entry isn't touched again before the response is sent, so the pointers stay valid
+    file->mime = entry->mime;
+    file->etag = entry->etag;
+    file->gzip = entry->gzip;
+    file->data = entry->data;
+    file->size = entry->size;
+    file->source = entry;
+    return true;
+}
+
+/**
+ * Streams a file which is not cached in chunks
+ */
+static esp_err_t web_assets_stream(httpd_req_t *req, const web_assets_file_t *file) {
+    const web_assets_entry_t *entry = file->source;
+    char path[WEB_ASSETS_FILE_PATH_LEN];
+    web_assets_file_path(entry, path, sizeof(path));
+    FILE *fp = fopen(path, "rb");
+    if (fp == NULL) {
+        ESP_LOGE(TAG, "Failed to open file: %s", path);
+        httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Failed to read file");
+        return ESP_FAIL;
+    }
+
+    size_t read;
+    esp_err_t err = ESP_OK;
+    while (err == ESP_OK && (read = fread(g_chunk, 1, sizeof(g_chunk), fp)) > 0) {
+        g_stats.flash_reads++;
+        g_stats.flash_bytes += read;
+        err = httpd_resp_send_chunk(req, (const char*)g_chunk, read);
+    }
+    fclose(fp);
+
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to send %s: %s", path, esp_err_to_name(err));
+        return err;
+    }
+    return httpd_resp_send_chunk(req, NULL, 0);
+}
+
+#endif
+
+// --------- REQUEST HANDLING --------- //
+
+static bool web_assets_accepts_gzip(httpd_req_t *req) {
+    char value[128];
+    if (httpd_req_get_hdr_value_str(req, "Accept-Encoding", value, sizeof(value)) != ESP_OK) return false;
+    return strstr(value, "gzip") != NULL;
+}
+
+static bool web_assets_not_modified(httpd_req_t *req, const char *etag) {
+    char value[128];
+    if (httpd_req_get_hdr_value_str(req, "If-None-Match", value, sizeof(value)) != ESP_OK) return false;
+    return strstr(value, etag) != NULL || strcmp(value, "*") == 0;
+}
+
+esp_err_t web_assets_handler(httpd_req_t *req) {
+    const int64_t start_us = esp_timer_get_time();
+    g_stats.requests++;
+
+    // Path without the query string
+    char uri[WEB_ASSETS_PATH_MAX_LEN];
+    const char *query = strchr(req->uri, '?');
+    const size_t uri_len = query != NULL ? query - req->uri : strlen(req->uri);
+    web_assets_file_t file;
+    bool found = false;
+    if (uri_len < sizeof(uri)) {
+        memcpy(uri, req->uri, uri_len);
+        uri[uri_len] = '\0';
+        if (strcmp(uri, "/") == 0) strcpy(uri, WEB_ASSETS_INDEX);
+        if (strstr(uri, "..") == NULL) found = web_assets_resolve(uri, web_assets_accepts_gzip(req), &file);
+    }
+    if (!found) {
+        ESP_LOGW(TAG, "File not found: %s", req->uri);
+        g_stats.not_found++;
+        httpd_resp_send_404(req);
+        return ESP_OK;
+    }
+
+    httpd_resp_set_hdr(req, "ETag", file.etag);
+    httpd_resp_set_hdr(req, "Cache-Control", strcmp(file.mime, "text/html") == 0 ? WEB_ASSETS_CACHE_CONTROL_HTML : WEB_ASSETS_CACHE_CONTROL);
+    httpd_resp_set_hdr(req, "Vary", "Accept-Encoding");
+
+    esp_err_t err;
+    if (web_assets_not_modified(req, file.etag)) {
+        g_stats.not_modified++;
+        httpd_resp_set_status(req, "304 Not Modified");
+        err = httpd_resp_send(req, NULL, 0);
+    } else {
+        httpd_resp_set_type(req, file.mime);
+        if (file.gzip) {
+            httpd_resp_set_hdr(req, "Content-Encoding", "gzip");
+            g_stats.gzip++;
+        }
+#if !HTTP_SERVER_EMBED_ASSETS
+        if (file.data == NULL) {
+            g_stats.streamed++;
+            err = web_assets_stream(req, &file);
+        } else
+#endif
+        {
+            // Bundled files are always in memory
+            g_stats.hits++;
+            err = httpd_resp_send(req, (const char*)file.data, file.size);
+        }
+    }
+
+    const int64_t elapsed_us = esp_timer_get_time() - start_us;
+    g_stats.total_us += elapsed_us;
+    if (elapsed_us > g_stats.max_us) g_stats.max_us = elapsed_us;
+    return err;
+}
+
+web_assets_stats_t web_assets_get_stats(void) {
+    return g_stats;
+}
@@ -0,0 +1,56 @@
+//
+// Created by kok on 19.10.26.
+//
+
+#ifndef WEB_ASSETS_H
+#define WEB_ASSETS_H
+
+#include <stdint.h>
+
+#include "esp_err.h"
+#include "esp_http_server.h"
+
+#define WEB_ASSETS_BASE_PATH            "/spiffs"
+#define WEB_ASSETS_INDEX                "/index.html"
+#define WEB_ASSETS_PATH_MAX_LEN         48      // SPIFFS object names are at most 32 characters
+#define WEB_ASSETS_ENTRIES              16      // Files whose size and ETag are remembered
+#define WEB_ASSETS_MAX_CACHED_SIZE      (16 * 1024)
+#define WEB_ASSETS_CACHE_BUDGET         (48 * 1024)     // Static pool, not taken from the heap
+#define WEB_ASSETS_BLOCK_SIZE           1024    // Allocation unit of the pool, at most 64 blocks
+#define WEB_ASSETS_CHUNK_SIZE           4096    // Read size when streaming a file which is not cached
+
+#define WEB_ASSETS_CACHE_CONTROL_HTML   "no-cache"          // Always revalidated, answered with 304 while unchanged
+#define WEB_ASSETS_CACHE_CONTROL        "max-age=3600"
+
+/**
+ * Asset serving counters
+ */
+typedef struct {
+    uint32_t requests;
+    uint32_t hits;           // Served from RAM
+    uint32_t not_modified;   // Answered with 304
+    uint32_t streamed;       // Streamed from flash because the file is too large or the cache is full
+    uint32_t not_found;
+    uint32_t gzip;           // Responses using a precompressed variant
+    uint32_t flash_reads;
+    uint64_t flash_bytes;
+    uint32_t evictions;
+    uint32_t cached_bytes;
+    uint64_t total_us;       // Time spent serving, including the transfer
+    uint32_t max_us;
+} web_assets_stats_t;
+
+/**
+ * URI handler for the static web interface. Serves a precompressed ".gz" variant when the client accepts it,
+ * sends a strong ETag and Cache-Control, answers If-None-Match with 304 and keeps small files in RAM.
+ * Built with HTTP_SERVER_EMBED_ASSETS the files come from a bundle in the app image instead of SPIFFS.
+ * Must only be called from the HTTP server task.
+ */
+esp_err_t web_assets_handler(httpd_req_t *req);
+
+/**
+ * Gets the asset serving counters
+ */
+web_assets_stats_t web_assets_get_stats(void);
+
+#endif //WEB_ASSETS_H
@@ -8,6 +8,7 @@
 #include "freertos/event_groups.h"
 #include "esp_log.h"
 #include "esp_event.h"
+#include "esp_timer.h"
 #include "esp_wifi_default.h"
 #include "nvs.h"
 
@@ -33,23 +34,91 @@ static uint8_t g_wifi_app_retry_count = 0;
 static esp_netif_t *wifi_app_ap = NULL;
 static esp_netif_t *wifi_app_sta = NULL;
 
-// --------- STA CONNECTION --------- //
+// Latest scan results, written by the event task and copied out by the HTTP server
+static wifi_app_sta_scan_results_t g_scan_cache;
+static int64_t g_scan_started_us = 0;
+static portMUX_TYPE g_scan_lock = portMUX_INITIALIZER_UNLOCKED;
+
+// --------- STA SCAN --------- //
 
-esp_err_t wifi_app_sta_scan(wifi_app_sta_scan_results_t *results) {
+/**
+ * Starts a scan without waiting for it. The results arrive with WIFI_EVENT_SCAN_DONE.
+ */
+static void wifi_app_sta_scan_start(void) {
     const wifi_scan_config_t config = {
         .show_hidden = true,
     };
-    esp_err_t err = esp_wifi_scan_start(&config, true);
-    if (err != ESP_OK) return err;
-    uint16_t max_records = WIFI_APP_STA_MAX_AP_RECORDS;
-    wifi_ap_record_t *records = malloc(sizeof(wifi_ap_record_t) * max_records);
-    err = esp_wifi_scan_get_ap_records(&max_records, records);
-    if (err != ESP_OK) return err;
-    results->records_count = max_records;
-    results->records = records;
-    return ESP_OK;
+    const esp_err_t err = esp_wifi_scan_start(&config, false);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to start WiFi scan! %s", esp_err_to_name(err));
+        taskENTER_CRITICAL(&g_scan_lock);
+        g_scan_cache.scanning = false;
+        taskEXIT_CRITICAL(&g_scan_lock);
+    }
+}
+
+/**
+ * Moves the driver's scan results into the cache and releases the driver's list.
+ * Runs on the WiFi application task, the system event task has too little stack for the records.
+ * @param status status of the WIFI_EVENT_SCAN_DONE event, 0 on success
+ */
+static void wifi_app_sta_scan_done(const uint32_t status) {
+    static wifi_app_sta_scan_record_t records[WIFI_APP_STA_MAX_AP_RECORDS];
+    uint8_t count = 0;
+    if (status == 0) {
+        wifi_ap_record_t record;
+        while (count < WIFI_APP_STA_MAX_AP_RECORDS && esp_wifi_scan_get_ap_record(&record) == ESP_OK) {
+            memcpy(records[count].ssid, record.ssid, sizeof(records[count].ssid));
+            records[count].rssi = record.rssi;
+            records[count].authmode = record.authmode;
+            count++;
+        }
+    }
+    esp_wifi_clear_ap_list();
+
+    const int64_t now_us = esp_timer_get_time();
+    taskENTER_CRITICAL(&g_scan_lock);
+    if (status == 0) {
+        memcpy(g_scan_cache.records, records, sizeof(records[0]) * count);
+        g_scan_cache.records_count = count;
+        g_scan_cache.updated_us = now_us;
+    }
+    g_scan_cache.scanning = false;
+    taskEXIT_CRITICAL(&g_scan_lock);
+    ESP_LOGI(TAG, "WiFi scan %s, %d networks in %lld ms", status == 0 ? "done" : "aborted", count, (now_us - g_scan_started_us) / 1000);
+}
+
+void wifi_app_sta_scan_request(const bool force) {
+    const int64_t now_us = esp_timer_get_time();
+    taskENTER_CRITICAL(&g_scan_lock);
+    const bool stale = g_scan_cache.updated_us == 0 || now_us - g_scan_cache.updated_us > WIFI_APP_SCAN_MAX_AGE_MS * 1000LL;
+    // A scan whose completion event never arrived doesn't block new ones forever
+    const bool idle = !g_scan_cache.scanning || now_us - g_scan_started_us > WIFI_APP_SCAN_TIMEOUT_MS * 1000LL;
+    const bool allowed = idle && (g_scan_started_us == 0 || now_us - g_scan_started_us >= WIFI_APP_SCAN_MIN_INTERVAL_MS * 1000LL);
+    const bool start = (force || stale) && allowed;
+    if (start) {
+        g_scan_cache.scanning = true;
+        g_scan_started_us = now_us;
+    }
+    taskEXIT_CRITICAL(&g_scan_lock);
+
+    // Also called from the system event task, which must not block on a full queue
+    if (start && !wifi_app_post_message(WIFI_APP_MSG_SCAN, NULL)) {
+        ESP_LOGW(TAG, "WiFi message queue is full, scan request dropped");
+        taskENTER_CRITICAL(&g_scan_lock);
+        g_scan_cache.scanning = false;
+        taskEXIT_CRITICAL(&g_scan_lock);
+    }
+}
+
+void wifi_app_sta_scan_get(wifi_app_sta_scan_results_t *results) {
+    taskENTER_CRITICAL(&g_scan_lock);
+    *results = g_scan_cache;
+    taskEXIT_CRITICAL(&g_scan_lock);
 }
 
+// --------- STA CONNECTION --------- //
+
 /**
  * Connect to a remote AP
  */
@@ -206,8 +275,17 @@ static void wifi_app_msg_queue_task(void *pvParams) {
                         }
                     }
 
+                    // A running scan would make the connection attempt fail, its results are dropped
+                    esp_wifi_scan_stop();
                     wifi_app_sta_connect();
                     break;
+                case WIFI_APP_MSG_SCAN:
+                    ESP_LOGI(TAG, "WIFI_APP_MSG_SCAN");
+                    wifi_app_sta_scan_start();
+                    break;
+                case WIFI_APP_MSG_SCAN_DONE:
+                    wifi_app_sta_scan_done((uint32_t)(uintptr_t)msg.params);
+                    break;
                 case WIFI_APP_MSG_DISCONNECT:
                     ESP_LOGI(TAG, "WIFI_APP_MSG_DISCONNECT");
                     event_bits = xEventGroupGetBits(wifi_app_event_group_handle);
@@ -233,6 +311,21 @@ static void wifi_app_event_handler(void *arg, const esp_event_base_t event_base,
             case WIFI_EVENT_STA_STOP:
                 ESP_LOGI(TAG, "WIFI_EVENT_STA_STOP");
                 break;
+            case WIFI_EVENT_SCAN_DONE:
+                // The results are copied on the WiFi application task. If the queue is full they are dropped.
+                if (!wifi_app_post_message(WIFI_APP_MSG_SCAN_DONE, (void*)(uintptr_t)((const wifi_event_sta_scan_done_t*)event_data)->status)) {
+                    ESP_LOGW(TAG, "WiFi message queue is full, scan results dropped");
+                    esp_wifi_clear_ap_list();
+                    taskENTER_CRITICAL(&g_scan_lock);
+                    g_scan_cache.scanning = false;
+                    taskEXIT_CRITICAL(&g_scan_lock);
+                }
+                break;
+            case WIFI_EVENT_AP_STACONNECTED:
+                // A client joined the setup AP, have the network list ready when it opens the panel
+                ESP_LOGI(TAG, "WIFI_EVENT_AP_STACONNECTED");
+                wifi_app_sta_scan_request(false);
+                break;
             case WIFI_EVENT_STA_DISCONNECTED:
                 ESP_LOGI(TAG, "WIFI_EVENT_STA_DISCONNECTED");
                 event_bits = xEventGroupGetBits(wifi_app_event_group_handle);
@@ -385,6 +478,11 @@ void wifi_app_send_message(const wifi_app_msg_e msgID, void *pvParams) {
     xQueueSend(wifi_app_message_queue_handle, &msg, portMAX_DELAY);
 }
 
+bool wifi_app_post_message(const wifi_app_msg_e msgID, void *pvParams) {
+    const wifi_app_message_t msg = {.msgID = msgID, .params = pvParams};
+    return xQueueSend(wifi_app_message_queue_handle, &msg, 0) == pdTRUE;
+}
+
 wifi_config_t *wifi_app_get_sta_config(void) {
     return &g_wifi_sta_config;
 }
@@ -11,7 +11,11 @@
 
 #define WIFI_APP_STA_CHANNEL          1
 #define WIFI_APP_STA_MAX_RETRIES      3
-#define WIFI_APP_STA_MAX_AP_RECORDS   5
+#define WIFI_APP_STA_MAX_AP_RECORDS   16
+
+#define WIFI_APP_SCAN_MAX_AGE_MS      30000   // Older results are refreshed on the next request
+#define WIFI_APP_SCAN_MIN_INTERVAL_MS 10000   // A scan pauses the station link, never start them more often
+#define WIFI_APP_SCAN_TIMEOUT_MS      15000
 
 #define WIFI_APP_AP_SSID              "ESP32_AP"
 #define WIFI_APP_AP_PASSWORD          "test1234"
@@ -26,6 +30,8 @@
 typedef enum {
     WIFI_APP_MSG_CONNECT,
     WIFI_APP_MSG_DISCONNECT,
+    WIFI_APP_MSG_SCAN,
+    WIFI_APP_MSG_SCAN_DONE,     // params carries the event status
 } wifi_app_msg_e;
 
 typedef struct {
@@ -39,8 +45,16 @@ typedef struct {
 } wifi_app_sta_connection_config_t;
 
 typedef struct {
-    wifi_ap_record_t *records;
+    uint8_t ssid[33];
+    int8_t rssi;
+    wifi_auth_mode_t authmode;
+} wifi_app_sta_scan_record_t;
+
+typedef struct {
+    wifi_app_sta_scan_record_t records[WIFI_APP_STA_MAX_AP_RECORDS];   // Strongest networks first
     uint8_t records_count;
+    bool scanning;
+    int64_t updated_us;                                                 // 0 until the first scan has finished
 } wifi_app_sta_scan_results_t;
 
 
@@ -54,15 +68,27 @@ void wifi_app_init(void);
  */
 void wifi_app_send_message(wifi_app_msg_e msgID, void *pvParams);
 
+/**
+ * Send message to the WiFi Application message queue without waiting, safe on the system event task
+ * @return false if the queue is full and the message was dropped
+ */
+bool wifi_app_post_message(wifi_app_msg_e msgID, void *pvParams);
+
 /**
  * Get the current wifi's sta configuration
  */
 wifi_config_t *wifi_app_get_sta_config(void);
 
 /**
- * Scan for remote AP's SSIDs
+ * Starts a background scan for remote APs if the cached results are older than WIFI_APP_SCAN_MAX_AGE_MS,
+ * or regardless of their age when forced. Never starts one sooner than WIFI_APP_SCAN_MIN_INTERVAL_MS after the last.
+ */
+void wifi_app_sta_scan_request(bool force);
+
+/**
+ * Copies the cached results of the last finished scan
  */
-esp_err_t wifi_app_sta_scan(wifi_app_sta_scan_results_t *results);
+void wifi_app_sta_scan_get(wifi_app_sta_scan_results_t *results);
 
 /**
  * Set callback function which is called upon wifi connection
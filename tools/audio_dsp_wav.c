@@ -0,0 +1,167 @@
+/*
+ * Host harness of the audio DSP stage. Feeds a WAV file, or a generated 120 BPM test signal, through
+ * audio_dsp_process_block() in blocks of AUDIO_DSP_FFT_SIZE samples the way audio_app does, and reports the
+ * CPU cost per block, the detected beats and the average band levels.
+ *
+ * Build and run from the repository root:
+ *     cc -O2 -Imain/audio_app tools/audio_dsp_wav.c main/audio_app/audio_dsp.c -lm -o audio_dsp_wav
+ *     ./audio_dsp_wav [file.wav] [-v]
+ *
+ * The WAV has to be 16 bit PCM, only the first channel is used. The band edges assume AUDIO_APP_SAMPLE_RATE,
+ * other rates are processed anyway with a warning. -v prints the levels of every block.
+ * The cost is host CPU time, the firmware logs its own figures every AUDIO_APP_STATS_LOG_BLOCKS blocks.
+ */
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define BENCH_CYCLES() __rdtsc()
+#else
+#define BENCH_CYCLES() 0
+#endif
+
+#include "audio_dsp.h"
+
+#define WAV_SAMPLE_RATE         16000   // AUDIO_APP_SAMPLE_RATE
+#define WAV_TEST_SECONDS        10
+#define WAV_TEST_BPM            120
+
+/**
+ * Reads a little-endian value of the given size
+ */
+static uint32_t wav_le(const uint8_t *p, int bytes) {
+    uint32_t value = 0;
+    for (int i = bytes - 1; i >= 0; i--) value = value << 8 | p[i];
+    return value;
+}
+
+/**
+ * Loads the first channel of a 16 bit PCM WAV file
+ * @return samples allocated with malloc or NULL
+ */
+static int16_t *wav_load(const char *path, size_t *count, uint32_t *rate) {
+    FILE *f = fopen(path, "rb");
+    if (f == NULL) {
+        perror(path);
+        return NULL;
+    }
+    fseek(f, 0, SEEK_END);
+    const long size = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    uint8_t *data = malloc(size);
+    if (data == NULL || fread(data, 1, size, f) != (size_t)size || size < 12 || memcmp(data, "RIFF", 4) != 0 || memcmp(data + 8, "WAVE", 4) != 0) {
+        fprintf(stderr, "%s is not a RIFF/WAVE file\n", path);
+        fclose(f);
+        free(data);
+        return NULL;
+    }
+    fclose(f);
+
+    uint32_t channels = 0, bits = 0;
+    int16_t *samples = NULL;
+    for (long pos = 12; pos + 8 <= size;) {
+        const uint32_t chunk_len = wav_le(data + pos + 4, 4);
+        const uint8_t *chunk = data + pos + 8;
+        if (pos + 8 + (long)chunk_len > size) break;
+        if (memcmp(data + pos, "fmt ", 4) == 0 && chunk_len >= 16) {
+            if (wav_le(chunk, 2) != 1) break;
+            channels = wav_le(chunk + 2, 2);
+            *rate = wav_le(chunk + 4, 4);
+            bits = wav_le(chunk + 14, 2);
+        } else if (memcmp(data + pos, "data", 4) == 0 && channels > 0 && bits == 16) {
+            *count = chunk_len / (2 * channels);
+            samples = malloc(*count * sizeof(int16_t));
+            for (size_t i = 0; samples != NULL && i < *count; i++) samples[i] = (int16_t)wav_le(chunk + i * 2 * channels, 2);
+            break;
+        }
+        pos += 8 + chunk_len + (chunk_len & 1);
+    }
+    free(data);
+    if (samples == NULL) fprintf(stderr, "%s: no 16 bit PCM data found\n", path);
+    return samples;
+}
+
+/**
+ * Generates a kick drum at WAV_TEST_BPM over a quiet 1 kHz tone and some noise
+ */
+static int16_t *wav_generate(size_t *count) {
+    *count = WAV_SAMPLE_RATE * WAV_TEST_SECONDS;
+    int16_t *samples = malloc(*count * sizeof(int16_t));
+    if (samples == NULL) return NULL;
+    const size_t beat_period = WAV_SAMPLE_RATE * 60 / WAV_TEST_BPM;
+    srand(1);
+    for (size_t i = 0; i < *count; i++) {
+        const double t = (double)i / WAV_SAMPLE_RATE;
+        const double since_beat = (double)(i % beat_period) / WAV_SAMPLE_RATE;
+        const double kick = since_beat < 0.15 ? 0.8 * exp(-since_beat * 30) * sin(2 * M_PI * 60 * since_beat) : 0;
+        const double tone = 0.05 * sin(2 * M_PI * 1000 * t);
+        const double noise = 0.01 * ((double)rand() / RAND_MAX - 0.5);
+        samples[i] = (int16_t)(32767 * (kick + tone + noise));
+    }
+    return samples;
+}
+
+int main(int argc, char *argv[]) {
+    const char *path = NULL;
+    bool verbose = false;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-v") == 0) verbose = true;
+        else path = argv[i];
+    }
+
+    size_t count = 0;
+    uint32_t rate = WAV_SAMPLE_RATE;
+    int16_t *samples = path != NULL ? wav_load(path, &count, &rate) : wav_generate(&count);
+    if (samples == NULL) return 1;
+    if (rate != WAV_SAMPLE_RATE) printf("Warning: %lu Hz input, the band edges assume %d Hz\n", (unsigned long)rate, WAV_SAMPLE_RATE);
+
+    static audio_dsp_t dsp;
+    audio_dsp_init(&dsp);
+
+    const size_t blocks = count / AUDIO_DSP_FFT_SIZE;
+    uint64_t total_ns = 0, max_ns = 0, total_cycles = 0;
+    uint64_t level_sums[AUDIO_DSP_BANDS_COUNT] = {0};
+    size_t beats = 0;
+    for (size_t b = 0; b < blocks; b++) {
+        audio_dsp_bands_t bands;
+        struct timespec t0, t1;
+        clock_gettime(CLOCK_MONOTONIC, &t0);
+        const uint64_t c0 = BENCH_CYCLES();
+        audio_dsp_process_block(&dsp, samples + b * AUDIO_DSP_FFT_SIZE, &bands);
+        const uint64_t c1 = BENCH_CYCLES();
+        clock_gettime(CLOCK_MONOTONIC, &t1);
+
+        const uint64_t ns = (uint64_t)((t1.tv_sec - t0.tv_sec) * 1000000000LL + (t1.tv_nsec - t0.tv_nsec));
+        total_ns += ns;
+        total_cycles += c1 - c0;
+        if (ns > max_ns) max_ns = ns;
+        if (bands.beat) beats++;
+        for (int i = 0; i < AUDIO_DSP_BANDS_COUNT; i++) level_sums[i] += bands.levels[i];
+
+        if (verbose) {
+            printf("%8.3f s ", (double)b * AUDIO_DSP_FFT_SIZE / rate);
+            for (int i = 0; i < AUDIO_DSP_BANDS_COUNT; i++) printf(" %3u", bands.levels[i]);
+            printf("%s\n", bands.beat ? "  beat" : "");
+        }
+    }
+    free(samples);
+    if (blocks == 0) {
+        printf("Less than one block of %d samples\n", AUDIO_DSP_FFT_SIZE);
+        return 1;
+    }
+
+    const double seconds = (double)blocks * AUDIO_DSP_FFT_SIZE / rate;
+    printf("%s: %zu blocks of %d samples, %.1f s of audio\n", path != NULL ? path : "generated", blocks, AUDIO_DSP_FFT_SIZE, seconds);
+    printf("cost per block: avg %.2f us, max %.2f us, %llu cycles (block period %d us)\n",
+           total_ns / 1000.0 / blocks, max_ns / 1000.0, (unsigned long long)(total_cycles / blocks),
+           AUDIO_DSP_FFT_SIZE * 1000 / (WAV_SAMPLE_RATE / 1000));
+    printf("beats: %zu, %.1f per minute%s\n", beats, beats * 60 / seconds, path == NULL ? " (generated at 120)" : "");
+    printf("average level per band:");
+    for (int i = 0; i < AUDIO_DSP_BANDS_COUNT; i++) printf(" %llu", (unsigned long long)(level_sums[i] / blocks));
+    printf("\n");
+    return 0;
+}
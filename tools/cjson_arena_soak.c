@@ -0,0 +1,215 @@
+/*
+ * Host soak test of the cJSON arena. Two threads take turns owning the arena and parse Wi-Fi connect bodies,
+ * some of them too large for the arena, while two more threads parse outside of it and hit the heap fallback.
+ * Every parsed tree is checked, and at the end the counters have to match the calibrated allocation counts
+ * exactly and the heap has to be back where it started. The free heap and its largest free block are printed
+ * after every tenth of the run, a largest block shrinking while the free total holds means fragmentation.
+ *
+ * Build and run from the repository root:
+ *     cc -O2 -pthread -Itools/host -Imain -Imain/cjson tools/cjson_arena_soak.c tools/host/host_freertos.c \
+ *         main/cjson_arena/cjson_arena.c main/cjson/cJSON.c -o cjson_arena_soak
+ *     ./cjson_arena_soak [commands]
+ */
+
+#include <malloc.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "cJSON.h"
+#include "cjson_arena/cjson_arena.h"
+
+#define SOAK_OWNERS             2
+#define SOAK_OUTSIDERS          2
+#define SOAK_OVERSIZED_EVERY    100     // Every n-th owner command outgrows the arena
+#define SOAK_OUTSIDER_SHARE     10      // Each outsider parses 1/n of the commands
+#define SOAK_REPORT_INTERVALS   10      // Heap samples printed during the measured run
+
+typedef struct {
+    uint32_t allocs;
+    uint32_t fallbacks;
+} soak_cost_t;
+
+static char g_oversized_password[CJSON_ARENA_SIZE + 64];
+static soak_cost_t g_cost_small;        // Owner parsing a regular body
+static soak_cost_t g_cost_oversized;    // Owner parsing a body larger than the arena
+static soak_cost_t g_cost_outside;      // Parsing a regular body without owning the arena
+static _Atomic uint32_t g_failures = 0;
+
+/**
+ * Builds a connect body, the SSID changes with every command so a mixed up tree is noticed
+ */
+static void soak_body(char *body, size_t size, unsigned long n, bool oversized) {
+    snprintf(body, size, "{\"ssid\": \"net-%lu\", \"password\": \"%s\"}", n, oversized ? g_oversized_password : "secret");
+}
+
+static void soak_parse(unsigned long n, bool oversized, bool owner) {
+    static _Thread_local char body[sizeof(g_oversized_password) + 64];
+    char ssid[32];
+    soak_body(body, sizeof(body), n, oversized);
+    snprintf(ssid, sizeof(ssid), "net-%lu", n);
+
+    if (owner) cjson_arena_begin();
+    cJSON *json = cJSON_Parse(body);
+    const cJSON *item = cJSON_GetObjectItemCaseSensitive(json, "ssid");
+    if (!cJSON_IsString(item) || strcmp(item->valuestring, ssid) != 0) {
+        printf("FAIL: command %lu parsed as \"%s\"\n", n, cJSON_IsString(item) ? item->valuestring : "?");
+        g_failures++;
+    }
+    cJSON_Delete(json);
+    if (owner) cjson_arena_end();
+}
+
+static soak_cost_t soak_calibrate(bool oversized, bool owner) {
+    const cjson_arena_stats_t before = cjson_arena_get_stats();
+    soak_parse(0, oversized, owner);
+    const cjson_arena_stats_t after = cjson_arena_get_stats();
+    return (soak_cost_t){.allocs = after.allocs - before.allocs, .fallbacks = after.fallbacks - before.fallbacks};
+}
+
+typedef struct {
+    unsigned long first;
+    unsigned long count;
+    bool owner;
+} soak_worker_t;
+
+static void *soak_worker(void *arg) {
+    const soak_worker_t *worker = arg;
+    for (unsigned long n = worker->first; n < worker->first + worker->count; n++)
+        soak_parse(n, worker->owner && n % SOAK_OVERSIZED_EVERY == 0, worker->owner);
+    return NULL;
+}
+
+/**
+ * malloc_info() output. The stream is opened before the heap is sampled and writes into a static buffer, freed
+ * stream buffers would stay in the tcache and show up as heap in use.
+ */
+static char g_heap_info_xml[64 * 1024];
+static FILE *g_heap_info;
+
+/**
+ * Gets the largest free chunk of the heap. glibc has no call for it, but malloc_info() lists the largest chunk
+ * of every bin as "to", and the top chunk (keepcost) can be split as well.
+ */
+static size_t soak_largest_free_block(void) {
+    rewind(g_heap_info);
+    malloc_info(0, g_heap_info);
+    const long len = ftell(g_heap_info);
+    g_heap_info_xml[len < (long)sizeof(g_heap_info_xml) ? len : (long)sizeof(g_heap_info_xml) - 1] = '\0';
+
+    size_t largest = mallinfo2().keepcost;
+    for (const char *p = g_heap_info_xml; (p = strstr(p, " to=\"")) != NULL; p += 5) {
+        const size_t size = strtoull(p + 5, NULL, 10);
+        if (size > largest) largest = size;
+    }
+    return largest;
+}
+
+/**
+ * Runs one owner or outsider thread per worker until all are done
+ */
+static void soak_round(soak_worker_t *workers, size_t count) {
+    pthread_t threads[SOAK_OWNERS + SOAK_OUTSIDERS];
+    for (size_t i = 0; i < count; i++) pthread_create(&threads[i], NULL, soak_worker, &workers[i]);
+    for (size_t i = 0; i < count; i++) pthread_join(threads[i], NULL);
+}
+
+int main(int argc, char *argv[]) {
+    const unsigned long commands = argc > 1 ? strtoul(argv[1], NULL, 10) : 100000;
+    memset(g_oversized_password, 'x', sizeof(g_oversized_password) - 1);
+
+    // One malloc arena for all threads, otherwise glibc creating arenas under contention shows up as heap growth
+    mallopt(M_ARENA_MAX, 1);
+
+    cjson_arena_init();
+    g_cost_small = soak_calibrate(false, true);
+    g_cost_oversized = soak_calibrate(true, true);
+    g_cost_outside = soak_calibrate(false, false);
+    printf("allocations per command: arena %u, oversized %u + %u on the heap, outside %u on the heap\n",
+           g_cost_small.allocs, g_cost_oversized.allocs, g_cost_oversized.fallbacks, g_cost_outside.fallbacks);
+
+    // The first threads leave thread bookkeeping on the heap, so a short round runs before the heap is sampled
+    soak_worker_t workers[SOAK_OWNERS + SOAK_OUTSIDERS];
+    for (int i = 0; i < SOAK_OWNERS + SOAK_OUTSIDERS; i++)
+        workers[i] = (soak_worker_t){.first = 1, .count = SOAK_OVERSIZED_EVERY, .owner = i < SOAK_OWNERS};
+    soak_round(workers, SOAK_OWNERS + SOAK_OUTSIDERS);
+
+    g_heap_info = fmemopen(g_heap_info_xml, sizeof(g_heap_info_xml), "w");
+    if (g_heap_info == NULL) {
+        perror("fmemopen");
+        return 1;
+    }
+    setvbuf(g_heap_info, NULL, _IONBF, 0);
+
+    const cjson_arena_stats_t start = cjson_arena_get_stats();
+    const size_t heap_start = mallinfo2().uordblks;
+
+    const unsigned long per_owner = commands / SOAK_OWNERS;
+    const unsigned long per_outsider = commands / SOAK_OUTSIDER_SHARE;
+    for (int i = 0; i < SOAK_OWNERS + SOAK_OUTSIDERS; i++) {
+        const bool owner = i < SOAK_OWNERS;
+        workers[i] = (soak_worker_t){
+            .first = owner ? 1 + i * per_owner : 1 + commands + (i - SOAK_OWNERS) * per_outsider,
+            .count = owner ? per_owner : per_outsider,
+            .owner = owner,
+        };
+    }
+
+    // Every interval runs the next slice of each worker's commands, the heap is sampled in between
+    double seconds = 0;
+    printf("interval   commands   heap free   largest free block\n");
+    for (int interval = 0; interval < SOAK_REPORT_INTERVALS; interval++) {
+        soak_worker_t slices[SOAK_OWNERS + SOAK_OUTSIDERS];
+        unsigned long done = 0;
+        for (int i = 0; i < SOAK_OWNERS + SOAK_OUTSIDERS; i++) {
+            const unsigned long from = workers[i].count * interval / SOAK_REPORT_INTERVALS;
+            const unsigned long to = workers[i].count * (interval + 1) / SOAK_REPORT_INTERVALS;
+            slices[i] = (soak_worker_t){.first = workers[i].first + from, .count = to - from, .owner = workers[i].owner};
+            done += to;
+        }
+
+        struct timespec t0, t1;
+        clock_gettime(CLOCK_MONOTONIC, &t0);
+        soak_round(slices, SOAK_OWNERS + SOAK_OUTSIDERS);
+        clock_gettime(CLOCK_MONOTONIC, &t1);
+        seconds += (t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec) / 1e9;
+
+        printf("%8d %10lu %11zu %20zu\n", interval + 1, done, mallinfo2().fordblks, soak_largest_free_block());
+    }
+
+    // Expected counters from the calibrated cost of every kind of command
+    uint64_t owned = 0, oversized = 0;
+    for (int i = 0; i < SOAK_OWNERS; i++) {
+        for (unsigned long n = workers[i].first; n < workers[i].first + workers[i].count; n++) {
+            if (n % SOAK_OVERSIZED_EVERY == 0) oversized++;
+            else owned++;
+        }
+    }
+    const uint64_t outside = (uint64_t)SOAK_OUTSIDERS * per_outsider;
+    const uint64_t expected_allocs = owned * g_cost_small.allocs + oversized * g_cost_oversized.allocs;
+    const uint64_t expected_fallbacks = oversized * g_cost_oversized.fallbacks + outside * g_cost_outside.fallbacks;
+
+    const cjson_arena_stats_t end = cjson_arena_get_stats();
+    const uint64_t messages = end.messages - start.messages;
+    const uint64_t allocs = end.allocs - start.allocs;
+    const uint64_t fallbacks = end.fallbacks - start.fallbacks;
+    const long heap_delta = (long)mallinfo2().uordblks - (long)heap_start;
+
+    printf("%lu arena commands (%llu oversized), %llu outside, %.2f s, %.2f us per command\n",
+           (unsigned long)(owned + oversized), (unsigned long long)oversized, (unsigned long long)outside,
+           seconds, seconds * 1e6 / (owned + oversized + outside));
+    printf("messages  %10llu expected %10llu\n", (unsigned long long)messages, (unsigned long long)(owned + oversized));
+    printf("allocs    %10llu expected %10llu\n", (unsigned long long)allocs, (unsigned long long)expected_allocs);
+    printf("fallbacks %10llu expected %10llu\n", (unsigned long long)fallbacks, (unsigned long long)expected_fallbacks);
+    printf("high water %u of %d bytes, heap in use changed by %ld bytes\n", end.high_water, CJSON_ARENA_SIZE, heap_delta);
+
+    fclose(g_heap_info);
+
+    const bool ok = g_failures == 0 && messages == owned + oversized && allocs == expected_allocs
+        && fallbacks == expected_fallbacks && end.high_water <= CJSON_ARENA_SIZE && heap_delta == 0;
+    printf(ok ? "PASS\n" : "FAIL\n");
+    return ok ? 0 : 1;
+}
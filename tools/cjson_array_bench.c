@@ -0,0 +1,80 @@
+/*
+ * Host benchmark of ingesting a JSON pixel frame for 1000 LEDs: cJSON_Parse with cJSON_GetArrayItem
+ * per index, cJSON_Parse walking the child list, and cJSON_ParseUInt8Array.
+ *
+ * Build and run from the repository root:
+ *     cc -O2 -Imain/cjson tools/cjson_array_bench.c main/cjson/cJSON.c -lm -o cjson_array_bench
+ *     ./cjson_array_bench [iterations]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "cJSON.h"
+
+#define BENCH_LEDS      1000
+#define BENCH_VALUES    (BENCH_LEDS * 3)
+
+static char g_frame[BENCH_VALUES * 5 + 2];
+static unsigned char g_rgb[BENCH_VALUES];
+
+static double bench_now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static size_t bench_build_frame(void) {
+    size_t len = 0;
+    g_frame[len++] = '[';
+    for (int i = 0; i < BENCH_VALUES; i++) len += sprintf(g_frame + len, i ? ",%d" : "%d", (i * 37) % 256);
+    g_frame[len++] = ']';
+    g_frame[len] = '\0';
+    return len;
+}
+
+static int bench_tree_indexed(size_t len) {
+    cJSON *json = cJSON_ParseWithLength(g_frame, len);
+    if (json == NULL) return 0;
+    const int count = cJSON_GetArraySize(json);
+    for (int i = 0; i < count; i++) g_rgb[i] = (unsigned char)cJSON_GetArrayItem(json, i)->valueint;
+    cJSON_Delete(json);
+    return count;
+}
+
+static int bench_tree_walk(size_t len) {
+    cJSON *json = cJSON_ParseWithLength(g_frame, len);
+    if (json == NULL) return 0;
+    int count = 0;
+    const cJSON *item;
+    cJSON_ArrayForEach(item, json) g_rgb[count++] = (unsigned char)item->valueint;
+    cJSON_Delete(json);
+    return count;
+}
+
+static int bench_bulk(size_t len) {
+    size_t count = 0;
+    if (!cJSON_ParseUInt8Array(g_frame, len, g_rgb, sizeof(g_rgb), &count)) return 0;
+    return (int)count;
+}
+
+static double bench_run(int (*fn)(size_t), size_t len, int iterations) {
+    const double start = bench_now_ns();
+    for (int i = 0; i < iterations; i++) {
+        if (fn(len) != BENCH_VALUES) return -1;
+    }
+    return (bench_now_ns() - start) / iterations / 1000;
+}
+
+int main(int argc, char **argv) {
+    const int iterations = argc > 1 ? atoi(argv[1]) : 200;
+    const size_t len = bench_build_frame();
+
+    printf("frame: %d LEDs, %zu bytes, %d iterations\n", BENCH_LEDS, len, iterations);
+    printf("cJSON_Parse + cJSON_GetArrayItem: %9.1f us/frame\n", bench_run(bench_tree_indexed, len, iterations));
+    printf("cJSON_Parse + cJSON_ArrayForEach: %9.1f us/frame\n", bench_run(bench_tree_walk, len, iterations));
+    printf("cJSON_ParseUInt8Array:            %9.1f us/frame\n", bench_run(bench_bulk, len, iterations));
+    return 0;
+}
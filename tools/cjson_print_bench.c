@@ -0,0 +1,82 @@
+/*
+ * Host benchmark of cJSON number printing on the messages the firmware produces: the LED status
+ * object and a 1000 element pixel array. Checks the integer path against printf first.
+ *
+ * Build and run from the repository root:
+ *     cc -O2 -Imain/cjson tools/cjson_print_bench.c main/cjson/cJSON.c -lm -o cjson_print_bench
+ *     ./cjson_print_bench [iterations]
+ * Build it against an older cJSON.c to compare.
+ */
+
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "cJSON.h"
+
+#define BENCH_PIXELS    1000
+
+static char g_output[16384];
+
+static double bench_now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+/**
+ * Prints the same tree repeatedly into a preallocated buffer, so only the printing is measured
+ */
+static double bench_print(const cJSON *json, int iterations) {
+    const double start = bench_now_ns();
+    for (int i = 0; i < iterations; i++) {
+        if (!cJSON_PrintPreallocated((cJSON*)json, g_output, sizeof(g_output), 0)) return -1;
+    }
+    return (bench_now_ns() - start) / iterations;
+}
+
+static int bench_check_integers(void) {
+    static const int values[] = {0, 1, -1, 9, 10, 99, 100, 255, -255, 65535, INT_MAX, INT_MIN, INT_MIN + 1};
+    char expected[32];
+    for (size_t i = 0; i < sizeof(values) / sizeof(values[0]); i++) {
+        cJSON *number = cJSON_CreateNumber(values[i]);
+        snprintf(expected, sizeof(expected), "%d", values[i]);
+        const int ok = cJSON_PrintPreallocated(number, g_output, sizeof(g_output), 0) && strcmp(g_output, expected) == 0;
+        cJSON_Delete(number);
+        if (!ok) {
+            fprintf(stderr, "printed %s, expected %s\n", g_output, expected);
+            return 0;
+        }
+    }
+    return 1;
+}
+
+int main(int argc, char **argv) {
+    const int iterations = argc > 1 ? atoi(argv[1]) : 100000;
+    if (!bench_check_integers()) return 1;
+
+    cJSON *status = cJSON_CreateObject();
+    cJSON_AddStringToObject(status, "tag", "led_strip");
+    cJSON_AddNumberToObject(status, "state", 1);
+    cJSON_AddNumberToObject(status, "mode", 2);
+    cJSON *color = cJSON_AddObjectToObject(status, "color");
+    cJSON_AddNumberToObject(color, "red", 255);
+    cJSON_AddNumberToObject(color, "green", 128);
+    cJSON_AddNumberToObject(color, "blue", 0);
+
+    cJSON *pixels = cJSON_CreateArray();
+    for (int i = 0; i < BENCH_PIXELS; i++) cJSON_AddItemToArray(pixels, cJSON_CreateNumber((i * 37) % 256));
+
+    const double status_ns = bench_print(status, iterations);
+    const double pixels_ns = bench_print(pixels, iterations / 100 > 0 ? iterations / 100 : 1);
+    const size_t pixels_len = strlen(g_output);
+
+    printf("status:     %8.1f ns/message\n", status_ns);
+    printf("pixels:     %8.1f ns/message (%d numbers, %zu bytes)\n", pixels_ns, BENCH_PIXELS, pixels_len);
+
+    cJSON_Delete(status);
+    cJSON_Delete(pixels);
+    return 0;
+}
@@ -0,0 +1,163 @@
+/*
+ * Host simulation of the frame clock synchronization: several frame_sync_core instances with skewed, drifting
+ * local clocks exchange beacons with a random delay. The scenario covers a node with a lower ID joining late
+ * and a leader failover. Reports the largest error against the leader and the largest jump of any frame clock.
+ *
+ * Build and run from the repository root:
+ *     cc -O2 -Imain/frame_sync tools/frame_sync_sim.c main/frame_sync/frame_sync_core.c -o frame_sync_sim
+ *     ./frame_sync_sim [seconds] [seed]
+ *
+ * Exits with 1 if a synced frame clock jumped or drifted further than SIM_MAX_ERROR_US.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "frame_sync_core.h"
+
+#define SIM_NODES               4
+#define SIM_TICK_US             10000
+#define SIM_MAX_DELAY_US        2000    // One-way delay of a beacon, uniformly distributed
+#define SIM_MAX_DRIFT_PPM       40      // Typical tolerance of the ESP32 crystal
+#define SIM_SETTLE_US           5000000 // Time after a join or failover before the error is measured
+#define SIM_MAX_ERROR_US        2000
+#define SIM_MAX_BEACONS         (SIM_NODES * 2)
+
+typedef struct {
+    frame_sync_core_t core;
+    int64_t boot_us;           // Local clock at simulation time 0
+    int32_t drift_ppm;
+    int64_t join_us;           // Simulation time the node is powered on
+    int64_t fail_us;           // Simulation time the node is powered off, 0 if never
+    bool running;
+    bool synced_before;
+    int64_t last_frame_us;     // Frame clock at the previous tick
+} sim_node_t;
+
+typedef struct {
+    frame_sync_beacon_t beacon;
+    int from;
+    int64_t deliver_us;        // Simulation time of the reception
+} sim_beacon_t;
+
+static sim_node_t g_nodes[SIM_NODES];
+static sim_beacon_t g_inflight[SIM_MAX_BEACONS * SIM_NODES];
+static int g_inflight_count = 0;
+
+static int64_t sim_local_us(const sim_node_t *node, int64_t sim_us) {
+    return node->boot_us + sim_us + sim_us / 1000000 * node->drift_ppm + sim_us % 1000000 * node->drift_ppm / 1000000;
+}
+
+static int64_t sim_random(int64_t max) {
+    return (int64_t)(rand() % (int)(max + 1));
+}
+
+static bool sim_is_synced(const sim_node_t *node) {
+    return node->running && node->core.offset_valid;
+}
+
+int main(int argc, char *argv[]) {
+    const int64_t duration_us = (argc > 1 ? atoll(argv[1]) : 120) * 1000000LL;
+    srand(argc > 2 ? atoi(argv[2]) : 1);
+
+    // Node 1 has the lowest ID but joins after the others agreed on a time base, node 2 leads first and fails
+    for (int i = 0; i < SIM_NODES; i++) {
+        g_nodes[i].boot_us = 1000000 + sim_random(60000000);
+        g_nodes[i].drift_ppm = (int32_t)sim_random(2 * SIM_MAX_DRIFT_PPM) - SIM_MAX_DRIFT_PPM;
+    }
+    g_nodes[0].join_us = duration_us / 4;
+    g_nodes[1].fail_us = duration_us / 2;
+
+    int64_t max_error_us = 0;
+    int64_t max_jump_us = 0;
+    int64_t settle_until_us = SIM_SETTLE_US;
+    uint32_t leader_changes = 0;
+    uint64_t last_leader = 0;
+
+    for (int64_t t = 0; t < duration_us; t += SIM_TICK_US) {
+        for (int i = 0; i < SIM_NODES; i++) {
+            sim_node_t *node = &g_nodes[i];
+            if (!node->running && t >= node->join_us && (node->fail_us == 0 || t < node->fail_us)) {
+                frame_sync_core_init(&node->core, i + 1, sim_local_us(node, t));
+                node->running = true;
+                settle_until_us = t + SIM_SETTLE_US;
+            }
+            if (node->running && node->fail_us != 0 && t >= node->fail_us) {
+                node->running = false;
+                settle_until_us = t + SIM_SETTLE_US;
+                printf("%7.2f s  node %d fails\n", t / 1e6, i + 1);
+            }
+        }
+
+        // Deliver the beacons which arrived by now
+        for (int b = 0; b < g_inflight_count;) {
+            if (g_inflight[b].deliver_us > t) {
+                b++;
+                continue;
+            }
+            for (int i = 0; i < SIM_NODES; i++) {
+                if (i == g_inflight[b].from || !g_nodes[i].running) continue;
+                frame_sync_core_on_beacon(&g_nodes[i].core, &g_inflight[b].beacon, sim_local_us(&g_nodes[i], g_inflight[b].deliver_us));
+            }
+            g_inflight[b] = g_inflight[--g_inflight_count];
+        }
+
+        for (int i = 0; i < SIM_NODES; i++) {
+            sim_node_t *node = &g_nodes[i];
+            if (!node->running) continue;
+            frame_sync_beacon_t beacon;
+            if (frame_sync_core_poll(&node->core, sim_local_us(node, t), &beacon) && g_inflight_count < (int)(sizeof(g_inflight) / sizeof(g_inflight[0]))) {
+                g_inflight[g_inflight_count++] = (sim_beacon_t){
+                    .beacon = beacon,
+                    .from = i,
+                    .deliver_us = t + sim_random(SIM_MAX_DELAY_US),
+                };
+            }
+        }
+
+        // The leader with the lowest ID is the reference
+        const sim_node_t *leader = NULL;
+        for (int i = 0; i < SIM_NODES && leader == NULL; i++)
+            if (g_nodes[i].running && g_nodes[i].core.role == FRAME_SYNC_ROLE_LEADER) leader = &g_nodes[i];
+        if (leader != NULL && leader->core.node_id != last_leader) {
+            printf("%7.2f s  node %d leads\n", t / 1e6, (int)leader->core.node_id);
+            last_leader = leader->core.node_id;
+            leader_changes++;
+        }
+
+        for (int i = 0; i < SIM_NODES; i++) {
+            sim_node_t *node = &g_nodes[i];
+            if (!sim_is_synced(node)) continue;
+            const int64_t frame_us = frame_sync_core_time(&node->core, sim_local_us(node, t));
+
+            // Every frame clock must keep running once it has a time base, whoever leads.
+            // Nodes which boot together may claim the role at the same time, so the first election is not checked.
+            if (node->synced_before && t >= SIM_SETTLE_US) {
+                const int64_t jump_us = llabs(frame_us - node->last_frame_us - SIM_TICK_US);
+                if (jump_us > max_jump_us) max_jump_us = jump_us;
+                if (jump_us > SIM_MAX_ERROR_US) printf("%7.2f s  node %d frame clock jumps by %lld us\n", t / 1e6, i + 1, (long long)jump_us);
+            }
+            node->synced_before = true;
+            node->last_frame_us = frame_us;
+
+            if (leader != NULL && t >= settle_until_us) {
+                const int64_t error_us = llabs(frame_us - frame_sync_core_time(&leader->core, sim_local_us(leader, t)));
+                if (error_us > max_error_us) max_error_us = error_us;
+            }
+        }
+    }
+
+    printf("\n%d nodes, %.0f s, drift up to %d ppm, delay up to %d us\n",
+           SIM_NODES, duration_us / 1e6, SIM_MAX_DRIFT_PPM, SIM_MAX_DELAY_US);
+    printf("%-8s %8s %8s %8s %8s\n", "node", "role", "rx", "tx", "steps");
+    for (int i = 0; i < SIM_NODES; i++) {
+        static const char *roles[] = {"listen", "leader", "follower"};
+        const frame_sync_core_t *core = &g_nodes[i].core;
+        printf("%-8d %8s %8lu %8lu %8lu%s\n", i + 1, roles[core->role], (unsigned long)core->beacons_rx,
+               (unsigned long)core->beacons_tx, (unsigned long)core->steps, g_nodes[i].running ? "" : " (off)");
+    }
+    printf("leader changes: %lu\nmax error against the leader: %lld us\nmax frame clock jump: %lld us\n",
+           (unsigned long)leader_changes, (long long)max_error_us, (long long)max_jump_us);
+
+    return max_error_us > SIM_MAX_ERROR_US || max_jump_us > SIM_MAX_ERROR_US ? 1 : 0;
+}
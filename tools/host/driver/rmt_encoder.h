@@ -0,0 +1,10 @@
+/*
+ * Only what rmt/rmt_app.h needs to be included on the host
+ */
+
+#ifndef HOST_DRIVER_RMT_ENCODER_H
+#define HOST_DRIVER_RMT_ENCODER_H
+
+#include "driver/rmt_tx.h"
+
+#endif //HOST_DRIVER_RMT_ENCODER_H
@@ -0,0 +1,10 @@
+/*
+ * Only what rmt/rmt_app.h needs to be included on the host
+ */
+
+#ifndef HOST_DRIVER_RMT_TX_H
+#define HOST_DRIVER_RMT_TX_H
+
+#define RMT_CLK_SRC_DEFAULT             0
+
+#endif //HOST_DRIVER_RMT_TX_H
@@ -0,0 +1,18 @@
+/*
+ * Warnings and errors go to stderr, informational logs are dropped unless HOST_LOG_INFO is defined
+ */
+
+#ifndef HOST_ESP_LOG_H
+#define HOST_ESP_LOG_H
+
+#include <stdio.h>
+
+#define ESP_LOGE(tag, fmt, ...)         fprintf(stderr, "E (%s) " fmt "\n", tag, ##__VA_ARGS__)
+#define ESP_LOGW(tag, fmt, ...)         fprintf(stderr, "W (%s) " fmt "\n", tag, ##__VA_ARGS__)
+#ifdef HOST_LOG_INFO
+#define ESP_LOGI(tag, fmt, ...)         fprintf(stderr, "I (%s) " fmt "\n", tag, ##__VA_ARGS__)
+#else
+#define ESP_LOGI(tag, fmt, ...)         do { if (0) fprintf(stderr, fmt, ##__VA_ARGS__); } while (0)
+#endif
+
+#endif //HOST_ESP_LOG_H
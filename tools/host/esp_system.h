@@ -0,0 +1,14 @@
+/*
+ * The tool building the module provides the shutdown handler registry
+ */
+
+#ifndef HOST_ESP_SYSTEM_H
+#define HOST_ESP_SYSTEM_H
+
+#include "esp_err.h"
+
+typedef void (*shutdown_handler_t)(void);
+
+esp_err_t esp_register_shutdown_handler(shutdown_handler_t handler);
+
+#endif //HOST_ESP_SYSTEM_H
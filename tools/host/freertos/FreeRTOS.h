@@ -0,0 +1,31 @@
+/*
+ * Minimal pthread stand-ins for the FreeRTOS API, so modules without hardware access can be built into the
+ * host tools. Only what those modules use is provided, timing and priorities are not modelled.
+ */
+
+#ifndef HOST_FREERTOS_H
+#define HOST_FREERTOS_H
+
+#include <pthread.h>
+#include <stdint.h>
+
+typedef int BaseType_t;
+typedef uint32_t TickType_t;
+
+#define pdTRUE                          1
+#define pdFALSE                         0
+#define portMAX_DELAY                   ((TickType_t)0xffffffffUL)
+
+// One tick is a millisecond like on the device, host_tick_us sets how long it takes in real time
+#define pdMS_TO_TICKS(ms)               ((TickType_t)(ms))
+extern uint32_t host_tick_us;
+
+// Critical sections only have to be mutually exclusive on the host
+typedef pthread_mutex_t portMUX_TYPE;
+#define portMUX_INITIALIZER_UNLOCKED    PTHREAD_MUTEX_INITIALIZER
+#define portENTER_CRITICAL(mux)         pthread_mutex_lock(mux)
+#define portEXIT_CRITICAL(mux)          pthread_mutex_unlock(mux)
+#define taskENTER_CRITICAL(mux)         pthread_mutex_lock(mux)
+#define taskEXIT_CRITICAL(mux)          pthread_mutex_unlock(mux)
+
+#endif //HOST_FREERTOS_H
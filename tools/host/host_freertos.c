@@ -0,0 +1,111 @@
+/*
+ * pthread implementation of the FreeRTOS task calls declared in freertos/task.h.
+ * Tools which run modules with tasks build this file along with them.
+ */
+
+#include <stdlib.h>
+#include <time.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+uint32_t host_tick_us = 1000;
+
+struct host_task {
+    pthread_t thread;
+    TaskFunction_t function;
+    void *params;
+    pthread_mutex_t lock;
+    pthread_cond_t notified;
+    uint32_t notifications;
+};
+
+static _Thread_local struct host_task *g_current = NULL;
+static pthread_key_t g_implicit_key;
+static pthread_once_t g_implicit_once = PTHREAD_ONCE_INIT;
+
+/**
+ * Frees the handle of a thread which was not created as a task when it exits
+ */
+static void host_task_free(void *task) {
+    free(task);
+}
+
+static void host_task_key_init(void) {
+    pthread_key_create(&g_implicit_key, host_task_free);
+}
+
+static struct host_task *host_task_new(void) {
+    struct host_task *task = calloc(1, sizeof(struct host_task));
+    pthread_mutex_init(&task->lock, NULL);
+    pthread_cond_init(&task->notified, NULL);
+    task->thread = pthread_self();
+    return task;
+}
+
+static void *host_task_entry(void *arg) {
+    g_current = arg;
+    g_current->function(g_current->params);
+    return NULL;
+}
+
+TaskHandle_t xTaskGetCurrentTaskHandle(void) {
+    // Threads which were not created as tasks get a handle on first use
+    if (g_current == NULL) {
+        g_current = host_task_new();
+        pthread_once(&g_implicit_once, host_task_key_init);
+        pthread_setspecific(g_implicit_key, g_current);
+    }
+    return g_current;
+}
+
+BaseType_t xTaskCreatePinnedToCore(TaskFunction_t function, const char *name, uint32_t stack_size, void *params,
+                                   uint32_t priority, TaskHandle_t *handle, int core_id) {
+    (void)name; (void)stack_size; (void)priority; (void)core_id;
+    struct host_task *task = host_task_new();
+    task->function = function;
+    task->params = params;
+    if (handle != NULL) *handle = task;
+    if (pthread_create(&task->thread, NULL, host_task_entry, task) != 0) return pdFALSE;
+    pthread_detach(task->thread);
+    return pdTRUE;
+}
+
+void vTaskDelay(TickType_t ticks) {
+    const uint64_t us = (uint64_t)ticks * host_tick_us;
+    const struct timespec delay = {.tv_sec = us / 1000000, .tv_nsec = (us % 1000000) * 1000};
+    nanosleep(&delay, NULL);
+}
+
+TickType_t xTaskGetTickCount(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (TickType_t)(((uint64_t)now.tv_sec * 1000000 + now.tv_nsec / 1000) / host_tick_us);
+}
+
+BaseType_t xTaskNotifyGive(TaskHandle_t task) {
+    pthread_mutex_lock(&task->lock);
+    task->notifications++;
+    pthread_cond_signal(&task->notified);
+    pthread_mutex_unlock(&task->lock);
+    return pdTRUE;
+}
+
+uint32_t ulTaskNotifyTake(BaseType_t clear_on_exit, TickType_t ticks) {
+    struct host_task *task = xTaskGetCurrentTaskHandle();
+    pthread_mutex_lock(&task->lock);
+    if (ticks == portMAX_DELAY) {
+        while (task->notifications == 0) pthread_cond_wait(&task->notified, &task->lock);
+    } else if (task->notifications == 0) {
+        struct timespec deadline;
+        clock_gettime(CLOCK_REALTIME, &deadline);
+        const uint64_t ns = deadline.tv_nsec + (uint64_t)ticks * host_tick_us * 1000;
+        deadline.tv_sec += ns / 1000000000;
+        deadline.tv_nsec = ns % 1000000000;
+        while (task->notifications == 0 && pthread_cond_timedwait(&task->notified, &task->lock, &deadline) == 0) {}
+    }
+    const uint32_t value = task->notifications;
+    if (value > 0) task->notifications = clear_on_exit ? 0 : value - 1;
+    pthread_mutex_unlock(&task->lock);
+    return value;
+}
@@ -0,0 +1,93 @@
+/*
+ * Host benchmark of the MQTT command decoding paths: json_cmd against cJSON_Parse.
+ * Reports the parse time per command and the heap high-water mark of each path.
+ *
+ * Build and run from the repository root:
+ *     cc -O2 -Imain -Imain/cjson tools/json_cmd_bench.c main/json_cmd/json_cmd.c main/cjson/cJSON.c -o json_cmd_bench
+ *     ./json_cmd_bench [iterations]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "cJSON.h"
+#include "json_cmd/json_cmd.h"
+
+static const char COMMAND[] =
+    "{\"tag\": \"led_strip\", \"cid\": \"bench-1\", \"state\": 1, \"mode\": 1, "
+    "\"color\": {\"red\": 255, \"green\": 128, \"blue\": 0}, \"apply_at\": 1760000000000}";
+
+static size_t g_heap_in_use = 0;
+static size_t g_heap_high_water = 0;
+
+/**
+ * Allocator hooks which keep the size in front of every block
+ */
+static void *bench_malloc(size_t size) {
+    size_t *block = malloc(sizeof(size_t) + size);
+    if (block == NULL) return NULL;
+    *block = size;
+    g_heap_in_use += size;
+    if (g_heap_in_use > g_heap_high_water) g_heap_high_water = g_heap_in_use;
+    return block + 1;
+}
+
+static void bench_free(void *ptr) {
+    if (ptr == NULL) return;
+    size_t *block = (size_t*)ptr - 1;
+    g_heap_in_use -= *block;
+    free(block);
+}
+
+static double bench_now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+/**
+ * Decodes the command like the old MQTT handler did, but releases the whole tree
+ */
+static int bench_cjson(const char *data, size_t len) {
+    cJSON *json = cJSON_ParseWithLength(data, len);
+    if (json == NULL) return 0;
+    const cJSON *state = cJSON_GetObjectItemCaseSensitive(json, "state");
+    const cJSON *color = cJSON_GetObjectItemCaseSensitive(json, "color");
+    const cJSON *red = cJSON_GetObjectItemCaseSensitive(color, "red");
+    const int sum = state->valueint + red->valueint;
+    cJSON_Delete(json);
+    return sum;
+}
+
+static int bench_json_cmd(const char *data, size_t len) {
+    json_cmd_t cmd;
+    if (json_cmd_parse(data, len, &cmd, NULL) != JSON_CMD_OK) return 0;
+    return cmd.step.state + cmd.step.color.red;
+}
+
+int main(int argc, char **argv) {
+    const int iterations = argc > 1 ? atoi(argv[1]) : 200000;
+    const size_t len = strlen(COMMAND);
+    cJSON_Hooks hooks = {.malloc_fn = bench_malloc, .free_fn = bench_free};
+    cJSON_InitHooks(&hooks);
+
+    volatile int sink = 0;
+    double start = bench_now_ns();
+    for (int i = 0; i < iterations; i++) sink += bench_cjson(COMMAND, len);
+    const double cjson_ns = (bench_now_ns() - start) / iterations;
+    const size_t cjson_high_water = g_heap_high_water;
+
+    g_heap_high_water = 0;
+    start = bench_now_ns();
+    for (int i = 0; i < iterations; i++) sink += bench_json_cmd(COMMAND, len);
+    const double json_cmd_ns = (bench_now_ns() - start) / iterations;
+
+    printf("command: %zu bytes, %d iterations\n", len, iterations);
+    printf("cJSON_Parse:    %8.1f ns/command, heap high-water %zu bytes\n", cjson_ns, cjson_high_water);
+    printf("json_cmd_parse: %8.1f ns/command, heap high-water %zu bytes, %zu bytes of output struct\n",
+        json_cmd_ns, g_heap_high_water, sizeof(json_cmd_t));
+    printf("speedup: %.1fx\n", cjson_ns / json_cmd_ns);
+    return sink == 0;
+}
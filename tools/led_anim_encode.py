@@ -0,0 +1,183 @@
+#!/usr/bin/env python3
+"""
+Converts a raw RGB dump or a GIF strip into the LANM animation format played by rmt_app.
+
+Raw input is a sequence of frames, each holding LED count * 3 bytes in RGB order.
+GIF input uses the first row of every GIF frame (resized to the LED count) and needs Pillow.
+
+Usage:
+    led_anim_encode.py input.rgb output.lanm --leds 30 --fps 60
+    led_anim_encode.py input.gif output.lanm --leds 30 --keyframe-interval 120
+
+Copy the result to spiffs_image/esp_wifi_connection_panel/anim.lanm to flash it as /spiffs/anim.lanm.
+"""
+
+import argparse
+import struct
+import sys
+import time
+
+MAGIC = b"LANM"
+VERSION = 1
+FLAG_ORDER_GRB = 0x01
+
+FRAME_KEY = 0
+FRAME_DELTA = 1
+
+RLE_LITERAL_MAX = 0x80
+RLE_REPEAT_MAX = 0x80
+RLE_MIN_REPEAT = 3
+
+
+def rle_encode(data):
+    out = bytearray()
+    literal = bytearray()
+    i = 0
+    n = len(data)
+
+    def flush_literal():
+        for start in range(0, len(literal), RLE_LITERAL_MAX):
+            chunk = literal[start:start + RLE_LITERAL_MAX]
+            out.append(len(chunk) - 1)
+            out.extend(chunk)
+        literal.clear()
+
+    while i < n:
+        run = 1
+        while i + run < n and run < RLE_REPEAT_MAX and data[i + run] == data[i]:
+            run += 1
+        if run >= RLE_MIN_REPEAT:
+            flush_literal()
+            out.append(RLE_LITERAL_MAX - 1 + run)
+            out.append(data[i])
+            i += run
+        else:
+            literal.append(data[i])
+            i += 1
+    flush_literal()
+    return bytes(out)
+
+
+def rle_decode(frame_type, payload, fb):
+    i = 0
+    out = 0
+    while i < len(payload):
+        ctrl = payload[i]
+        i += 1
+        if ctrl < RLE_LITERAL_MAX:
+            count = ctrl + 1
+            chunk = payload[i:i + count]
+            i += count
+        else:
+            count = ctrl - (RLE_LITERAL_MAX - 1)
+            chunk = bytes([payload[i]]) * count
+            i += 1
+        for k in range(count):
+            fb[out + k] = chunk[k] if frame_type == FRAME_KEY else fb[out + k] ^ chunk[k]
+        out += count
+    if out != len(fb):
+        raise ValueError("payload covers %d bytes, expected %d" % (out, len(fb)))
+
+
+def to_grb(frame):
+    out = bytearray(len(frame))
+    out[0::3] = frame[1::3]
+    out[1::3] = frame[0::3]
+    out[2::3] = frame[2::3]
+    return bytes(out)
+
+
+def load_raw(path, leds):
+    frame_size = leds * 3
+    with open(path, "rb") as f:
+        data = f.read()
+    if len(data) % frame_size:
+        sys.exit("%s: size %d is not a multiple of the frame size %d" % (path, len(data), frame_size))
+    return [data[i:i + frame_size] for i in range(0, len(data), frame_size)]
+
+
+def load_gif(path, leds):
+    try:
+        from PIL import Image, ImageSequence
+    except ImportError:
+        sys.exit("GIF input requires Pillow (pip install pillow)")
+    frames = []
+    with Image.open(path) as gif:
+        for frame in ImageSequence.Iterator(gif):
+            row = frame.convert("RGB").crop((0, 0, frame.width, 1)).resize((leds, 1))
+            frames.append(row.tobytes())
+    return frames
+
+
+def encode(frames, keyframe_interval):
+    encoded = []
+    previous = None
+    for index, frame in enumerate(frames):
+        key_payload = rle_encode(frame)
+        if previous is None or (keyframe_interval and index % keyframe_interval == 0):
+            encoded.append((FRAME_KEY, key_payload))
+        else:
+            delta_payload = rle_encode(bytes(a ^ b for a, b in zip(frame, previous)))
+            # Keep whichever representation is smaller
+            if len(delta_payload) < len(key_payload):
+                encoded.append((FRAME_DELTA, delta_payload))
+            else:
+                encoded.append((FRAME_KEY, key_payload))
+        previous = frame
+    return encoded
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Encode an LED animation into the LANM format")
+    parser.add_argument("input", help="raw RGB dump (.rgb/.raw) or GIF strip (.gif)")
+    parser.add_argument("output", help="output .lanm file")
+    parser.add_argument("--leds", type=int, default=30, help="number of LEDs per frame (default: 30)")
+    parser.add_argument("--fps", type=float, default=60, help="playback frame rate (default: 60)")
+    parser.add_argument("--keyframe-interval", type=int, default=0,
+                        help="force a keyframe every N frames, 0 = first frame only (default: 0)")
+    parser.add_argument("--rgb", action="store_true", help="store frames in RGB instead of the strip's GRB order")
+    args = parser.parse_args()
+
+    frames = load_gif(args.input, args.leds) if args.input.lower().endswith(".gif") else load_raw(args.input, args.leds)
+    if not frames:
+        sys.exit("%s: no frames found" % args.input)
+    if len(frames) > 0xFFFF:
+        sys.exit("too many frames: %d (max 65535)" % len(frames))
+    frame_interval_ms = int(round(1000 / args.fps)) if args.fps > 0 else 0
+    if not 1 <= frame_interval_ms <= 0xFFFF:
+        sys.exit("--fps %g gives a frame interval outside 1..65535 ms" % args.fps)
+    if not args.rgb:
+        frames = [to_grb(frame) for frame in frames]
+
+    encoded = encode(frames, args.keyframe_interval)
+
+    header = struct.pack("<4sBBHHH", MAGIC, VERSION, 0 if args.rgb else FLAG_ORDER_GRB,
+                         args.leds, len(frames), frame_interval_ms)
+    with open(args.output, "wb") as f:
+        f.write(header)
+        for frame_type, payload in encoded:
+            f.write(struct.pack("<BBH", frame_type, 0, len(payload)))
+            f.write(payload)
+
+    # Verify the round trip and measure the host decode time
+    fb = bytearray(args.leds * 3)
+    start = time.perf_counter()
+    for index, (frame_type, payload) in enumerate(encoded):
+        rle_decode(frame_type, payload, fb)
+        if bytes(fb) != frames[index]:
+            sys.exit("round trip mismatch at frame %d" % index)
+    decode_us = (time.perf_counter() - start) * 1e6 / len(encoded)
+
+    raw_size = len(frames) * args.leds * 3
+    file_size = len(header) + sum(4 + len(payload) for _, payload in encoded)
+    keyframes = sum(1 for frame_type, _ in encoded if frame_type == FRAME_KEY)
+    print("frames:            %d (%d key, %d delta)" % (len(encoded), keyframes, len(encoded) - keyframes))
+    print("raw size:          %d bytes" % raw_size)
+    print("encoded size:      %d bytes" % file_size)
+    print("compression ratio: %.2f" % (raw_size / file_size))
+    print("flash bandwidth:   %.1f KB/s at %.0f FPS" % (file_size / len(frames) * args.fps / 1024, args.fps))
+    print("host decode time:  %.1f us/frame (device time is logged by led_anim on every loop)" % decode_us)
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,224 @@
+/*
+ * Host test of the LANM decoder. Checks led_anim_decode_frame() against hand made RLE payloads, then encodes a
+ * generated animation with led_anim_encode.py and plays it through led_anim_open() / led_anim_next_frame() for
+ * two loops on a strip of the same length, a shorter and a longer one. A truncated copy has to fail cleanly
+ * and a header with a zero frame interval has to be rejected.
+ *
+ * Build and run from the repository root:
+ *     cc -O2 -Itools/host -Imain/led_anim tools/led_anim_test.c main/led_anim/led_anim.c -o led_anim_test
+ *     ./led_anim_test [python]
+ */
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "led_anim.h"
+
+#define TEST_LEDS               40
+#define TEST_FRAMES             50
+#define TEST_KEYFRAME_INTERVAL  16
+#define TEST_FRAME_SIZE         (TEST_LEDS * 3)
+#define TEST_CANARY             0xA5
+
+static int g_failures = 0;
+
+#define TEST_CHECK(cond, ...) do { if (!(cond)) { printf("FAIL: " __VA_ARGS__); printf("\n"); g_failures++; } } while (0)
+
+static uint8_t g_frames[TEST_FRAMES][TEST_FRAME_SIZE];
+
+// --------- DECODER --------- //
+
+static void test_decode(void) {
+    uint8_t fb[8];
+
+    // Literal run followed by a repeat run
+    const uint8_t key[] = {0x02, 1, 2, 3, 0x84, 9};
+    TEST_CHECK(led_anim_decode_frame(LED_ANIM_FRAME_KEY, key, sizeof(key), fb, 8) == ESP_OK, "key frame rejected");
+    TEST_CHECK(memcmp(fb, (uint8_t[]){1, 2, 3, 9, 9, 9, 9, 9}, 8) == 0, "key frame decoded wrong");
+
+    // XOR literals, a zero run which keeps the pixels and a non zero run
+    const uint8_t delta[] = {0x01, 0xFF, 0x00, 0x81, 0x00, 0x83, 0x01};
+    TEST_CHECK(led_anim_decode_frame(LED_ANIM_FRAME_DELTA, delta, sizeof(delta), fb, 8) == ESP_OK, "delta frame rejected");
+    TEST_CHECK(memcmp(fb, (uint8_t[]){0xFE, 2, 3, 9, 8, 8, 8, 8}, 8) == 0, "delta frame decoded wrong");
+
+    // The longest runs of both kinds
+    uint8_t long_fb[LED_ANIM_RLE_LITERAL_MAX + LED_ANIM_RLE_REPEAT_MAX];
+    uint8_t long_payload[1 + LED_ANIM_RLE_LITERAL_MAX + 2];
+    long_payload[0] = LED_ANIM_RLE_LITERAL_MAX - 1;
+    for (int i = 0; i < LED_ANIM_RLE_LITERAL_MAX; i++) long_payload[1 + i] = i;
+    long_payload[1 + LED_ANIM_RLE_LITERAL_MAX] = 0xFF;
+    long_payload[2 + LED_ANIM_RLE_LITERAL_MAX] = 7;
+    TEST_CHECK(led_anim_decode_frame(LED_ANIM_FRAME_KEY, long_payload, sizeof(long_payload), long_fb, sizeof(long_fb)) == ESP_OK,
+               "longest runs rejected");
+    TEST_CHECK(long_fb[LED_ANIM_RLE_LITERAL_MAX - 1] == LED_ANIM_RLE_LITERAL_MAX - 1 && long_fb[sizeof(long_fb) - 1] == 7,
+               "longest runs decoded wrong");
+
+    // Payloads which don't cover the frame exactly never write past it
+    uint8_t guarded[9];
+    memset(guarded, TEST_CANARY, sizeof(guarded));
+    const uint8_t too_long[] = {0x88, 1};
+    const uint8_t too_short[] = {0x83, 1};
+    const uint8_t cut_literal[] = {0x03, 1, 2};
+    const uint8_t cut_repeat[] = {0x02, 1, 2, 3, 0x84};
+    TEST_CHECK(led_anim_decode_frame(LED_ANIM_FRAME_KEY, too_long, sizeof(too_long), guarded, 8) == ESP_ERR_INVALID_SIZE, "overlong run accepted");
+    TEST_CHECK(led_anim_decode_frame(LED_ANIM_FRAME_KEY, too_short, sizeof(too_short), guarded, 8) == ESP_ERR_INVALID_SIZE, "short payload accepted");
+    TEST_CHECK(led_anim_decode_frame(LED_ANIM_FRAME_KEY, cut_literal, sizeof(cut_literal), guarded, 8) == ESP_ERR_INVALID_SIZE, "cut literal accepted");
+    TEST_CHECK(led_anim_decode_frame(LED_ANIM_FRAME_KEY, cut_repeat, sizeof(cut_repeat), guarded, 8) == ESP_ERR_INVALID_SIZE, "cut repeat accepted");
+    TEST_CHECK(guarded[8] == TEST_CANARY, "decoder wrote past the frame");
+}
+
+// --------- PLAYER --------- //
+
+/**
+ * A dot running over a slowly changing gradient, with a blank stretch which RLE compresses
+ */
+static void test_generate(void) {
+    for (int f = 0; f < TEST_FRAMES; f++) {
+        for (int led = 0; led < TEST_LEDS; led++) {
+            uint8_t *pixel = &g_frames[f][led * 3];
+            const bool blank = led >= TEST_LEDS / 2 && led < TEST_LEDS * 3 / 4;
+            pixel[0] = blank ? 0 : (uint8_t)(led * 6 + f);
+            pixel[1] = blank ? 0 : (uint8_t)(255 - led * 6);
+            pixel[2] = led == f % TEST_LEDS ? 255 : 0;
+        }
+    }
+}
+
+static bool test_encode(const char *python, const char *raw_path, const char *anim_path) {
+    FILE *raw = fopen(raw_path, "wb");
+    if (raw == NULL || fwrite(g_frames, sizeof(g_frames), 1, raw) != 1) {
+        perror(raw_path);
+        if (raw != NULL) fclose(raw);
+        return false;
+    }
+    fclose(raw);
+
+    char command[512];
+    snprintf(command, sizeof(command), "%s tools/led_anim_encode.py %s %s --leds %d --rgb --keyframe-interval %d > /dev/null",
+             python, raw_path, anim_path, TEST_LEDS, TEST_KEYFRAME_INTERVAL);
+    return system(command) == 0;
+}
+
+/**
+ * Plays two loops into a strip of the given length and compares every frame
+ */
+static void test_play(const char *anim_path, int strip_leds) {
+    const size_t fb_len = strip_leds * 3;
+    const size_t shown = fb_len < TEST_FRAME_SIZE ? fb_len : TEST_FRAME_SIZE;
+    uint8_t *fb = malloc(fb_len);
+    memset(fb, TEST_CANARY, fb_len);
+
+    led_anim_player_t player;
+    TEST_CHECK(led_anim_open(anim_path, &player) == ESP_OK, "%d LEDs: open failed", strip_leds);
+    TEST_CHECK(player.header.led_count == TEST_LEDS && player.header.frame_count == TEST_FRAMES, "%d LEDs: wrong header", strip_leds);
+
+    for (int n = 0; n < TEST_FRAMES * 2 && player.fp != NULL; n++) {
+        const esp_err_t err = led_anim_next_frame(&player, fb, fb_len);
+        TEST_CHECK(err == ESP_OK, "%d LEDs: frame %d failed with %s", strip_leds, n, esp_err_to_name(err));
+        if (err != ESP_OK) break;
+        TEST_CHECK(memcmp(fb, g_frames[n % TEST_FRAMES], shown) == 0, "%d LEDs: frame %d differs", strip_leds, n);
+        for (size_t i = shown; i < fb_len; i++) {
+            if (fb[i] == TEST_CANARY) continue;
+            TEST_CHECK(false, "%d LEDs: frame %d touched LED %d", strip_leds, n, (int)(i / 3));
+            break;
+        }
+    }
+    printf("%2d LEDs: %lu frames, %lu bytes read, compression %.2f, avg decode %llu us\n", strip_leds,
+           (unsigned long)player.stats.frames_decoded, (unsigned long)player.stats.file_bytes,
+           (double)player.stats.frames_decoded * TEST_FRAME_SIZE / player.stats.file_bytes,
+           (unsigned long long)(player.stats.total_decode_us / (player.stats.frames_decoded ? player.stats.frames_decoded : 1)));
+    led_anim_close(&player);
+    TEST_CHECK(player.fp == NULL && player.payload == NULL && player.frame == NULL, "%d LEDs: close left resources", strip_leds);
+    free(fb);
+}
+
+/**
+ * Cuts the file in the middle of a frame, playback has to stop with an error instead of showing garbage
+ */
+static void test_truncated(const char *anim_path, const char *cut_path) {
+    FILE *in = fopen(anim_path, "rb");
+    FILE *out = fopen(cut_path, "wb");
+    if (in == NULL || out == NULL) {
+        TEST_CHECK(false, "can't copy %s", anim_path);
+        if (in != NULL) fclose(in);
+        if (out != NULL) fclose(out);
+        return;
+    }
+    fseek(in, 0, SEEK_END);
+    const long size = ftell(in);
+    fseek(in, 0, SEEK_SET);
+    for (long i = 0; i < size * 2 / 3; i++) fputc(fgetc(in), out);
+    fclose(in);
+    fclose(out);
+
+    led_anim_player_t player;
+    uint8_t fb[TEST_FRAME_SIZE];
+    TEST_CHECK(led_anim_open(cut_path, &player) == ESP_OK, "truncated file: header rejected");
+    esp_err_t err = ESP_OK;
+    int frames = 0;
+    while (frames < TEST_FRAMES && (err = led_anim_next_frame(&player, fb, sizeof(fb))) == ESP_OK) frames++;
+    TEST_CHECK(err != ESP_OK && frames < TEST_FRAMES, "truncated file: all %d frames played", frames);
+    led_anim_close(&player);
+    printf("truncated: stopped after %d frames with %s\n", frames, esp_err_to_name(err));
+}
+
+/**
+ * A zero frame interval would make the player spin without a delay
+ */
+static void test_zero_interval(const char *path) {
+    const led_anim_header_t header = {
+        .magic = LED_ANIM_MAGIC, .version = LED_ANIM_VERSION, .led_count = 1, .frame_count = 1, .frame_interval_ms = 0
+    };
+    const led_anim_frame_header_t frame_header = {.type = LED_ANIM_FRAME_KEY, .payload_len = 2};
+    const uint8_t payload[] = {0x82, 0};
+    FILE *out = fopen(path, "wb");
+    if (out == NULL) {
+        TEST_CHECK(false, "can't write %s", path);
+        return;
+    }
+    fwrite(&header, sizeof(header), 1, out);
+    fwrite(&frame_header, sizeof(frame_header), 1, out);
+    fwrite(payload, sizeof(payload), 1, out);
+    fclose(out);
+
+    led_anim_player_t player;
+    TEST_CHECK(led_anim_open(path, &player) == ESP_ERR_INVALID_VERSION, "zero frame interval accepted");
+    TEST_CHECK(player.fp == NULL && player.payload == NULL, "rejected header left resources");
+}
+
+int main(int argc, char *argv[]) {
+    const char *python = argc > 1 ? argv[1] : "python3";
+    char raw_path[] = "/tmp/led_anim_test_XXXXXX";
+    const int fd = mkstemp(raw_path);
+    if (fd < 0) {
+        perror("mkstemp");
+        return 1;
+    }
+    close(fd);
+    char anim_path[sizeof(raw_path) + 8], cut_path[sizeof(raw_path) + 8];
+    snprintf(anim_path, sizeof(anim_path), "%s.lanm", raw_path);
+    snprintf(cut_path, sizeof(cut_path), "%s.cut", raw_path);
+
+    test_decode();
+    test_zero_interval(cut_path);
+
+    test_generate();
+    if (!test_encode(python, raw_path, anim_path)) {
+        printf("FAIL: led_anim_encode.py failed\n");
+        g_failures++;
+    } else {
+        test_play(anim_path, TEST_LEDS);
+        test_play(anim_path, TEST_LEDS - 10);
+        test_play(anim_path, TEST_LEDS + 10);
+        test_truncated(anim_path, cut_path);
+    }
+
+    remove(raw_path);
+    remove(anim_path);
+    remove(cut_path);
+    printf(g_failures == 0 ? "PASS\n" : "FAIL: %d checks\n", g_failures);
+    return g_failures == 0 ? 0 : 1;
+}
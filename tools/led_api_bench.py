@@ -0,0 +1,91 @@
+#!/usr/bin/env python3
+"""
+Measures requests per second of the REST LED API on a running controller: GET /api/led, a JSON and a
+MessagePack command on /api/led, and a raw frame on /api/led/pixels. Every connection is kept alive,
+--connections spreads the load over several sockets (the server handles them on one task).
+
+Usage:
+    led_api_bench.py 192.168.0.1 [--seconds 10] [--connections 1] [--leds 30]
+
+No on-device figures have been recorded yet; the script has only been exercised against a local stub server.
+"""
+
+import argparse
+import http.client
+import threading
+import time
+
+# {"tag": "led_strip", "state": 1, "mode": 1, "color": {"red": 255, "green": 128, "blue": 0}}
+MSGPACK_COMMAND = bytes.fromhex(
+    "84a3746167a96c65645f7374726970a5737461746501a46d6f646501a5636f6c6f7283a3726564ccffa5677265656ecc80a4626c756500")
+
+
+def scenarios(leds):
+    frame = bytes((i * 37) % 256 for i in range(leds * 3))
+    return [
+        ("GET /api/led", "GET", "/api/led", None, {}),
+        ("PUT /api/led (JSON)", "PUT", "/api/led",
+         b'{"state": 1, "mode": 1, "color": {"red": 255, "green": 128, "blue": 0}}', {"Content-Type": "application/json"}),
+        ("PUT /api/led (MessagePack)", "PUT", "/api/led", MSGPACK_COMMAND, {"Content-Type": "application/msgpack"}),
+        ("POST /api/led/pixels", "POST", "/api/led/pixels", frame, {"Content-Type": "application/octet-stream"}),
+    ]
+
+
+def worker(host, port, method, path, body, headers, deadline, latencies, errors):
+    conn = http.client.HTTPConnection(host, port, timeout=5)
+    while time.monotonic() < deadline:
+        start = time.monotonic()
+        try:
+            conn.request(method, path, body=body, headers=headers)
+            response = conn.getresponse()
+            response.read()
+            if response.status >= 300:
+                errors.append(response.status)
+                continue
+        except (OSError, http.client.HTTPException) as e:
+            errors.append(str(e))
+            conn.close()
+            conn = http.client.HTTPConnection(host, port, timeout=5)
+            continue
+        latencies.append(time.monotonic() - start)
+    conn.close()
+
+
+def run(host, port, scenario, seconds, connections):
+    name, method, path, body, headers = scenario
+    latencies, errors = [], []
+    deadline = time.monotonic() + seconds
+    threads = [threading.Thread(target=worker, args=(host, port, method, path, body, headers, deadline, latencies, errors))
+               for _ in range(connections)]
+    for thread in threads:
+        thread.start()
+    for thread in threads:
+        thread.join()
+
+    latencies.sort()
+    if not latencies:
+        print("%-28s no successful requests, %d errors (%s)" % (name, len(errors), errors[:1]))
+        return
+
+    def percentile(p):
+        return latencies[min(len(latencies) - 1, int(len(latencies) * p))] * 1000
+
+    print("%-28s %8.1f req/s   p50 %6.1f ms   p99 %6.1f ms   %d errors"
+          % (name, len(latencies) / seconds, percentile(0.5), percentile(0.99), len(errors)))
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("host")
+    parser.add_argument("--port", type=int, default=80)
+    parser.add_argument("--seconds", type=float, default=10)
+    parser.add_argument("--connections", type=int, default=1)
+    parser.add_argument("--leds", type=int, default=30, help="RMT_APP_LED_NUMBERS of the firmware")
+    args = parser.parse_args()
+
+    for scenario in scenarios(args.leds):
+        run(args.host, args.port, scenario, args.seconds, args.connections)
+
+
+if __name__ == "__main__":
+    main()
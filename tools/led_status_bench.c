@@ -0,0 +1,119 @@
+/*
+ * Host benchmark of the status message serializers: the cJSON tree used before against the led_status template.
+ * Reports the time and CPU cycles per message and the heap traffic of each path.
+ *
+ * Build and run from the repository root:
+ *     cc -O2 -Imain -Imain/cjson tools/led_status_bench.c main/led_status/led_status.c main/cjson/cJSON.c -o led_status_bench
+ *     ./led_status_bench [iterations]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define BENCH_CYCLES() __rdtsc()
+#else
+#define BENCH_CYCLES() 0
+#endif
+
+#include "cJSON.h"
+#include "led_status/led_status.h"
+
+static size_t g_allocs = 0;
+static size_t g_alloc_bytes = 0;
+static size_t g_heap_in_use = 0;
+static size_t g_heap_high_water = 0;
+
+/**
+ * Allocator hooks which keep the size in front of every block
+ */
+static void *bench_malloc(size_t size) {
+    size_t *block = malloc(sizeof(size_t) + size);
+    if (block == NULL) return NULL;
+    *block = size;
+    g_allocs++;
+    g_alloc_bytes += size;
+    g_heap_in_use += size;
+    if (g_heap_in_use > g_heap_high_water) g_heap_high_water = g_heap_in_use;
+    return block + 1;
+}
+
+static void bench_free(void *ptr) {
+    if (ptr == NULL) return;
+    size_t *block = (size_t*)ptr - 1;
+    g_heap_in_use -= *block;
+    free(block);
+}
+
+static double bench_now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static cJSON *bench_build_tree(const led_status_t *status) {
+    cJSON *json = cJSON_CreateObject();
+    cJSON_AddStringToObject(json, "tag", "led_strip");
+    cJSON_AddNumberToObject(json, "state", status->state);
+    cJSON_AddNumberToObject(json, "mode", status->mode);
+    cJSON *color = cJSON_CreateObject();
+    cJSON_AddNumberToObject(color, "red", status->red);
+    cJSON_AddNumberToObject(color, "green", status->green);
+    cJSON_AddNumberToObject(color, "blue", status->blue);
+    cJSON_AddItemToObject(json, "color", color);
+    return json;
+}
+
+/**
+ * The publisher before the template: a tree plus a formatted string per message
+ */
+static size_t bench_cjson_print(const led_status_t *status) {
+    cJSON *json = bench_build_tree(status);
+    char *str = cJSON_Print(json);
+    const size_t len = strlen(str);
+    cJSON_free(str);
+    cJSON_Delete(json);
+    return len;
+}
+
+static size_t bench_cjson_prealloc(const led_status_t *status) {
+    static char buffer[256];
+    cJSON *json = bench_build_tree(status);
+    cJSON_PrintPreallocated(json, buffer, sizeof(buffer), 0);
+    cJSON_Delete(json);
+    return strlen(buffer);
+}
+
+static size_t bench_template(const led_status_t *status) {
+    static char buffer[LED_STATUS_LEN + 1];
+    return led_status_format(buffer, status);
+}
+
+static void bench_run(const char *name, size_t (*serialize)(const led_status_t*), int iterations) {
+    g_allocs = g_alloc_bytes = g_heap_high_water = 0;
+    volatile size_t sink = 0;
+    led_status_t status = {.state = 1, .mode = 1, .red = 255, .green = 128, .blue = 0};
+    const double start_ns = bench_now_ns();
+    const unsigned long long start_cycles = BENCH_CYCLES();
+    for (int i = 0; i < iterations; i++) {
+        status.green = i;
+        sink += serialize(&status);
+    }
+    const double cycles = (double)(BENCH_CYCLES() - start_cycles) / iterations;
+    const double ns = (bench_now_ns() - start_ns) / iterations;
+    printf("%-24s %6zu bytes %8.1f ns %8.0f cycles %5.1f allocs %6.1f heap bytes/msg, high-water %zu bytes\n",
+        name, sink / iterations, ns, cycles, (double)g_allocs / iterations, (double)g_alloc_bytes / iterations, g_heap_high_water);
+}
+
+int main(int argc, char **argv) {
+    const int iterations = argc > 1 ? atoi(argv[1]) : 200000;
+    cJSON_Hooks hooks = {.malloc_fn = bench_malloc, .free_fn = bench_free};
+    cJSON_InitHooks(&hooks);
+
+    bench_run("cJSON_Print", bench_cjson_print, iterations);
+    bench_run("cJSON_PrintPreallocated", bench_cjson_prealloc, iterations);
+    bench_run("led_status_format", bench_template, iterations);
+    return 0;
+}
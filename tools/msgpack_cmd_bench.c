@@ -0,0 +1,99 @@
+/*
+ * Host benchmark of the two payload formats: the same command decoded by json_cmd and msgpack_cmd,
+ * and the same status encoded by led_status and msgpack_cmd. Reports payload sizes and times.
+ *
+ * Build and run from the repository root:
+ *     cc -O2 -Imain tools/msgpack_cmd_bench.c main/json_cmd/json_cmd.c main/msgpack_cmd/msgpack_cmd.c \
+ *         main/led_status/led_status.c -o msgpack_cmd_bench
+ *     ./msgpack_cmd_bench [iterations]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "json_cmd/json_cmd.h"
+#include "msgpack_cmd/msgpack_cmd.h"
+#include "led_status/led_status.h"
+
+static const char COMMAND_JSON[] =
+    "{\"tag\": \"led_strip\", \"cid\": \"bench-1\", \"state\": 1, \"mode\": 1, "
+    "\"color\": {\"red\": 255, \"green\": 128, \"blue\": 0}, \"apply_at\": 1760000000000}";
+
+/**
+ * The command above as MessagePack
+ */
+static const uint8_t COMMAND_MSGPACK[] = {
+    0x86,
+    0xa3, 't', 'a', 'g', 0xa9, 'l', 'e', 'd', '_', 's', 't', 'r', 'i', 'p',
+    0xa3, 'c', 'i', 'd', 0xa7, 'b', 'e', 'n', 'c', 'h', '-', '1',
+    0xa5, 's', 't', 'a', 't', 'e', 0x01,
+    0xa4, 'm', 'o', 'd', 'e', 0x01,
+    0xa5, 'c', 'o', 'l', 'o', 'r', 0x83,
+        0xa3, 'r', 'e', 'd', 0xcc, 0xff,
+        0xa5, 'g', 'r', 'e', 'e', 'n', 0xcc, 0x80,
+        0xa4, 'b', 'l', 'u', 'e', 0x00,
+    0xa8, 'a', 'p', 'p', 'l', 'y', '_', 'a', 't', 0xcf, 0x00, 0x00, 0x01, 0x99, 0xc8, 0x2c, 0xc0, 0x00,
+};
+
+static double bench_now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+int main(int argc, char **argv) {
+    const int iterations = argc > 1 ? atoi(argv[1]) : 200000;
+    const led_status_t status = {.state = 1, .mode = 2, .red = 255, .green = 128, .blue = 0};
+    volatile int sink = 0;
+    json_cmd_t cmd;
+
+    // Both decoders must agree before anything is timed
+    json_cmd_t expected;
+    if (json_cmd_parse(COMMAND_JSON, strlen(COMMAND_JSON), &expected, NULL) != JSON_CMD_OK ||
+        msgpack_cmd_parse(COMMAND_MSGPACK, sizeof(COMMAND_MSGPACK), &cmd, NULL) != JSON_CMD_OK ||
+        memcmp(&expected, &cmd, offsetof(json_cmd_t, batch)) != 0) {
+        fprintf(stderr, "decoders disagree\n");
+        return 1;
+    }
+
+    double start = bench_now_ns();
+    for (int i = 0; i < iterations; i++) {
+        json_cmd_parse(COMMAND_JSON, strlen(COMMAND_JSON), &cmd, NULL);
+        sink += cmd.step.state;
+    }
+    const double json_decode_ns = (bench_now_ns() - start) / iterations;
+
+    start = bench_now_ns();
+    for (int i = 0; i < iterations; i++) {
+        msgpack_cmd_parse(COMMAND_MSGPACK, sizeof(COMMAND_MSGPACK), &cmd, NULL);
+        sink += cmd.step.state;
+    }
+    const double msgpack_decode_ns = (bench_now_ns() - start) / iterations;
+
+    char json_status[LED_STATUS_LEN + 1];
+    size_t json_status_len = 0;
+    start = bench_now_ns();
+    for (int i = 0; i < iterations; i++) {
+        json_status_len = led_status_format(json_status, &status);
+        sink += json_status[i % json_status_len];
+    }
+    const double json_encode_ns = (bench_now_ns() - start) / iterations;
+
+    uint8_t msgpack_status[MSGPACK_CMD_STATUS_MAX_LEN];
+    size_t msgpack_status_len = 0;
+    start = bench_now_ns();
+    for (int i = 0; i < iterations; i++) {
+        msgpack_status_len = msgpack_cmd_format_status(msgpack_status, &status);
+        sink += msgpack_status[i % msgpack_status_len];
+    }
+    const double msgpack_encode_ns = (bench_now_ns() - start) / iterations;
+
+    printf("%d iterations\n", iterations);
+    printf("command decode: json    %3zu bytes %8.1f ns\n", strlen(COMMAND_JSON), json_decode_ns);
+    printf("                msgpack %3zu bytes %8.1f ns\n", sizeof(COMMAND_MSGPACK), msgpack_decode_ns);
+    printf("status encode:  json    %3zu bytes %8.1f ns\n", json_status_len, json_encode_ns);
+    printf("                msgpack %3zu bytes %8.1f ns\n", msgpack_status_len, msgpack_encode_ns);
+    return sink == 0;
+}
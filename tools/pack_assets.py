@@ -0,0 +1,176 @@
+#!/usr/bin/env python3
+"""
+Packs the web panel into one read-only blob which is embedded in the app image, and generates the
+C index used by web_assets: a perfect hash from request path to offset, length, MIME type and ETag.
+
+A file "x.js.gz" next to "x.js" becomes the precompressed variant of "/x.js". With --gzip, text assets
+without one get a variant generated when compressing actually saves space.
+
+Usage:
+    pack_assets.py spiffs_image/esp_wifi_connection_panel web_assets_bundle.bin web_assets_bundle.h --gzip
+
+The build runs it when HTTP_SERVER_EMBED_ASSETS is enabled (idf.py -DHTTP_SERVER_EMBED_ASSETS=ON build).
+"""
+
+import argparse
+import gzip
+import os
+import sys
+import zlib
+
+FNV_OFFSET = 2166136261
+FNV_PRIME = 16777619
+ALIGN = 4
+MAX_SEED_TRIES = 100000
+
+# Keep in sync with g_mime_types in main/web_assets/web_assets.c
+MIME_TYPES = {
+    ".html": "text/html",
+    ".css": "text/css",
+    ".js": "application/javascript",
+    ".json": "application/json",
+    ".svg": "image/svg+xml",
+    ".png": "image/png",
+    ".jpg": "image/jpeg",
+    ".ico": "image/x-icon",
+    ".woff2": "font/woff2",
+    ".txt": "text/plain",
+}
+COMPRESSIBLE = {".html", ".css", ".js", ".json", ".svg", ".txt"}
+# Files on the SPIFFS image which are read by the firmware and not served, e.g. the animation of led_anim_encode.py
+EXCLUDED = {".lanm"}
+
+
+def bundle_hash(path, seed):
+    """FNV-1a over the path, seeded through the offset basis. Matches web_assets_bundle_hash()."""
+    h = (FNV_OFFSET ^ seed) & 0xFFFFFFFF
+    for b in path.encode():
+        h ^= b
+        h = (h * FNV_PRIME) & 0xFFFFFFFF
+    return h
+
+
+def etag(data):
+    return '"%08x-%x"' % (zlib.crc32(data) & 0xFFFFFFFF, len(data))
+
+
+def collect(src_dir, generate_gzip):
+    """Maps request paths to their plain and precompressed contents."""
+    assets = {}
+    for root, _, files in os.walk(src_dir):
+        for name in sorted(files):
+            if os.path.splitext(name)[1] in EXCLUDED:
+                continue
+            full = os.path.join(root, name)
+            path = "/" + os.path.relpath(full, src_dir).replace(os.sep, "/")
+            with open(full, "rb") as f:
+                data = f.read()
+            if path.endswith(".gz"):
+                assets.setdefault(path[:-3], {})["gz"] = data
+            else:
+                assets.setdefault(path, {})["plain"] = data
+
+    for path, variants in assets.items():
+        ext = os.path.splitext(path)[1]
+        if generate_gzip and "gz" not in variants and "plain" in variants and ext in COMPRESSIBLE:
+            packed = gzip.compress(variants["plain"], compresslevel=9, mtime=0)
+            if len(packed) < len(variants["plain"]):
+                variants["gz"] = packed
+    return assets
+
+
+def find_seed(paths):
+    """Finds the smallest power of two table and a seed which maps every path to its own slot."""
+    slots = 1
+    while slots < len(paths):
+        slots *= 2
+    while True:
+        for seed in range(MAX_SEED_TRIES):
+            used = set()
+            for path in paths:
+                slot = bundle_hash(path, seed) & (slots - 1)
+                if slot in used:
+                    break
+                used.add(slot)
+            else:
+                return seed, slots
+        slots *= 2
+
+
+def c_string(s):
+    return '"' + s.replace("\\", "\\\\").replace('"', '\\"') + '"'
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("src_dir")
+    parser.add_argument("out_bin")
+    parser.add_argument("out_header")
+    parser.add_argument("--gzip", action="store_true", help="generate .gz variants for text assets")
+    args = parser.parse_args()
+
+    assets = collect(args.src_dir, args.gzip)
+    if not assets:
+        sys.exit("pack_assets: no files found in %s" % args.src_dir)
+
+    paths = sorted(assets)
+    seed, slots = find_seed(paths)
+
+    blob = bytearray()
+
+    def append(data):
+        offset = len(blob)
+        blob.extend(data)
+        blob.extend(b"\0" * (-len(blob) % ALIGN))
+        return offset
+
+    entries = []
+    for path in paths:
+        variants = assets[path]
+        ext = os.path.splitext(path)[1]
+        entry = {"path": path, "mime": MIME_TYPES.get(ext, "application/octet-stream")}
+        for key in ("plain", "gz"):
+            data = variants.get(key)
+            entry[key] = (append(data), len(data), etag(data)) if data is not None else (0, 0, None)
+        entries.append(entry)
+
+    index = [0] * slots
+    for i, path in enumerate(paths):
+        index[bundle_hash(path, seed) & (slots - 1)] = i + 1
+
+    with open(args.out_bin, "wb") as f:
+        f.write(blob)
+
+    lines = [
+        "// Generated by tools/pack_assets.py from %s, do not edit" % os.path.basename(os.path.normpath(args.src_dir)),
+        "",
+        "#define WEB_ASSETS_BUNDLE_SEED          0x%08xu" % seed,
+        "#define WEB_ASSETS_BUNDLE_SLOTS         %d" % slots,
+        "#define WEB_ASSETS_BUNDLE_SIZE          %d" % len(blob),
+        "",
+        "static const web_assets_bundle_entry_t g_bundle_entries[] = {",
+    ]
+    for e in entries:
+        plain_offset, plain_size, plain_etag = e["plain"]
+        gz_offset, gz_size, gz_etag = e["gz"]
+        lines.append(
+            "    {.path = %s, .mime = %s, .offset = %d, .size = %d, .etag = %s, .gz_offset = %d, .gz_size = %d, .gz_etag = %s},"
+            % (c_string(e["path"]), c_string(e["mime"]), plain_offset, plain_size,
+               c_string(plain_etag) if plain_etag else "NULL", gz_offset, gz_size, c_string(gz_etag) if gz_etag else "NULL"))
+    lines += [
+        "};",
+        "",
+        "// Entry index + 1 per hash slot, 0 for empty slots",
+        "static const uint16_t g_bundle_slots[WEB_ASSETS_BUNDLE_SLOTS] = {%s};" % ", ".join(str(i) for i in index),
+        "",
+    ]
+    with open(args.out_header, "w") as f:
+        f.write("\n".join(lines))
+
+    plain_total = sum(len(v.get("plain", b"")) for v in assets.values())
+    print("pack_assets: %d files, %d bytes of content, %d byte blob, %d hash slots (seed %d)"
+          % (len(entries), plain_total, len(blob), slots, seed))
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,301 @@
+/*
+ * Host command storm against rmt_store with a stub NVS. Checks the legacy key migration, including a failed
+ * write, and the upgrade of a version 1 blob, then lets two threads mark state changes every few milliseconds while the write-behind task runs.
+ * Some NVS commits are made to fail on purpose. Reports the commits per hour against the state changes and
+ * checks that the last state is what ends up in NVS after the shutdown flush.
+ *
+ * Time runs faster than on the device, a tick (1 ms of firmware time) takes host_tick_us.
+ *
+ * Build and run from the repository root:
+ *     cc -O2 -pthread -Itools/host -Imain tools/rmt_store_storm.c tools/host/host_freertos.c main/rmt_store/rmt_store.c -o rmt_store_storm
+ *     ./rmt_store_storm [minutes]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_system.h"
+#include "esp_rom_crc.h"
+#include "nvs.h"
+#include "rmt_store/rmt_store.h"
+
+#define STORM_TICK_US           20      // 50 times faster than the device
+#define STORM_THREADS           2
+#define STORM_MARK_EVERY_MS     10      // Per thread, like dragging a color picker
+#define STORM_FAIL_EVERY        7       // Every n-th commit during the storm fails
+#define NVS_STUB_KEYS           8
+
+// --------- STUB NVS --------- //
+
+typedef struct {
+    char key[16];
+    uint8_t data[16];
+    size_t len;
+} nvs_stub_entry_t;
+
+static nvs_stub_entry_t g_nvs[NVS_STUB_KEYS];
+static pthread_mutex_t g_nvs_lock = PTHREAD_MUTEX_INITIALIZER;
+static uint32_t g_nvs_commits = 0;
+static uint32_t g_nvs_fail_every = 0;    // Fail every n-th commit, 0 to never fail
+static bool g_nvs_fail_sets = false;     // Fail every nvs_set_*
+
+static nvs_stub_entry_t *nvs_stub_find(const char *key) {
+    for (int i = 0; i < NVS_STUB_KEYS; i++)
+        if (g_nvs[i].key[0] != '\0' && strcmp(g_nvs[i].key, key) == 0) return &g_nvs[i];
+    return NULL;
+}
+
+static esp_err_t nvs_stub_set(const char *key, const void *data, size_t len) {
+    pthread_mutex_lock(&g_nvs_lock);
+    nvs_stub_entry_t *entry = nvs_stub_find(key);
+    for (int i = 0; entry == NULL && i < NVS_STUB_KEYS; i++)
+        if (g_nvs[i].key[0] == '\0') entry = &g_nvs[i];
+    const esp_err_t err = g_nvs_fail_sets || entry == NULL || len > sizeof(entry->data) ? ESP_ERR_NVS_NOT_ENOUGH_SPACE : ESP_OK;
+    if (err == ESP_OK) {
+        snprintf(entry->key, sizeof(entry->key), "%s", key);
+        memcpy(entry->data, data, len);
+        entry->len = len;
+    }
+    pthread_mutex_unlock(&g_nvs_lock);
+    return err;
+}
+
+static esp_err_t nvs_stub_get(const char *key, void *data, size_t *len) {
+    pthread_mutex_lock(&g_nvs_lock);
+    const nvs_stub_entry_t *entry = nvs_stub_find(key);
+    esp_err_t err = ESP_ERR_NVS_NOT_FOUND;
+    if (entry != NULL) {
+        memcpy(data, entry->data, entry->len < *len ? entry->len : *len);
+        *len = entry->len;
+        err = ESP_OK;
+    }
+    pthread_mutex_unlock(&g_nvs_lock);
+    return err;
+}
+
+esp_err_t nvs_open(const char *name, nvs_open_mode_t mode, nvs_handle_t *handle) {
+    (void)name; (void)mode;
+    *handle = 1;
+    return ESP_OK;
+}
+
+void nvs_close(nvs_handle_t handle) {
+    (void)handle;
+}
+
+esp_err_t nvs_commit(nvs_handle_t handle) {
+    (void)handle;
+    pthread_mutex_lock(&g_nvs_lock);
+    const bool fail = g_nvs_fail_every != 0 && (g_nvs_commits + 1) % g_nvs_fail_every == 0;
+    g_nvs_commits++;
+    pthread_mutex_unlock(&g_nvs_lock);
+    return fail ? ESP_FAIL : ESP_OK;
+}
+
+esp_err_t nvs_set_u8(nvs_handle_t handle, const char *key, uint8_t value) {
+    (void)handle;
+    return nvs_stub_set(key, &value, 1);
+}
+
+esp_err_t nvs_get_u8(nvs_handle_t handle, const char *key, uint8_t *value) {
+    (void)handle;
+    size_t len = 1;
+    return nvs_stub_get(key, value, &len);
+}
+
+esp_err_t nvs_set_blob(nvs_handle_t handle, const char *key, const void *value, size_t length) {
+    (void)handle;
+    return nvs_stub_set(key, value, length);
+}
+
+esp_err_t nvs_get_blob(nvs_handle_t handle, const char *key, void *value, size_t *length) {
+    (void)handle;
+    return nvs_stub_get(key, value, length);
+}
+
+esp_err_t nvs_erase_key(nvs_handle_t handle, const char *key) {
+    (void)handle;
+    pthread_mutex_lock(&g_nvs_lock);
+    nvs_stub_entry_t *entry = nvs_stub_find(key);
+    if (entry != NULL) memset(entry, 0, sizeof(nvs_stub_entry_t));
+    pthread_mutex_unlock(&g_nvs_lock);
+    return entry != NULL ? ESP_OK : ESP_ERR_NVS_NOT_FOUND;
+}
+
+// --------- PLATFORM STUBS --------- //
+
+static shutdown_handler_t g_shutdown_handler = NULL;
+
+esp_err_t esp_register_shutdown_handler(shutdown_handler_t handler) {
+    g_shutdown_handler = handler;
+    return ESP_OK;
+}
+
+uint32_t esp_rom_crc32_le(uint32_t crc, const uint8_t *buf, uint32_t len) {
+    crc = ~crc;
+    for (uint32_t i = 0; i < len; i++) {
+        crc ^= buf[i];
+        for (int bit = 0; bit < 8; bit++) crc = crc >> 1 ^ (0xEDB88320 & -(crc & 1));
+    }
+    return ~crc;
+}
+
+// --------- CHECKS --------- //
+
+static int g_failures = 0;
+
+static void storm_expect(bool ok, const char *what) {
+    printf("%-60s %s\n", what, ok ? "ok" : "FAIL");
+    if (!ok) g_failures++;
+}
+
+static void storm_seed_legacy(void) {
+    memset(g_nvs, 0, sizeof(g_nvs));
+    nvs_set_u8(1, "state", RMT_APP_LED_ON);
+    nvs_set_u8(1, "mode", RMT_APP_LED_MODE_STATIC);
+    nvs_set_u8(1, "red", 10);
+    nvs_set_u8(1, "green", 20);
+    nvs_set_u8(1, "blue", 30);
+}
+
+static bool storm_config_is(const rmt_app_active_config_t *config, uint8_t state, uint8_t mode, uint8_t red, uint8_t green, uint8_t blue) {
+    return config->state == state && config->mode == mode && config->colors.red == red && config->colors.green == green && config->colors.blue == blue;
+}
+
+static void storm_check_migration(void) {
+    rmt_app_active_config_t config = {0};
+    uint8_t value;
+
+    // A blob which can't be written must not cost the legacy keys
+    storm_seed_legacy();
+    g_nvs_fail_sets = true;
+    const esp_err_t err = rmt_store_load(&config);
+    g_nvs_fail_sets = false;
+    storm_expect(err == ESP_OK && storm_config_is(&config, RMT_APP_LED_ON, RMT_APP_LED_MODE_STATIC, 10, 20, 30),
+                 "failed migration still loads the legacy state");
+    storm_expect(nvs_get_u8(1, "blue", &value) == ESP_OK && nvs_stub_find(RMT_STORE_BLOB_KEY) == NULL, "failed migration keeps the legacy keys");
+
+    memset(&config, 0, sizeof(config));
+    storm_expect(rmt_store_load(&config) == ESP_OK && storm_config_is(&config, RMT_APP_LED_ON, RMT_APP_LED_MODE_STATIC, 10, 20, 30),
+                 "migration is retried on the next boot");
+    storm_expect(nvs_get_u8(1, "state", &value) == ESP_ERR_NVS_NOT_FOUND && nvs_get_u8(1, "blue", &value) == ESP_ERR_NVS_NOT_FOUND,
+                 "legacy keys are erased once the blob is committed");
+
+    memset(&config, 0, sizeof(config));
+    storm_expect(rmt_store_load(&config) == ESP_OK && storm_config_is(&config, RMT_APP_LED_ON, RMT_APP_LED_MODE_STATIC, 10, 20, 30),
+                 "migrated blob loads with a valid CRC");
+    storm_expect(config.brightness == 255, "legacy state loads at full brightness");
+
+    // Blob written before the brightness was stored: version, state, mode, red, green, blue and the CRC
+    uint8_t v1[10] = {1, RMT_APP_LED_ON, RMT_APP_LED_MODE_RAINBOW, 40, 50, 60};
+    const uint32_t crc = esp_rom_crc32_le(0, v1, 6);
+    memcpy(&v1[6], &crc, sizeof(crc));
+    nvs_set_blob(1, RMT_STORE_BLOB_KEY, v1, sizeof(v1));
+    memset(&config, 0, sizeof(config));
+    storm_expect(rmt_store_load(&config) == ESP_OK && storm_config_is(&config, RMT_APP_LED_ON, RMT_APP_LED_MODE_RAINBOW, 40, 50, 60) &&
+                 config.brightness == 255, "version 1 blob loads at full brightness");
+    v1[3] ^= 1;
+    nvs_set_blob(1, RMT_STORE_BLOB_KEY, v1, sizeof(v1));
+    storm_expect(rmt_store_load(&config) == ESP_ERR_INVALID_CRC, "corrupted version 1 blob is rejected");
+}
+
+typedef struct {
+    int id;
+    TickType_t until;
+    uint32_t marks;
+} storm_thread_t;
+
+// The last marked state, the marks of both threads are serialized so "last" is well defined
+static pthread_mutex_t g_last_lock = PTHREAD_MUTEX_INITIALIZER;
+static rmt_app_active_config_t g_last;
+
+static void *storm_thread(void *arg) {
+    storm_thread_t *thread = arg;
+    unsigned int seed = thread->id;
+    while (xTaskGetTickCount() < thread->until) {
+        const rmt_app_active_config_t config = {
+            .state = rand_r(&seed) % 8 == 0 ? RMT_APP_LED_OFF : RMT_APP_LED_ON,
+            .mode = rand_r(&seed) % RMT_APP_LED_MODES_COUNT,
+            .colors = {.red = rand_r(&seed) % 256, .green = rand_r(&seed) % 256, .blue = rand_r(&seed) % 256},
+            .brightness = rand_r(&seed) % 256,
+        };
+        pthread_mutex_lock(&g_last_lock);
+        rmt_store_mark_dirty(&config);
+        g_last = config;
+        pthread_mutex_unlock(&g_last_lock);
+        thread->marks++;
+        vTaskDelay(pdMS_TO_TICKS(STORM_MARK_EVERY_MS));
+    }
+    return NULL;
+}
+
+static void storm_run(uint32_t minutes) {
+    const uint32_t nvs_commits_start = g_nvs_commits;
+    rmt_store_start();
+    storm_expect(g_shutdown_handler != NULL, "shutdown flush is registered");
+
+    g_nvs_fail_every = STORM_FAIL_EVERY;
+    const TickType_t start = xTaskGetTickCount();
+    storm_thread_t threads[STORM_THREADS];
+    pthread_t handles[STORM_THREADS];
+    for (int i = 0; i < STORM_THREADS; i++) {
+        threads[i] = (storm_thread_t){.id = i + 1, .until = start + pdMS_TO_TICKS(minutes * 60000)};
+        pthread_create(&handles[i], NULL, storm_thread, &threads[i]);
+    }
+    uint32_t marks = 0;
+    for (int i = 0; i < STORM_THREADS; i++) {
+        pthread_join(handles[i], NULL);
+        marks += threads[i].marks;
+    }
+    g_nvs_fail_every = 0;
+
+    // esp_restart() right after the storm
+    g_shutdown_handler();
+    const double elapsed_min = (xTaskGetTickCount() - start) / 60000.0;
+
+    const rmt_store_stats_t stats = rmt_store_get_stats();
+    const uint32_t nvs_commits = g_nvs_commits - nvs_commits_start;
+    const uint32_t max_commits = (uint32_t)(elapsed_min * 60000 / RMT_STORE_DEFAULT_INTERVAL_MS) + 2;
+    printf("\n%.1f min of firmware time, %lu state changes from %d threads\n", elapsed_min, (unsigned long)marks, STORM_THREADS);
+    printf("NVS commits %lu (%lu succeeded, %lu failed), %.0f per hour for %.0f state changes per hour\n\n",
+           (unsigned long)nvs_commits, (unsigned long)stats.commits, (unsigned long)stats.failures,
+           nvs_commits * 60 / elapsed_min, marks * 60 / elapsed_min);
+
+    storm_expect(stats.marks == marks, "every state change is counted");
+    storm_expect(stats.commits + stats.failures == nvs_commits, "every commit is counted as success or failure");
+    storm_expect(stats.failures > 0, "injected commit failures are counted");
+    storm_expect(nvs_commits <= max_commits, "at most one commit per interval, plus the flush");
+
+    rmt_app_active_config_t stored = {0};
+    storm_expect(rmt_store_load(&stored) == ESP_OK, "stored blob loads with a valid CRC");
+    storm_expect(storm_config_is(&stored, g_last.state, g_last.mode, g_last.colors.red, g_last.colors.green, g_last.colors.blue) &&
+                 stored.brightness == g_last.brightness, "last state change is in NVS after the flush");
+
+    // A failed write is retried without any further change. The task may still be holding back the last storm change.
+    rmt_store_set_interval(100);
+    vTaskDelay(pdMS_TO_TICKS(RMT_STORE_DEFAULT_INTERVAL_MS));
+    const rmt_app_active_config_t last = {.state = RMT_APP_LED_ON, .mode = RMT_APP_LED_MODE_RAINBOW, .colors = {.red = 1, .green = 2, .blue = 3}};
+    g_nvs_fail_every = 1;
+    rmt_store_mark_dirty(&last);
+    vTaskDelay(pdMS_TO_TICKS(250));
+    g_nvs_fail_every = 0;
+    vTaskDelay(pdMS_TO_TICKS(250));
+    memset(&stored, 0, sizeof(stored));
+    storm_expect(rmt_store_get_stats().failures >= stats.failures + 2, "the write keeps failing while NVS does");
+    storm_expect(rmt_store_load(&stored) == ESP_OK && storm_config_is(&stored, RMT_APP_LED_ON, RMT_APP_LED_MODE_RAINBOW, 1, 2, 3),
+                 "a failed write is retried until it succeeds");
+}
+
+int main(int argc, char *argv[]) {
+    const uint32_t minutes = argc > 1 ? strtoul(argv[1], NULL, 10) : 10;
+    host_tick_us = STORM_TICK_US;
+
+    storm_check_migration();
+    storm_run(minutes);
+
+    printf(g_failures == 0 ? "\nPASS\n" : "\n%d check(s) failed\n", g_failures);
+    return g_failures == 0 ? 0 : 1;
+}
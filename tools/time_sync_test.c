@@ -0,0 +1,93 @@
+/*
+ * Host test of the wall clock to esp_timer conversion used for "apply_at".
+ * Checks the range limits, and that a timestamp converted while SNTP slews the wall clock
+ * still lands where the slewed wall clock reaches it.
+ *
+ * Build and run from the repository root:
+ *     cc -O2 -Imain tools/time_sync_test.c -o time_sync_test
+ *     ./time_sync_test
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "time_sync/time_sync.h"
+
+#define TEST_WALL_NOW_US        1792368000000000LL  // 2026-10-19 00:00 UTC
+#define TEST_LOCAL_NOW_US       3600000000LL        // One hour after boot
+#define TEST_SLEW_PPM           500                 // Fastest adjtime() slew of the SNTP smooth sync
+
+static int g_failures = 0;
+
+static void test_expect(bool ok, const char *what) {
+    if (ok) return;
+    printf("FAIL: %s\n", what);
+    g_failures++;
+}
+
+static void test_convert(int64_t wall_ms, bool expected_ok, int64_t expected_us, const char *what) {
+    int64_t local_us = 0;
+    const bool ok = time_sync_convert_us(wall_ms, TEST_WALL_NOW_US, TEST_LOCAL_NOW_US, &local_us);
+    test_expect(ok == expected_ok && (!ok || local_us == expected_us), what);
+}
+
+/**
+ * The wall clock runs faster than esp_timer by slew_ppm while SNTP corrects an offset.
+ * A timestamp converted at "sample_us" should fire when the wall clock reaches it, give or take the slew
+ * accumulated until then, which is the error rmt_app_schedule_messages() has to live with.
+ */
+static void test_slew(int64_t ahead_ms, int32_t slew_ppm) {
+    const int64_t target_ms = TEST_WALL_NOW_US / 1000 + ahead_ms;
+    int64_t worst_us = 0;
+    for (int64_t sample_us = 0; sample_us < ahead_ms * 1000; sample_us += ahead_ms * 100) {
+        const int64_t local_now_us = TEST_LOCAL_NOW_US + sample_us;
+        const int64_t wall_now_us = TEST_WALL_NOW_US + sample_us + sample_us * slew_ppm / 1000000;
+        int64_t due_us;
+        if (!time_sync_convert_us(target_ms, wall_now_us, local_now_us, &due_us)) {
+            test_expect(false, "slewed conversion in range");
+            return;
+        }
+
+        // Local time at which the slewed wall clock actually reaches the target
+        const int64_t exact_us = TEST_LOCAL_NOW_US + (target_ms * 1000 - TEST_WALL_NOW_US) * 1000000 / (1000000 + slew_ppm);
+        const int64_t error_us = llabs(due_us - exact_us);
+        if (error_us > worst_us) worst_us = error_us;
+
+        // The error shrinks as the sample gets closer to the due time, it is bounded by the slew of the remaining wait
+        const int64_t bound_us = (exact_us - local_now_us) * abs(slew_ppm) / 1000000 + 1;
+        if (error_us > bound_us) {
+            printf("FAIL: %lld ms ahead at %d ppm, sampled %lld ms in: error %lld us > %lld us\n",
+                   (long long)ahead_ms, (int)slew_ppm, (long long)(sample_us / 1000), (long long)error_us, (long long)bound_us);
+            g_failures++;
+            return;
+        }
+    }
+    printf("%6lld ms ahead at %+5d ppm: worst error %lld us\n", (long long)ahead_ms, (int)slew_ppm, (long long)worst_us);
+}
+
+int main(void) {
+    const int64_t now_ms = TEST_WALL_NOW_US / 1000;
+    test_convert(now_ms, true, TEST_LOCAL_NOW_US, "now maps to now");
+    test_convert(now_ms + 1500, true, TEST_LOCAL_NOW_US + 1500000, "future timestamp");
+    test_convert(now_ms - 250, true, TEST_LOCAL_NOW_US - 250000, "past timestamp");
+    test_convert(0, true, TEST_LOCAL_NOW_US - TEST_WALL_NOW_US, "epoch");
+    test_convert(TIME_SYNC_MAX_WALL_MS, true, TEST_LOCAL_NOW_US + (TIME_SYNC_MAX_WALL_MS * 1000 - TEST_WALL_NOW_US), "largest timestamp");
+    test_convert(TIME_SYNC_MAX_WALL_MS + 1, false, 0, "beyond the largest timestamp");
+    test_convert(-1, false, 0, "negative timestamp");
+    test_convert(INT64_MAX, false, 0, "INT64_MAX would overflow");
+    test_convert(INT64_MAX / 1000 + 1, false, 0, "first value overflowing the scaling");
+
+    int64_t local_us;
+    test_expect(!time_sync_convert_us(now_ms, -1, TEST_LOCAL_NOW_US, &local_us), "negative wall clock sample");
+    test_expect(!time_sync_convert_us(now_ms, INT64_MAX, TEST_LOCAL_NOW_US, &local_us), "wall clock sample out of range");
+
+    // Up to the rmt_app schedule limit of 60 s
+    static const int64_t ahead_ms[] = {100, 5000, 60000};
+    static const int32_t slew_ppm[] = {-TEST_SLEW_PPM, 0, TEST_SLEW_PPM};
+    for (size_t i = 0; i < sizeof(ahead_ms) / sizeof(ahead_ms[0]); i++)
+        for (size_t j = 0; j < sizeof(slew_ppm) / sizeof(slew_ppm[0]); j++)
+            test_slew(ahead_ms[i], slew_ppm[j]);
+
+    printf(g_failures == 0 ? "All checks passed\n" : "%d check(s) failed\n", g_failures);
+    return g_failures == 0 ? 0 : 1;
+}
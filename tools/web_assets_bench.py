@@ -0,0 +1,95 @@
+#!/usr/bin/env python3
+"""
+Measures the page load of the web UI on a running controller: a cold load of / and every asset it references,
+then --reloads warm reloads which revalidate with If-None-Match the way a browser does. Reports the time and the
+bytes of every pass and the SPIFFS reads the firmware counted for it (the "assets" block of /stats).
+
+Usage:
+    web_assets_bench.py 192.168.0.1 [--reloads 10]
+
+Run it right after a reboot to see the cold cache, the cold load also counts the first GET / which finds the
+referenced assets. With embedded assets the flash read counters stay at zero.
+No on-device figures have been recorded yet; the script has only been exercised against a local stub server.
+"""
+
+import argparse
+import http.client
+import json
+import re
+import time
+
+REFERENCE = re.compile(r'(?:src|href)="(/[^"#?]*)"')
+
+
+def assets_stats(conn):
+    conn.request("GET", "/stats")
+    response = conn.getresponse()
+    body = response.read()
+    if response.status != 200:
+        return {}
+    return json.loads(body).get("assets", {})
+
+
+def fetch(conn, path, etags):
+    headers = {"Accept-Encoding": "gzip"}
+    if path in etags:
+        headers["If-None-Match"] = etags[path]
+    start = time.monotonic()
+    conn.request("GET", path, headers=headers)
+    response = conn.getresponse()
+    body = response.read()
+    elapsed = time.monotonic() - start
+    if response.getheader("ETag"):
+        etags[path] = response.getheader("ETag")
+    return response.status, body, elapsed
+
+
+def load_page(conn, etags, paths):
+    """Fetches every path one after the other on one kept alive connection, like a browser with a single socket"""
+    total_bytes, total_time, statuses = 0, 0.0, {}
+    for path in paths:
+        status, body, elapsed = fetch(conn, path, etags)
+        total_bytes += len(body)
+        total_time += elapsed
+        statuses[status] = statuses.get(status, 0) + 1
+    return total_bytes, total_time, statuses
+
+
+def report(name, conn, before, total_bytes, total_time, statuses):
+    after = assets_stats(conn)
+    reads = after.get("flash_reads", 0) - before.get("flash_reads", 0)
+    read_bytes = after.get("flash_bytes", 0) - before.get("flash_bytes", 0)
+    print("%-14s %8.1f ms %9d bytes   flash %5d reads %9d bytes   %s"
+          % (name, total_time * 1000, total_bytes, reads, read_bytes,
+             " ".join("%d x%d" % item for item in sorted(statuses.items()))))
+    return after
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("host")
+    parser.add_argument("--port", type=int, default=80)
+    parser.add_argument("--reloads", type=int, default=10)
+    args = parser.parse_args()
+
+    conn = http.client.HTTPConnection(args.host, args.port, timeout=10)
+    etags = {}
+    stats = assets_stats(conn)
+
+    status, index, _ = fetch(conn, "/", etags)
+    if status != 200:
+        print("GET / answered %d" % status)
+        return
+    paths = ["/"] + sorted(set(REFERENCE.findall(index.decode("utf-8", "replace"))))
+    etags.clear()
+    print("%d files: %s" % (len(paths), " ".join(paths)))
+
+    stats = report("cold load", conn, stats, *load_page(conn, etags, paths))
+    stats = report("uncached load", conn, stats, *load_page(conn, {}, paths))
+    for i in range(args.reloads):
+        stats = report("reload %d" % (i + 1), conn, stats, *load_page(conn, etags, paths))
+    conn.close()
+
+
+if __name__ == "__main__":
+    main()